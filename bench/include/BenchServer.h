@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+
+class Server;
+
+
+// Runs a Server on a free loopback port for the lifetime of the object. Kept apart from Server.h so
+// benchmarks that drive the Client do not pull in both headers' ReceiveResult definitions.
+class BenchServer {
+public:
+    BenchServer(const std::string &directory, size_t workerThreads, size_t listenerShards = 1, bool pinShards = false);
+
+    int port() const;
+
+    ~BenchServer();
+
+private:
+    std::unique_ptr<Server> _server;
+    std::thread _thread;
+    int _port;
+};
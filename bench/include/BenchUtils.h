@@ -0,0 +1,35 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "Socket.h"
+
+
+// Connected TCP pair over 127.0.0.1, so benchmarks exercise the same stack as real clients.
+bool createLoopbackPair(Socket &serverSide, Socket &clientSide);
+
+std::string createTempDirectory();
+void removeDirectory(const std::string &path);
+bool writePatternFile(const std::string &path, size_t size);
+
+off_t fileSize(const std::string &path);
+
+double wallSeconds();
+double threadCpuSeconds();
+
+
+// Discards std::cout output (server and client progress messages) while in scope.
+class CoutSilencer {
+public:
+    CoutSilencer() : _original(std::cout.rdbuf(nullptr)) {
+    }
+
+    ~CoutSilencer() {
+        std::cout.rdbuf(_original);
+        std::cout.clear();
+    }
+
+private:
+    std::streambuf *_original;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+
+int runGetBenchmark(int argc, char **argv);
+int runStripeBenchmark(int argc, char **argv);
+int runIoBenchmark(int argc, char **argv);
+int runPoolBenchmark(int argc, char **argv);
+int runMicroBenchmark(int argc, char **argv);
+int runShardBenchmark(int argc, char **argv);
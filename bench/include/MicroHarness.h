@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+
+// One operation measured by the micro-benchmarks. The constructor does slow preparation such as creating files;
+// setUp() starts sockets and threads, because syscalls are counted in a forked child that must start its own.
+class MicroBenchmark {
+public:
+    virtual ~MicroBenchmark() = default;
+
+    virtual bool setUp() {
+        return true;
+    }
+
+    virtual void run(uint64_t operations) = 0;
+
+    virtual void tearDown() {
+    }
+};
+
+
+struct MicroResult {
+    uint64_t operations;
+    double nanosPerOp;
+    double allocationsPerOp; // operator new calls, on any thread
+    double syscallsPerOp; // on any thread; negative when they cannot be counted
+};
+
+
+// Times enough operations to run for about a quarter of a second, counting allocations along the way, then
+// counts syscalls in a ptrace'd child process so the tracing does not slow down the timed run.
+bool measureMicroBenchmark(MicroBenchmark &benchmark, MicroResult &result);
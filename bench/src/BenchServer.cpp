@@ -0,0 +1,59 @@
+#include "BenchServer.h"
+#include "Server.h"
+
+#include <chrono>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+
+namespace {
+    int findFreePort() {
+        const int probeFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+
+        bind(probeFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        getsockname(probeFd, reinterpret_cast<sockaddr *>(&addr), &addrLen);
+        close(probeFd);
+        return ntohs(addr.sin_port);
+    }
+
+    bool isListening(const int port) {
+        const int probeFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+
+        const bool connected = connect(probeFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        close(probeFd);
+        return connected;
+    }
+}
+
+
+BenchServer::BenchServer(const std::string &directory, const size_t workerThreads, const size_t listenerShards,
+                         const bool pinShards) :
+    _server(new Server(directory, workerThreads, workerThreads, 4096, IoEngineType::BLOCKING,
+                       FileCache::DEFAULT_BUDGET, listenerShards, pinShards)), _port(findFreePort()) {
+    Server *server = _server.get();
+    const int port = _port;
+    _thread = std::thread([server, port] { server->start(port); });
+
+    for (int attempt = 0; attempt < 200 && !isListening(_port); ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+
+int BenchServer::port() const {
+    return _port;
+}
+
+
+BenchServer::~BenchServer() {
+    _server->shutdown();
+    _thread.join();
+}
@@ -0,0 +1,128 @@
+#include "BenchUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+
+bool createLoopbackPair(Socket &serverSide, Socket &clientSide) {
+    const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd == -1) {
+        perror("socket");
+        return false;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 || listen(listenFd, 1) == -1 ||
+        getsockname(listenFd, reinterpret_cast<sockaddr *>(&addr), &addrLen) == -1) {
+        perror("loopback listener");
+        close(listenFd);
+        return false;
+    }
+
+    if (!clientSide.createS() || !clientSide.connectS("127.0.0.1", ntohs(addr.sin_port))) {
+        close(listenFd);
+        return false;
+    }
+
+    serverSide.setS(accept(listenFd, nullptr, nullptr));
+    close(listenFd);
+    return serverSide.getS() != -1;
+}
+
+
+std::string createTempDirectory() {
+    char pathTemplate[] = "/tmp/client-server-bench-XXXXXX";
+    if (mkdtemp(pathTemplate) == nullptr) {
+        perror("mkdtemp");
+        return "";
+    }
+    return std::string(pathTemplate) + "/";
+}
+
+
+void removeDirectory(const std::string &path) {
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        const std::string entryPath = path + "/" + name;
+        struct stat entryStat{};
+        if (lstat(entryPath.c_str(), &entryStat) == 0 && S_ISDIR(entryStat.st_mode)) {
+            removeDirectory(entryPath);
+        } else {
+            unlink(entryPath.c_str());
+        }
+    }
+
+    closedir(dir);
+    rmdir(path.c_str());
+}
+
+
+bool writePatternFile(const std::string &path, const size_t size) {
+    const int fileFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fileFd == -1) {
+        perror("open");
+        return false;
+    }
+
+    std::vector<char> block(1024 * 1024);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<char>(i * 31 + i / 4096);
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        const size_t chunkSize = std::min(block.size(), size - written);
+        if (write(fileFd, block.data(), chunkSize) != static_cast<ssize_t>(chunkSize)) {
+            perror("write");
+            close(fileFd);
+            return false;
+        }
+        written += chunkSize;
+    }
+
+    close(fileFd);
+    return true;
+}
+
+
+off_t fileSize(const std::string &path) {
+    struct stat fileStat{};
+    return stat(path.c_str(), &fileStat) == 0 ? fileStat.st_size : -1;
+}
+
+
+double wallSeconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+double threadCpuSeconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
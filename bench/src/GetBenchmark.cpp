@@ -0,0 +1,146 @@
+#include "Benchmarks.h"
+#include "BenchUtils.h"
+#include "Crc32c.h"
+#include "Server.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+
+namespace {
+    const std::string BENCH_USER = "bench";
+    const std::string BENCH_FILE = "payload.bin";
+
+    struct GetMode {
+        const char *name;
+        TransferOptions options;
+    };
+
+    // Plays the client side of a GET: reads the status, acknowledges it and drains the payload. With checksums
+    // it also checksums what arrives and compares it with the trailer; a mismatch reports no bytes received.
+    void drainGet(const Socket &clientSide, const TransferOptions &options, size_t &receivedBytes) {
+        char status[MESSAGE_SIZE] = {};
+        clientSide.receiveData(status, sizeof(status));
+        clientSide.sendData(RESPONSE_ACK.c_str());
+        uint32_t crc = 0;
+
+        if (options.streamGet) {
+            const size_t expectedBytes = std::stoull(std::string(status).substr(RESPONSE_OK.size()));
+            std::vector<char> buffer(STREAM_BUFFER_SIZE);
+            while (receivedBytes < expectedBytes) {
+                const ssize_t chunkSize = recv(clientSide.getS(), buffer.data(),
+                                               std::min(buffer.size(), expectedBytes - receivedBytes), 0);
+                if (chunkSize <= 0) {
+                    break;
+                }
+                if (options.checksum) {
+                    crc = crc32c(crc, buffer.data(), chunkSize);
+                }
+                receivedBytes += chunkSize;
+            }
+        } else {
+            std::vector<char> buffer(options.dataFrameSize());
+            ssize_t chunkSize;
+            while ((chunkSize = clientSide.receiveData(buffer.data(), buffer.size())) > 0) {
+                if (options.checksum) {
+                    crc = crc32c(crc, buffer.data(), chunkSize);
+                }
+                receivedBytes += chunkSize;
+            }
+        }
+
+        uint32_t serverCrc;
+        if (options.checksum && (!receiveChecksumTrailer(clientSide, serverCrc) || serverCrc != crc)) {
+            receivedBytes = 0;
+        }
+    }
+
+    bool runRound(const Server &server, const TransferOptions &options, const size_t fileSize, double &seconds,
+                  double &serverCpuSeconds) {
+        Socket serverSide, clientSide;
+        if (!createLoopbackPair(serverSide, clientSide)) {
+            return false;
+        }
+
+        size_t receivedBytes = 0;
+        std::thread client(drainGet, std::cref(clientSide), std::cref(options), std::ref(receivedBytes));
+
+        const double wallStart = wallSeconds();
+        const double cpuStart = threadCpuSeconds();
+        server.handleGet(serverSide, BENCH_USER, BENCH_FILE, options);
+        serverCpuSeconds = threadCpuSeconds() - cpuStart;
+
+        client.join();
+        seconds = wallSeconds() - wallStart;
+
+        serverSide.closeS();
+        clientSide.closeS();
+        return receivedBytes == fileSize;
+    }
+}
+
+
+int runGetBenchmark(const int argc, char **argv) {
+    const size_t sizeMiB = argc > 0 ? std::stoul(argv[0]) : 256;
+    const int rounds = argc > 1 ? std::stoi(argv[1]) : 3;
+    const size_t fileSize = sizeMiB * 1024 * 1024;
+
+    const std::string directory = createTempDirectory();
+    if (directory.empty() || mkdir((directory + BENCH_USER).c_str(), 0777) == -1 ||
+        !writePatternFile(directory + BENCH_USER + "/" + BENCH_FILE, fileSize)) {
+        removeDirectory(directory);
+        return 1;
+    }
+
+    std::cout << "GET benchmark: " << sizeMiB << " MiB file, best of " << rounds << " round(s), CRC-32C via "
+            << crc32cImplementation() << "\n\n"
+            << std::left << std::setw(24) << "mode" << std::setw(18) << "throughput MiB/s"
+            << "server CPU s/GiB" << std::endl;
+
+    // the stream rounds after the first send the checksum stored by it instead of reading the file back
+    std::vector<GetMode> modes(5);
+    modes[0].name = "framed 1 KiB";
+    modes[1].name = "framed 1 MiB (sendmsg)";
+    modes[1].options.frameSize = 1024 * 1024;
+    modes[2].name = "framed 1 MiB + crc32c";
+    modes[2].options.frameSize = 1024 * 1024;
+    modes[2].options.checksum = true;
+    modes[3].name = "stream (sendfile)";
+    modes[3].options.streamGet = true;
+    modes[4].name = "stream + crc32c";
+    modes[4].options.streamGet = true;
+    modes[4].options.checksum = true;
+
+    int exitCode = 0;
+    {
+        const Server server(directory, 1, 1, 1);
+        for (const GetMode &mode: modes) {
+            double bestSeconds = 0, bestCpuSeconds = 0;
+            for (int round = 0; round < rounds; ++round) {
+                double seconds = 0, cpuSeconds = 0;
+                if (!runRound(server, mode.options, fileSize, seconds, cpuSeconds)) {
+                    std::cout << "round failed: short transfer" << std::endl;
+                    exitCode = 1;
+                    break;
+                }
+                if (round == 0 || seconds < bestSeconds) {
+                    bestSeconds = seconds;
+                    bestCpuSeconds = cpuSeconds;
+                }
+            }
+
+            const double gib = static_cast<double>(fileSize) / (1024.0 * 1024.0 * 1024.0);
+            std::cout << std::left << std::setw(24) << mode.name
+                    << std::setw(18) << std::fixed << std::setprecision(1) << sizeMiB / bestSeconds
+                    << std::setprecision(3) << bestCpuSeconds / gib << std::endl;
+        }
+    }
+
+    removeDirectory(directory);
+    return exitCode;
+}
@@ -0,0 +1,152 @@
+#include "Benchmarks.h"
+#include "BenchUtils.h"
+#include "Server.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+
+namespace {
+    const std::string BENCH_USER = "bench";
+    const std::string BENCH_FILE = "payload.bin";
+    constexpr uint32_t BENCH_FRAME_SIZE = 256 * 1024;
+
+    struct EngineMode {
+        const char *name;
+        IoEngineType type;
+    };
+
+    bool clientGet(const Socket &clientSide) {
+        char status[MESSAGE_SIZE] = {};
+        clientSide.receiveData(status, sizeof(status));
+        clientSide.sendData(RESPONSE_ACK.c_str());
+
+        std::vector<char> buffer(BENCH_FRAME_SIZE);
+        ssize_t chunkSize;
+        while ((chunkSize = clientSide.receiveData(buffer.data(), buffer.size())) > 0) {
+        }
+        return chunkSize == 0;
+    }
+
+    bool clientPut(const Socket &clientSide, const std::vector<char> &payload) {
+        char status[MESSAGE_SIZE] = {};
+        clientSide.receiveData(status, sizeof(status));
+
+        for (size_t position = 0; position < payload.size(); position += BENCH_FRAME_SIZE) {
+            const size_t frameSize = std::min<size_t>(BENCH_FRAME_SIZE, payload.size() - position);
+            if (clientSide.sendData(payload.data() + position, frameSize) == -1) {
+                return false;
+            }
+        }
+        clientSide.sendData("", 0);
+        return clientSide.receiveData(status, sizeof(status)) > 0 && std::string(status) == RESPONSE_OK;
+    }
+
+    // One simulated connection issuing alternating GET and PUT requests, timing each one end to end.
+    void runSession(const Server &server, const int session, const int operations, const std::vector<char> &payload,
+                    std::vector<double> &latencies, bool &ok) {
+        Socket serverSide, clientSide;
+        if (!createLoopbackPair(serverSide, clientSide)) {
+            ok = false;
+            return;
+        }
+
+        TransferOptions options;
+        options.frameSize = BENCH_FRAME_SIZE;
+        const std::string putFile = "upload" + std::to_string(session) + ".bin";
+
+        for (int operation = 0; operation < operations && ok; ++operation) {
+            const bool get = operation % 2 == 0;
+            bool clientOk = false;
+            const double start = wallSeconds();
+            std::thread client([&] { clientOk = get ? clientGet(clientSide) : clientPut(clientSide, payload); });
+            if (get) {
+                server.handleGet(serverSide, BENCH_USER, BENCH_FILE, options);
+            } else {
+                server.handlePut(serverSide, BENCH_USER, putFile, options);
+            }
+            client.join();
+            latencies.push_back(wallSeconds() - start);
+            ok = clientOk;
+        }
+
+        serverSide.closeS();
+        clientSide.closeS();
+    }
+
+    double percentile(std::vector<double> &values, const double fraction) {
+        std::sort(values.begin(), values.end());
+        const size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+}
+
+
+int runIoBenchmark(const int argc, char **argv) {
+    const size_t sizeMiB = argc > 0 ? std::stoul(argv[0]) : 16;
+    const int sessions = argc > 1 ? std::stoi(argv[1]) : 4;
+    const int operations = argc > 2 ? std::stoi(argv[2]) : 16;
+    const size_t fileSize = sizeMiB * 1024 * 1024;
+
+    const std::string directory = createTempDirectory();
+    if (directory.empty() || mkdir((directory + BENCH_USER).c_str(), 0777) == -1 ||
+        !writePatternFile(directory + BENCH_USER + "/" + BENCH_FILE, fileSize)) {
+        removeDirectory(directory);
+        return 1;
+    }
+    const std::vector<char> payload(fileSize, 'x');
+
+    std::cout << "File I/O engine benchmark: " << sessions << " session(s) x " << operations
+            << " alternating GET/PUT of " << sizeMiB << " MiB, " << BENCH_FRAME_SIZE / 1024 << " KiB frames\n\n"
+            << std::left << std::setw(12) << "engine" << std::setw(18) << "throughput MiB/s" << std::setw(12)
+            << "p50 ms" << "p99 ms" << std::endl;
+
+    std::vector<EngineMode> modes = {{"blocking", IoEngineType::BLOCKING}, {"io_uring", IoEngineType::URING}};
+
+    int exitCode = 0;
+    for (const EngineMode &mode: modes) {
+        std::vector<std::vector<double> > latencies(sessions);
+        std::vector<char> results(sessions, true);
+        double seconds;
+        {
+            CoutSilencer silencer;
+            const Server server(directory, 1, 1, 1, mode.type);
+
+            std::vector<std::thread> threads;
+            const double start = wallSeconds();
+            for (int session = 0; session < sessions; ++session) {
+                threads.emplace_back([&, session] {
+                    bool ok = true;
+                    runSession(server, session, operations, payload, latencies[session], ok);
+                    results[session] = ok;
+                });
+            }
+            for (std::thread &thread: threads) {
+                thread.join();
+            }
+            seconds = wallSeconds() - start;
+        }
+
+        if (std::find(results.begin(), results.end(), false) != results.end()) {
+            std::cout << mode.name << ": transfer failed" << std::endl;
+            exitCode = 1;
+            continue;
+        }
+
+        std::vector<double> allLatencies;
+        for (const std::vector<double> &sessionLatencies: latencies) {
+            allLatencies.insert(allLatencies.end(), sessionLatencies.begin(), sessionLatencies.end());
+        }
+        const double totalMiB = static_cast<double>(sizeMiB) * sessions * operations;
+        std::cout << std::left << std::setw(12) << mode.name << std::setw(18) << std::fixed << std::setprecision(1)
+                << totalMiB / seconds << std::setw(12) << percentile(allLatencies, 0.5) * 1000
+                << percentile(allLatencies, 0.99) * 1000 << std::endl;
+    }
+
+    removeDirectory(directory);
+    return exitCode;
+}
@@ -0,0 +1,382 @@
+#include "Benchmarks.h"
+#include "BenchUtils.h"
+#include "Logger.h"
+#include "MetadataCache.h"
+#include "MicroHarness.h"
+#include "Server.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+    const std::string BENCH_USER = "bench";
+
+    bool createSocketPair(Socket &first, Socket &second) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+            perror("socketpair");
+            return false;
+        }
+        first = Socket(fds[0]);
+        second = Socket(fds[1]);
+        return true;
+    }
+
+    // Socket::sendData() on one end of a socketpair, receiveData() on the other, one frame per operation.
+    class SocketFrameBenchmark : public MicroBenchmark {
+    public:
+        explicit SocketFrameBenchmark(const size_t payloadSize) : _payload(payloadSize, 'x'), _buffer(payloadSize) {
+        }
+
+        bool setUp() override {
+            return createSocketPair(_sender, _receiver);
+        }
+
+        void run(const uint64_t operations) override {
+            std::thread sender([this, operations] {
+                for (uint64_t i = 0; i < operations; ++i) {
+                    _sender.sendData(_payload.data(), _payload.size());
+                }
+            });
+            for (uint64_t i = 0; i < operations; ++i) {
+                _receiver.receiveData(_buffer.data(), _buffer.size());
+            }
+            sender.join();
+        }
+
+        void tearDown() override {
+            _sender.closeS();
+            _receiver.closeS();
+        }
+
+    private:
+        const std::vector<char> _payload;
+        std::vector<char> _buffer;
+        Socket _sender, _receiver;
+    };
+
+    // Server::receiveMessage() on a command that is already waiting, as at the top of every request.
+    class ReceiveMessageBenchmark : public MicroBenchmark {
+    public:
+        bool setUp() override {
+            return createSocketPair(_sender, _receiver);
+        }
+
+        void run(const uint64_t operations) override {
+            std::thread sender([this, operations] {
+                for (uint64_t i = 0; i < operations; ++i) {
+                    _sender.sendData("INFO notes.txt");
+                }
+            });
+            char buffer[MESSAGE_SIZE];
+            for (uint64_t i = 0; i < operations; ++i) {
+                _status += static_cast<int>(
+                    Server::receiveMessage(_receiver, buffer, sizeof(buffer) - 1, BENCH_USER.c_str()).status);
+            }
+            sender.join();
+        }
+
+        void tearDown() override {
+            _sender.closeS();
+            _receiver.closeS();
+        }
+
+    private:
+        Socket _sender, _receiver;
+        volatile int _status{0};
+    };
+
+    // Server::classifyReceive() alone: building the ReceiveResult of a successful receive.
+    class ClassifyReceiveBenchmark : public MicroBenchmark {
+    public:
+        void run(const uint64_t operations) override {
+            for (uint64_t i = 0; i < operations; ++i) {
+                _status += static_cast<int>(Server::classifyReceive(14, BENCH_USER.c_str()).status);
+            }
+        }
+
+    private:
+        volatile int _status{0};
+    };
+
+    // Server::isValidFilename() and isValidUsername() over a mix of accepted and rejected names.
+    class NameValidationBenchmark : public MicroBenchmark {
+    public:
+        explicit NameValidationBenchmark(const bool filenames) : _filenames(filenames) {
+            if (filenames) {
+                _names = {"notes.txt", "quarterly-report-2024-final.pdf", "../etc/passwd", ".notes.txt.part",
+                          "photos/holiday.jpg", "archive_with_a_rather_long_name_0123456789.tar.gz"};
+            } else {
+                _names = {"alice", "bob42", "bad user", "Administrator", "x", "user_name"};
+            }
+        }
+
+        void run(const uint64_t operations) override {
+            for (uint64_t i = 0; i < operations; ++i) {
+                const std::string &name = _names[i % _names.size()];
+                _valid += _filenames ? Server::isValidFilename(name) : Server::isValidUsername(name);
+            }
+        }
+
+    private:
+        const bool _filenames;
+        std::vector<std::string> _names;
+        volatile int _valid{0};
+    };
+
+    // A user folder with the given number of files, removed again with the benchmark.
+    class FolderBenchmark : public MicroBenchmark {
+    public:
+        explicit FolderBenchmark(const size_t entries) : _directory(createTempDirectory()) {
+            const std::string folder = _directory + BENCH_USER + "/";
+            _prepared = !_directory.empty() && mkdir(folder.c_str(), 0777) == 0;
+            for (size_t i = 0; i < entries && _prepared; ++i) {
+                const int fileFd = open((folder + "file-" + std::to_string(i) + ".txt").c_str(),
+                                        O_WRONLY | O_CREAT, 0666);
+                _prepared = fileFd != -1 && close(fileFd) == 0;
+            }
+        }
+
+        ~FolderBenchmark() override {
+            removeDirectory(_directory);
+        }
+
+    protected:
+        const std::string _directory;
+        bool _prepared;
+    };
+
+    // Server::handleList() of a server whose metadata cache is not running, so every call reads the folder.
+    class HandleListBenchmark : public FolderBenchmark {
+    public:
+        explicit HandleListBenchmark(const size_t entries) : FolderBenchmark(entries) {
+        }
+
+        bool setUp() override {
+            if (!_prepared || !createSocketPair(_serverSide, _clientSide)) {
+                return false;
+            }
+            _server.reset(new Server(_directory, 1, 1, 1));
+            _drain = std::thread([this] {
+                const char *data;
+                while (_clientSide.receiveView(data, 64 * 1024 * 1024) >= 0) {
+                }
+            });
+            return true;
+        }
+
+        void run(const uint64_t operations) override {
+            for (uint64_t i = 0; i < operations; ++i) {
+                _server->handleList(_serverSide, BENCH_USER);
+            }
+        }
+
+        void tearDown() override {
+            _serverSide.closeS();
+            _drain.join();
+            _clientSide.closeS();
+            _server.reset();
+        }
+
+    private:
+        std::unique_ptr<Server> _server;
+        Socket _serverSide, _clientSide;
+        std::thread _drain;
+    };
+
+    // Server::handleGet() of a whole small file over a pipelined session, which skips the ACK, with the file
+    // cache on or off.
+    class HandleGetBenchmark : public FolderBenchmark {
+    public:
+        HandleGetBenchmark(const size_t fileSize, const bool cached) : FolderBenchmark(0), _cached(cached) {
+            const std::vector<char> data(fileSize, 'x');
+            const int fileFd = open((_directory + BENCH_USER + "/file.bin").c_str(), O_WRONLY | O_CREAT, 0666);
+            _prepared = _prepared && fileFd != -1 &&
+                        write(fileFd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+            if (fileFd != -1) {
+                close(fileFd);
+            }
+            _options.frameSize = 1024 * 1024;
+            _options.pipelined = true;
+        }
+
+        bool setUp() override {
+            // loopback TCP rather than a socketpair, since GET corks the socket
+            if (!_prepared || !createLoopbackPair(_serverSide, _clientSide)) {
+                return false;
+            }
+            _server.reset(new Server(_directory, 1, 1, 1, IoEngineType::BLOCKING,
+                                     _cached ? FileCache::DEFAULT_BUDGET : 0));
+            _drain = std::thread([this] {
+                const char *data;
+                while (_clientSide.receiveView(data, 64 * 1024 * 1024) >= 0) {
+                }
+            });
+            return true;
+        }
+
+        void run(const uint64_t operations) override {
+            for (uint64_t i = 0; i < operations; ++i) {
+                _server->handleGet(_serverSide, BENCH_USER, "file.bin", _options);
+            }
+        }
+
+        void tearDown() override {
+            _serverSide.closeS();
+            _drain.join();
+            _clientSide.closeS();
+            _server.reset();
+        }
+
+    private:
+        const bool _cached;
+        TransferOptions _options;
+        std::unique_ptr<Server> _server;
+        Socket _serverSide, _clientSide;
+        std::thread _drain;
+    };
+
+    // MetadataCache::list() once warmed up, which is what handleList() answers from on a running server.
+    class CachedListBenchmark : public FolderBenchmark {
+    public:
+        explicit CachedListBenchmark(const size_t entries) : FolderBenchmark(entries) {
+        }
+
+        bool setUp() override {
+            _cache.reset(new MetadataCache(_directory, &Server::isPartialFilename));
+            return _prepared && _cache->start(1);
+        }
+
+        void run(const uint64_t operations) override {
+            std::string listing;
+            for (uint64_t i = 0; i < operations; ++i) {
+                _cache->list(BENCH_USER, listing);
+            }
+        }
+
+        void tearDown() override {
+            _cache.reset();
+        }
+
+    private:
+        std::unique_ptr<MetadataCache> _cache;
+    };
+
+    // ThreadPool::submit() of a small task, until the workers have run all of them.
+    class PoolSubmitBenchmark : public MicroBenchmark {
+    public:
+        explicit PoolSubmitBenchmark(const size_t workers) : _workers(workers) {
+        }
+
+        bool setUp() override {
+            _pool.reset(new ThreadPool(_workers));
+            return true;
+        }
+
+        void run(const uint64_t operations) override {
+            std::atomic<uint64_t> done{0};
+            std::atomic<uint64_t> *counter = &done;
+            for (uint64_t i = 0; i < operations; ++i) {
+                _pool->submit([counter] { counter->fetch_add(1, std::memory_order_relaxed); });
+            }
+            while (done.load(std::memory_order_relaxed) < operations) {
+                std::this_thread::yield();
+            }
+        }
+
+        void tearDown() override {
+            _pool.reset();
+        }
+
+    private:
+        const size_t _workers;
+        std::unique_ptr<ThreadPool> _pool;
+    };
+
+    struct MicroCase {
+        std::string name;
+        std::function<MicroBenchmark *()> create;
+    };
+
+    std::string formatPerOp(const double value) {
+        std::ostringstream stream;
+        if (value < 0) {
+            stream << "-";
+        } else {
+            stream << std::fixed << std::setprecision(value < 10 ? 2 : 0) << value;
+        }
+        return stream.str();
+    }
+}
+
+
+int runMicroBenchmark(const int argc, char **argv) {
+    const std::string filter = argc > 0 ? argv[0] : "";
+
+    std::vector<MicroCase> cases;
+    for (const size_t size: {16, 512, 4096, 65536, 1048576}) {
+        cases.push_back({"socket frame " + std::to_string(size) + " B",
+                         [size] { return new SocketFrameBenchmark(size); }});
+    }
+    cases.push_back({"receiveMessage", [] { return new ReceiveMessageBenchmark(); }});
+    cases.push_back({"classifyReceive", [] { return new ClassifyReceiveBenchmark(); }});
+    cases.push_back({"isValidFilename", [] { return new NameValidationBenchmark(true); }});
+    cases.push_back({"isValidUsername", [] { return new NameValidationBenchmark(false); }});
+    for (const size_t entries: {10, 1000, 100000}) {
+        cases.push_back({"handleList " + std::to_string(entries) + " files",
+                         [entries] { return new HandleListBenchmark(entries); }});
+        cases.push_back({"cached list " + std::to_string(entries) + " files",
+                         [entries] { return new CachedListBenchmark(entries); }});
+    }
+    for (const size_t size: {4096, 262144}) {
+        for (const bool cached: {false, true}) {
+            cases.push_back({"handleGet " + std::to_string(size / 1024) + " KiB " + (cached ? "cached" : "uncached"),
+                             [size, cached] { return new HandleGetBenchmark(size, cached); }});
+        }
+    }
+    for (const size_t workers: {1, 4}) {
+        cases.push_back({"pool submit " + std::to_string(workers) + " worker(s)",
+                         [workers] { return new PoolSubmitBenchmark(workers); }});
+    }
+
+    // the server's warnings would only interleave with the table, and the forked children must not log
+    Logger::instance().setLevel(LogLevel::OFF);
+    std::cout << "Micro-benchmarks: time and allocations from an in-process run, syscalls (all threads) from a"
+            << " ptrace'd child\n\n" << std::left << std::setw(28) << "benchmark" << std::setw(12) << "ops"
+            << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op" << "syscalls/op" << std::endl;
+
+    int exitCode = 0;
+    for (const MicroCase &microCase: cases) {
+        if (microCase.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        const std::unique_ptr<MicroBenchmark> benchmark(microCase.create());
+        MicroResult result{};
+        bool measured;
+        {
+            CoutSilencer silencer; // a Server prints its statistics when it stops
+            measured = measureMicroBenchmark(*benchmark, result);
+        }
+        if (!measured) {
+            std::cout << std::setw(28) << microCase.name << "setup failed" << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        std::cout << std::setw(28) << microCase.name << std::setw(12) << result.operations << std::setw(12)
+                << formatPerOp(result.nanosPerOp) << std::setw(12) << formatPerOp(result.allocationsPerOp)
+                << formatPerOp(result.syscallsPerOp) << std::endl;
+    }
+    return exitCode;
+}
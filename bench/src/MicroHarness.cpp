@@ -0,0 +1,163 @@
+#include "MicroHarness.h"
+#include "BenchUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace {
+    constexpr double TARGET_SECONDS = 0.25;
+    constexpr double CALIBRATION_SECONDS = 0.02;
+    constexpr uint64_t MAX_OPERATIONS = 100000000;
+    constexpr uint64_t MAX_TRACED_OPERATIONS = 2000; // every traced syscall costs two trips through the tracer
+
+    // only counted while a benchmark runs, so other benchmarks' threads do not contend on the counter
+    std::atomic<bool> countingAllocations{false};
+    std::atomic<uint64_t> allocations{0};
+
+    double timeRun(MicroBenchmark &benchmark, const uint64_t operations) {
+        const double start = wallSeconds();
+        benchmark.run(operations);
+        return wallSeconds() - start;
+    }
+
+#if defined(__linux__) && defined(PTRACE_GET_SYSCALL_INFO)
+    constexpr long MARKER_SYSCALL = SYS_getppid; // nothing under test calls it
+
+    // Runs the benchmark in a child and counts the syscalls of all its threads between two marker syscalls the
+    // child makes around run(); -1 if tracing is not permitted.
+    long countSyscalls(MicroBenchmark &benchmark, const uint64_t operations) {
+        const pid_t child = fork();
+        if (child == -1) {
+            perror("fork");
+            return -1;
+        }
+        if (child == 0) {
+            if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1) {
+                _exit(2);
+            }
+            raise(SIGSTOP);
+            if (!benchmark.setUp()) {
+                _exit(1);
+            }
+            syscall(MARKER_SYSCALL);
+            benchmark.run(operations);
+            syscall(MARKER_SYSCALL);
+            _exit(0); // no tearDown(): stopping a Server flushes the logger, whose thread fork() did not copy
+        }
+
+        int status;
+        if (waitpid(child, &status, 0) == -1 || !WIFSTOPPED(status) ||
+            ptrace(PTRACE_SETOPTIONS, child, nullptr,
+                   PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL) == -1 ||
+            ptrace(PTRACE_SYSCALL, child, nullptr, nullptr) == -1) {
+            kill(child, SIGKILL);
+            waitpid(child, &status, 0);
+            return -1;
+        }
+
+        long count = 0;
+        int markers = 0;
+        bool childSucceeded = false;
+        std::set<pid_t> threads = {child};
+        pid_t thread;
+        while ((thread = waitpid(-1, &status, __WALL)) != -1) {
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                if (thread == child) {
+                    childSucceeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                }
+                continue;
+            }
+
+            int signal = 0;
+            const int stopSignal = WSTOPSIG(status);
+            if (stopSignal == (SIGTRAP | 0x80)) {
+                __ptrace_syscall_info info{};
+                if (ptrace(PTRACE_GET_SYSCALL_INFO, thread, sizeof(info), &info) > 0 &&
+                    info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                    if (static_cast<long>(info.entry.nr) == MARKER_SYSCALL) {
+                        ++markers;
+                    } else if (markers == 1) {
+                        ++count;
+                    }
+                }
+            } else if (stopSignal == SIGSTOP && threads.insert(thread).second) {
+                // a new thread's first stop
+            } else if (stopSignal != SIGTRAP) {
+                signal = stopSignal; // SIGTRAP alone is a clone event
+            }
+            ptrace(PTRACE_SYSCALL, thread, nullptr, signal);
+        }
+        return childSucceeded && markers == 2 ? count : -1;
+    }
+#else
+    long countSyscalls(MicroBenchmark &, uint64_t) {
+        return -1;
+    }
+#endif
+}
+
+
+void *operator new(const size_t size) {
+    if (countingAllocations.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+
+bool measureMicroBenchmark(MicroBenchmark &benchmark, MicroResult &result) {
+    std::fflush(nullptr); // the child would flush a copy of anything still buffered
+    const long syscalls = countSyscalls(benchmark, 0);
+    if (!benchmark.setUp()) {
+        return false;
+    }
+
+    // grows the operation count tenfold until a run is long enough to extrapolate from; doubles as warm-up
+    uint64_t operations = 1;
+    double seconds;
+    while ((seconds = timeRun(benchmark, operations)) < CALIBRATION_SECONDS && operations < MAX_OPERATIONS) {
+        operations *= 10;
+    }
+    operations = std::min(MAX_OPERATIONS, std::max<uint64_t>(1, static_cast<uint64_t>(
+                                                                   operations * TARGET_SECONDS / seconds)));
+
+    allocations = 0;
+    countingAllocations = true;
+    seconds = timeRun(benchmark, operations);
+    countingAllocations = false;
+    benchmark.tearDown();
+
+    result.operations = operations;
+    result.nanosPerOp = seconds * 1e9 / operations;
+    result.allocationsPerOp = static_cast<double>(allocations) / operations;
+    result.syscallsPerOp = -1;
+
+    const uint64_t tracedOperations = std::min(operations, MAX_TRACED_OPERATIONS);
+    const long tracedSyscalls = syscalls < 0 ? -1 : countSyscalls(benchmark, tracedOperations);
+    if (tracedSyscalls >= 0) {
+        // the run with no operations accounts for per-run costs such as starting a helper thread
+        result.syscallsPerOp = static_cast<double>(std::max(0L, tracedSyscalls - syscalls)) / tracedOperations;
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+#include "Benchmarks.h"
+#include "BenchUtils.h"
+#include "ThreadPool.h"
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    constexpr int CHILD_TASKS = 4;
+
+    // The previous pool design: one std::function queue behind one mutex, kept here as the baseline.
+    class SharedQueuePool {
+    public:
+        explicit SharedQueuePool(const size_t numThreads) {
+            for (size_t i = 0; i < numThreads; ++i) {
+                _workers.emplace_back([this] {
+                    while (true) {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _cv.wait(lock, [this] { return _stopFlag || !_taskQueue.empty(); });
+                        if (_stopFlag && _taskQueue.empty()) {
+                            return;
+                        }
+                        std::function<void()> task = std::move(_taskQueue.front());
+                        _taskQueue.pop();
+                        lock.unlock();
+                        task();
+                    }
+                });
+            }
+        }
+
+        void submit(const std::function<void()> &task) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _taskQueue.push(task);
+            _cv.notify_one();
+        }
+
+        ~SharedQueuePool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopFlag = true;
+            }
+            _cv.notify_all();
+            for (std::thread &worker: _workers) {
+                worker.join();
+            }
+        }
+
+    private:
+        std::queue<std::function<void()>> _taskQueue;
+        std::vector<std::thread> _workers;
+        std::condition_variable _cv;
+        std::mutex _mutex;
+        bool _stopFlag = false;
+    };
+
+    // Mirrors what the server submits: a pointer plus a shared_ptr to the session.
+    template<typename Pool>
+    void submitTask(Pool &pool, std::atomic<size_t> &done, const std::shared_ptr<int> &session, const bool nested) {
+        std::atomic<size_t> *counter = &done;
+        pool.submit([&pool, counter, session, nested] {
+            if (nested) {
+                for (int child = 0; child < CHILD_TASKS; ++child) {
+                    submitTask(pool, *counter, session, false);
+                }
+            }
+            counter->fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    // Returns tasks executed per second, from the first submit until the last task has run.
+    template<typename Pool>
+    double runScenario(const size_t workers, const int producers, const size_t tasksPerProducer, const bool nested) {
+        std::atomic<size_t> done{0};
+        const size_t expected = producers * tasksPerProducer * (nested ? CHILD_TASKS + 1 : 1);
+        double seconds;
+        {
+            Pool pool(workers);
+            const double start = wallSeconds();
+            std::vector<std::thread> threads;
+            for (int producer = 0; producer < producers; ++producer) {
+                threads.emplace_back([&pool, &done, tasksPerProducer, nested] {
+                    const std::shared_ptr<int> session = std::make_shared<int>(0);
+                    for (size_t task = 0; task < tasksPerProducer; ++task) {
+                        submitTask(pool, done, session, nested);
+                    }
+                });
+            }
+            for (std::thread &thread: threads) {
+                thread.join();
+            }
+            while (done.load(std::memory_order_relaxed) < expected) {
+                std::this_thread::yield();
+            }
+            seconds = wallSeconds() - start;
+        }
+        return expected / seconds;
+    }
+}
+
+
+int runPoolBenchmark(const int argc, char **argv) {
+    const size_t tasks = argc > 0 ? std::stoul(argv[0]) : 1000000;
+    const int producers = argc > 1 ? std::stoi(argv[1]) : 4;
+    const size_t workers = argc > 2 ? std::stoul(argv[2]) : 8;
+    const size_t tasksPerProducer = tasks / producers;
+
+    std::cout << "Thread pool benchmark: " << producers << " producer(s) x " << tasksPerProducer << " tasks, "
+            << workers << " worker(s)\n\n"
+            << std::left << std::setw(28) << "pool" << std::setw(20) << "external Mtasks/s"
+            << "nested (1+" << CHILD_TASKS << ") Mtasks/s" << std::endl;
+
+    const double sharedExternal = runScenario<SharedQueuePool>(workers, producers, tasksPerProducer, false);
+    const double sharedNested = runScenario<SharedQueuePool>(workers, producers, tasksPerProducer, true);
+    std::cout << std::left << std::setw(28) << "shared queue, std::function" << std::setw(20) << std::fixed
+            << std::setprecision(2) << sharedExternal / 1e6 << sharedNested / 1e6 << std::endl;
+
+    const double stealingExternal = runScenario<ThreadPool>(workers, producers, tasksPerProducer, false);
+    const double stealingNested = runScenario<ThreadPool>(workers, producers, tasksPerProducer, true);
+    std::cout << std::left << std::setw(28) << "work stealing, Task" << std::setw(20) << std::fixed
+            << std::setprecision(2) << stealingExternal / 1e6 << stealingNested / 1e6 << std::endl;
+    return 0;
+}
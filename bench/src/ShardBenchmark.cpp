@@ -0,0 +1,124 @@
+#include "Benchmarks.h"
+#include "BenchServer.h"
+#include "BenchUtils.h"
+#include "CpuAffinity.h"
+#include "TransferOptions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+
+namespace {
+    const std::string BENCH_USER = "bench";
+    const std::string BENCH_FILE = "small.bin";
+    constexpr size_t BENCH_FILE_SIZE = 1024;
+    constexpr size_t WORKERS_PER_SHARD = 2;
+
+    // One short-lived session, as a connection storm brings them: connect, negotiate, log in, fetch a small file
+    // inline and leave. Waits for the server to close first, so TIME_WAIT does not pile up on client ports.
+    bool runConnection(const int port) {
+        Socket socket;
+        if (!socket.createS() || !socket.connectS("127.0.0.1", port)) {
+            socket.closeS();
+            return false;
+        }
+
+        TransferOptions options;
+        options.inlineLimit = MAX_INLINE_SIZE;
+        const std::string requests[] = {"2.0 " + options.toString(), BENCH_USER, "GET " + BENCH_FILE};
+        char response[2 * BENCH_FILE_SIZE];
+        bool ok = socket.receiveData(response, sizeof(response)) > 0 &&
+                  std::string(response, RESPONSE_OK.size()) == RESPONSE_OK;
+        for (const std::string &request: requests) {
+            ok = ok && socket.sendData(request.c_str()) != -1 && socket.receiveData(response, sizeof(response)) > 0 &&
+                 std::string(response, RESPONSE_OK.size()) == RESPONSE_OK;
+        }
+        ok = ok && socket.sendData("EXIT") != -1;
+        while (ok && socket.receiveData(response, sizeof(response)) > 0) {
+        }
+        socket.closeS();
+        return ok;
+    }
+
+    double percentile(std::vector<double> &values, const double fraction) {
+        std::sort(values.begin(), values.end());
+        const size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+}
+
+
+int runShardBenchmark(const int argc, char **argv) {
+    const double seconds = argc > 0 ? std::stod(argv[0]) : 2;
+    const int clients = argc > 1 ? std::stoi(argv[1]) : 64;
+    const size_t maxShards = argc > 2 ? std::stoul(argv[2]) : 16;
+
+    const std::string directory = createTempDirectory();
+    if (directory.empty() || mkdir((directory + BENCH_USER).c_str(), 0777) == -1 ||
+        !writePatternFile(directory + BENCH_USER + "/" + BENCH_FILE, BENCH_FILE_SIZE)) {
+        removeDirectory(directory);
+        return 1;
+    }
+
+    const size_t cpus = allowedCpus().size();
+    std::cout << "Listener shard benchmark: " << clients << " client(s) opening connections for " << seconds
+            << " s each round, " << WORKERS_PER_SHARD << " workers per shard, shards pinned to "
+            << (cpus > 0 ? std::to_string(cpus) + " CPU(s)" : "no CPUs (affinity unsupported)")
+            << "; clients share the machine\n\n"
+            << std::left << std::setw(10) << "shards" << std::setw(16) << "connections/s" << std::setw(12)
+            << "p50 ms" << "p99 ms" << std::endl;
+
+    int exitCode = 0;
+    for (size_t shards = 1; shards <= maxShards; shards *= 2) {
+        std::vector<std::vector<double> > latencies(clients);
+        std::atomic<size_t> failures{0};
+        double elapsed;
+        {
+            CoutSilencer silencer;
+            const BenchServer server(directory, WORKERS_PER_SHARD * shards, shards, true);
+            const int port = server.port();
+
+            std::vector<std::thread> threads;
+            const double start = wallSeconds();
+            for (int client = 0; client < clients; ++client) {
+                threads.emplace_back([&, client] {
+                    while (wallSeconds() - start < seconds) {
+                        const double connectionStart = wallSeconds();
+                        if (!runConnection(port)) {
+                            ++failures;
+                            continue;
+                        }
+                        latencies[client].push_back(wallSeconds() - connectionStart);
+                    }
+                });
+            }
+            for (std::thread &thread: threads) {
+                thread.join();
+            }
+            elapsed = wallSeconds() - start;
+        }
+
+        std::vector<double> allLatencies;
+        for (const std::vector<double> &clientLatencies: latencies) {
+            allLatencies.insert(allLatencies.end(), clientLatencies.begin(), clientLatencies.end());
+        }
+        if (allLatencies.empty() || failures > 0) {
+            std::cout << shards << " shard(s): " << failures << " connection(s) failed" << std::endl;
+            exitCode = 1;
+            if (allLatencies.empty()) {
+                continue;
+            }
+        }
+        std::cout << std::left << std::setw(10) << shards << std::setw(16) << std::fixed << std::setprecision(0)
+                << allLatencies.size() / elapsed << std::setw(12) << std::setprecision(2)
+                << percentile(allLatencies, 0.5) * 1000 << percentile(allLatencies, 0.99) * 1000 << std::endl;
+    }
+
+    removeDirectory(directory);
+    return exitCode;
+}
@@ -0,0 +1,77 @@
+#include "Benchmarks.h"
+#include "BenchServer.h"
+#include "BenchUtils.h"
+#include "Client.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+    const std::string BENCH_USER = "bench";
+    const std::string BENCH_FILE = "striped.bin";
+}
+
+
+int runStripeBenchmark(const int argc, char **argv) {
+    const size_t sizeMiB = argc > 0 ? std::stoul(argv[0]) : 256;
+    const off_t expectedSize = static_cast<off_t>(sizeMiB) * 1024 * 1024;
+
+    const std::string directory = createTempDirectory();
+    const std::string serverDirectory = directory + "server/";
+    const std::string clientDirectory = directory + "client/";
+    if (directory.empty() || mkdir(serverDirectory.c_str(), 0777) == -1 ||
+        mkdir(clientDirectory.c_str(), 0777) == -1 || !writePatternFile(clientDirectory + BENCH_FILE, expectedSize)) {
+        removeDirectory(directory);
+        return 1;
+    }
+
+    std::cout << "Striped transfer benchmark: " << sizeMiB << " MiB file over loopback\n\n"
+            << std::left << std::setw(10) << "stripes" << std::setw(18) << "PUT MiB/s" << "GET MiB/s" << std::endl;
+
+    int exitCode = 0;
+    {
+        const BenchServer server(serverDirectory, 8);
+
+        for (const size_t stripeCount: {1, 2, 4, 8}) {
+            double putSeconds, getSeconds;
+            bool transferred;
+            {
+                CoutSilencer silencer;
+                Client client(clientDirectory);
+                client.setStripeCount(stripeCount);
+                client.connect("127.0.0.1", server.port());
+                client.sendUsername(BENCH_USER);
+                if (fileSize(serverDirectory + BENCH_USER + "/" + BENCH_FILE) != -1) {
+                    client.deleteFile(BENCH_FILE); // or the chunk store would skip the whole upload
+                }
+
+                const double putStart = wallSeconds();
+                client.putFile(BENCH_FILE);
+                putSeconds = wallSeconds() - putStart;
+                transferred = fileSize(serverDirectory + BENCH_USER + "/" + BENCH_FILE) == expectedSize;
+
+                unlink((clientDirectory + BENCH_FILE).c_str());
+                const double getStart = wallSeconds();
+                client.getFile(BENCH_FILE);
+                getSeconds = wallSeconds() - getStart;
+                transferred = transferred && fileSize(clientDirectory + BENCH_FILE) == expectedSize;
+
+                client.disconnect();
+            }
+
+            if (!transferred) {
+                std::cout << "transfer with " << stripeCount << " stripe(s) failed" << std::endl;
+                exitCode = 1;
+                break;
+            }
+            std::cout << std::left << std::setw(10) << stripeCount << std::setw(18) << std::fixed
+                    << std::setprecision(1) << sizeMiB / putSeconds << sizeMiB / getSeconds << std::endl;
+        }
+    }
+
+    removeDirectory(directory);
+    return exitCode;
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+
+#include "Benchmarks.h"
+#include "Logger.h"
+
+
+static void printUsage() {
+    std::cout << "Usage: bench <benchmark> [options]\n"
+            << "  get [sizeMiB] [rounds]   - GET throughput: 1 KiB frames vs negotiated frames vs zero-copy stream,\n"
+            << "                             with and without CRC-32C\n"
+            << "  stripes [sizeMiB]        - striped GET/PUT over 1, 2, 4 and 8 loopback connections\n"
+            << "  io [sizeMiB] [sessions] [ops]\n"
+            << "                           - framed GET/PUT throughput and p50/p99 latency, blocking vs io_uring\n"
+            << "  pool [tasks] [producers] [workers]\n"
+            << "                           - thread pool submit/execute throughput under contention\n"
+            << "  micro [filter]           - ns, allocations and syscalls per operation of socket framing, request\n"
+            << "                             parsing, LIST and the thread pool; filter picks benchmarks by name\n"
+            << "  shards [seconds] [clients] [maxShards]\n"
+            << "                           - connection storm throughput and latency with 1, 2, 4 ... maxShards\n"
+            << "                             SO_REUSEPORT listeners pinned to the CPUs\n";
+}
+
+
+int main(const int argc, char **argv) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+
+    // server messages are still formatted and queued, only the write goes nowhere
+    const int nullFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (nullFd != -1) {
+        Logger::instance().setOutput(nullFd);
+    }
+
+    const std::string benchmark = argv[1];
+    if (benchmark == "get") {
+        return runGetBenchmark(argc - 2, argv + 2);
+    }
+    if (benchmark == "stripes") {
+        return runStripeBenchmark(argc - 2, argv + 2);
+    }
+
+    if (benchmark == "io") {
+        return runIoBenchmark(argc - 2, argv + 2);
+    }
+    if (benchmark == "pool") {
+        return runPoolBenchmark(argc - 2, argv + 2);
+    }
+    if (benchmark == "micro") {
+        return runMicroBenchmark(argc - 2, argv + 2);
+    }
+    if (benchmark == "shards") {
+        return runShardBenchmark(argc - 2, argv + 2);
+    }
+
+    printUsage();
+    return 1;
+}
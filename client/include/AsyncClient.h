@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConnectionPool.h"
+
+
+struct OperationResult {
+    bool succeeded{false};
+    std::string message; // the server's answer or the client's error; INFO's file info on success
+    uint64_t bytes{0}; // file bytes moved by GET and PUT
+    double seconds{0};
+};
+
+struct ListResult : OperationResult {
+    std::vector<std::string> filenames;
+};
+
+
+// Non-blocking front end to Client. Operations are queued and run by a few worker threads, each on a connection
+// leased from a ConnectionPool; results come back through a future or a callback run on a worker thread.
+// A reused connection that turns out to be dead is replaced and the operation tried once more.
+class AsyncClient {
+public:
+    explicit AsyncClient(const PoolConfig &config, size_t workers = 4);
+    ~AsyncClient(); // finishes the operations already queued
+
+    AsyncClient(const AsyncClient &) = delete;
+    AsyncClient &operator=(const AsyncClient &) = delete;
+
+    std::future<OperationResult> get(const std::string &filename);
+    std::future<OperationResult> put(const std::string &filename);
+    std::future<OperationResult> remove(const std::string &filename);
+    std::future<OperationResult> info(const std::string &filename);
+    std::future<ListResult> list();
+
+    void get(const std::string &filename, std::function<void(const OperationResult &)> callback);
+    void put(const std::string &filename, std::function<void(const OperationResult &)> callback);
+    void remove(const std::string &filename, std::function<void(const OperationResult &)> callback);
+    void info(const std::string &filename, std::function<void(const OperationResult &)> callback);
+    void list(std::function<void(const ListResult &)> callback);
+
+    ConnectionPool &pool();
+
+private:
+    typedef std::function<bool(Client &, OperationResult &)> Operation;
+
+    const std::string _directory;
+    ConnectionPool _pool;
+
+    std::mutex _mutex;
+    std::condition_variable _queueCondition;
+    std::deque<std::function<void()>> _queue;
+    bool _stopping{false};
+    std::vector<std::thread> _workers;
+
+    void workerLoop();
+    void enqueue(std::function<void()> task);
+    void execute(const Operation &operation, OperationResult &result);
+
+    Operation fileOperation(const std::string &action, const std::string &filename) const;
+    std::future<OperationResult> submit(const Operation &operation);
+    void submit(const Operation &operation, std::function<void(const OperationResult &)> callback);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ConnectionPool.h"
+
+
+struct BatchConfig {
+    PoolConfig connection;
+    std::vector<std::string> manifests; // "-" reads standard input
+    std::vector<std::string> jobs; // "GET <pattern>" and so on, given on the command line
+    size_t sessions{4};
+    size_t retries{2};
+};
+
+
+// Runs the GET/PUT/DELETE jobs of a manifest over a pool of authenticated sessions. A pattern with *, ? or [
+// expands against the local directory for PUT and against the server's LIST for GET and DELETE.
+class BatchTransfer {
+public:
+    explicit BatchTransfer(const BatchConfig &config);
+
+    // 0 when every file succeeded, 1 when any failed, 2 when the jobs could not be read or expanded
+    int run();
+
+private:
+    struct BatchItem {
+        std::string action;
+        std::string filename;
+    };
+
+    struct BatchOutcome {
+        bool succeeded{false};
+        size_t attempts{0};
+        uint64_t bytes{0};
+        std::string error;
+    };
+
+    const BatchConfig _config;
+    ConnectionPool _pool;
+    std::vector<BatchItem> _items;
+    std::vector<BatchOutcome> _outcomes;
+
+    bool readJobs(std::vector<std::string> &jobs) const;
+    bool expandJobs(const std::vector<std::string> &jobs);
+    bool listLocalFiles(std::vector<std::string> &filenames) const;
+
+    void runSession(std::atomic<size_t> &next);
+    bool transfer(Client &client, const BatchItem &item, uint64_t &bytes) const;
+
+    void printReport(double seconds) const;
+};
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <Socket.h>
+#include <TransferOptions.h>
+
 
+const std::string PARTIAL_SUFFIX = ".part";
 
 enum class ReceiveStatus {
     SUCCESS,
@@ -24,21 +33,55 @@ public:
     int connect(const char *serverIp, int port);
     void disconnect();
     bool isConnected() const;
+    bool checkConnection();
 
     int sendUsername(const std::string &username);
 
     void listFiles();
-    void getFile(const std::string &filename);
-    void putFile(const std::string &filename);
-    void deleteFile(const std::string &filename);
+    bool requestListing(std::vector<std::string> &filenames);
+    bool getFile(const std::string &filename);
+    bool putFile(const std::string &filename);
+    bool deleteFile(const std::string &filename);
     void getFileInfo(const std::string &filename);
+    bool requestInfo(const std::string &filename, std::string &info);
+    void getStats();
+    void runBatch(const std::vector<std::string> &commands);
+
+    void setStripeCount(size_t stripeCount);
+    void setCompression(bool enabled);
+    void setOutput(std::ostream &output);
 
 private:
     Socket _socket;
     const std::string _directory;
+    TransferOptions _options;
 
+    std::string _serverIp;
+    int _port{-1};
+    std::string _username;
+    size_t _stripeCount{0};
+    bool _compress{false};
+    std::ostream *_output;
+
+    int openConnection(const char *serverIp, int port, const char *version = "2.0");
     std::string receiveResponse();
+    off_t requestFileSize(const std::string &filename);
+
+    size_t stripeCountFor(off_t fileSize) const;
+    bool transferStriped(const std::string &filename, off_t fileSize, size_t stripeCount, bool upload);
+    bool runStripes(const std::vector<std::function<bool(Client &)>> &stripes);
+    bool downloadRange(const std::string &filename, off_t offset, off_t length);
+    bool uploadRange(const std::string &filename, off_t offset, off_t length, off_t totalSize);
+    off_t receiveFrames(int fileFd, off_t offset, std::string &summary, uint32_t *crc);
+    void sendFrames(int fileFd, const std::vector<std::pair<off_t, off_t>> &ranges, std::string &summary,
+                    uint32_t *crc);
+    bool verifyDownload(int fileFd, off_t offset, off_t length, uint32_t crc);
+    off_t writeInline(const std::string &response, int fileFd, off_t offset, bool &intact);
 
-    void downloadFile(const std::string &filename);
-    void uploadFile(const std::string &filename, int fileFd);
+    bool downloadFile(const std::string &filename, off_t offset, const std::string &response);
+    bool uploadFile(const std::string &filename, int fileFd);
+    bool uploadDeduplicated(const std::string &filename, int fileFd, off_t fileSize);
+    bool uploadChunks(const std::string &filename, const std::string &uploadId, size_t firstChunk, size_t chunkCount,
+                      const std::vector<bool> &sent, off_t fileSize);
+    bool uploadDelta(const std::string &filename, int fileFd, off_t fileSize, bool &complete);
 };
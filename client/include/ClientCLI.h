@@ -6,7 +6,7 @@
 
 class ClientCLI {
 public:
-    explicit ClientCLI(const std::string &directory);
+    explicit ClientCLI(const std::string &directory, bool compress = false);
 
     void run(const char *serverIp, int port);
 
@@ -15,6 +15,8 @@ private:
 
     static void printMenu();
 
+    void runBatch(const std::string &path);
+
     static std::vector<std::string> parseInput(const std::string &input);
 
     static std::string getUsernameFromUser();
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "Client.h"
+
+
+struct PoolConfig {
+    std::string host{"127.0.0.1"};
+    int port{9080};
+    std::string username;
+    std::string directory{"files/"};
+    bool compress{false};
+    size_t maxIdle{16}; // connections kept open between operations
+    std::chrono::seconds maxIdleTime{300}; // well below the server's 600 s idle timeout
+};
+
+
+// An authenticated session whose messages are kept, not printed, so the caller can report them.
+class PooledConnection {
+public:
+    explicit PooledConnection(const PoolConfig &config);
+
+    // the last message since the previous call, without colour codes
+    std::string takeMessage();
+
+    std::ostringstream output;
+    Client client;
+    size_t operations{0};
+    std::chrono::steady_clock::time_point lastUsed;
+};
+
+
+// Hands out pre-authenticated connections, so an operation does not pay for the OK/version/username handshake.
+// A connection that sat idle too long or that the server has closed is discarded instead of reused.
+class ConnectionPool {
+public:
+    explicit ConnectionPool(const PoolConfig &config);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // opens up to count connections ahead of the first operations; returns how many are idle afterwards
+    size_t warmUp(size_t count);
+
+    // nullptr with error set if no connection could be opened
+    std::unique_ptr<PooledConnection> acquire(std::string &error);
+    void release(std::unique_ptr<PooledConnection> connection);
+
+    size_t idleCount() const;
+
+private:
+    const PoolConfig _config;
+    mutable std::mutex _mutex;
+    std::deque<std::unique_ptr<PooledConnection>> _idle; // most recently used at the back
+
+    std::unique_ptr<PooledConnection> open(std::string &error) const;
+};
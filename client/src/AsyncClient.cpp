@@ -0,0 +1,178 @@
+#include "AsyncClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
+
+AsyncClient::AsyncClient(const PoolConfig &config, const size_t workers) : _directory(config.directory),
+                                                                           _pool(config) {
+    for (size_t i = 0; i < std::max<size_t>(1, workers); ++i) {
+        _workers.emplace_back(&AsyncClient::workerLoop, this);
+    }
+}
+
+
+AsyncClient::~AsyncClient() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queueCondition.notify_all();
+    for (std::thread &worker: _workers) {
+        worker.join();
+    }
+}
+
+
+std::future<OperationResult> AsyncClient::get(const std::string &filename) {
+    return submit(fileOperation("GET", filename));
+}
+
+
+std::future<OperationResult> AsyncClient::put(const std::string &filename) {
+    return submit(fileOperation("PUT", filename));
+}
+
+
+std::future<OperationResult> AsyncClient::remove(const std::string &filename) {
+    return submit(fileOperation("DELETE", filename));
+}
+
+
+std::future<OperationResult> AsyncClient::info(const std::string &filename) {
+    return submit(fileOperation("INFO", filename));
+}
+
+
+std::future<ListResult> AsyncClient::list() {
+    const std::shared_ptr<std::promise<ListResult>> promise = std::make_shared<std::promise<ListResult>>();
+    list([promise](const ListResult &result) { promise->set_value(result); });
+    return promise->get_future();
+}
+
+
+void AsyncClient::get(const std::string &filename, std::function<void(const OperationResult &)> callback) {
+    submit(fileOperation("GET", filename), callback);
+}
+
+
+void AsyncClient::put(const std::string &filename, std::function<void(const OperationResult &)> callback) {
+    submit(fileOperation("PUT", filename), callback);
+}
+
+
+void AsyncClient::remove(const std::string &filename, std::function<void(const OperationResult &)> callback) {
+    submit(fileOperation("DELETE", filename), callback);
+}
+
+
+void AsyncClient::info(const std::string &filename, std::function<void(const OperationResult &)> callback) {
+    submit(fileOperation("INFO", filename), callback);
+}
+
+
+void AsyncClient::list(std::function<void(const ListResult &)> callback) {
+    enqueue([this, callback] {
+        ListResult result;
+        std::vector<std::string> &filenames = result.filenames;
+        execute([&filenames](Client &client, OperationResult &) { return client.requestListing(filenames); },
+                result);
+        callback(result);
+    });
+}
+
+
+ConnectionPool &AsyncClient::pool() {
+    return _pool;
+}
+
+
+std::future<OperationResult> AsyncClient::submit(const Operation &operation) {
+    const std::shared_ptr<std::promise<OperationResult>> promise = std::make_shared<std::promise<OperationResult>>();
+    submit(operation, [promise](const OperationResult &result) { promise->set_value(result); });
+    return promise->get_future();
+}
+
+
+void AsyncClient::submit(const Operation &operation, std::function<void(const OperationResult &)> callback) {
+    enqueue([this, operation, callback] {
+        OperationResult result;
+        execute(operation, result);
+        callback(result);
+    });
+}
+
+
+void AsyncClient::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queueCondition.wait(lock, [this] { return _stopping || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+            task = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        task();
+    }
+}
+
+
+void AsyncClient::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(task));
+    }
+    _queueCondition.notify_one();
+}
+
+
+void AsyncClient::execute(const Operation &operation, OperationResult &result) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::unique_ptr<PooledConnection> connection = _pool.acquire(result.message);
+        if (!connection) {
+            break;
+        }
+
+        const bool reused = connection->operations++ > 0;
+        result.message.clear();
+        result.succeeded = operation(connection->client, result);
+        const std::string message = connection->takeMessage();
+        if (!result.succeeded || result.message.empty()) {
+            result.message = message; // INFO already holds the file info
+        }
+        const bool stale = !result.succeeded && reused && !connection->client.isConnected();
+        _pool.release(std::move(connection));
+        if (!stale) {
+            break;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+AsyncClient::Operation AsyncClient::fileOperation(const std::string &action, const std::string &filename) const {
+    const std::string path = _directory + filename;
+    if (action == "INFO") {
+        return [filename](Client &client, OperationResult &result) {
+            return client.requestInfo(filename, result.message);
+        };
+    }
+    if (action == "DELETE") {
+        return [filename](Client &client, OperationResult &) { return client.deleteFile(filename); };
+    }
+
+    const bool upload = action == "PUT";
+    return [filename, path, upload](Client &client, OperationResult &result) {
+        if (!(upload ? client.putFile(filename) : client.getFile(filename))) {
+            return false;
+        }
+        struct stat fileStat{};
+        result.bytes = stat(path.c_str(), &fileStat) == 0 ? fileStat.st_size : 0;
+        return true;
+    };
+}
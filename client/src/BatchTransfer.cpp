@@ -0,0 +1,265 @@
+#include "BatchTransfer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+
+namespace {
+    const std::vector<std::string> BATCH_ACTIONS = {"GET", "PUT", "DELETE"};
+
+    // a failed attempt waits 200 ms, then twice as long after each further failure
+    constexpr int RETRY_DELAY_MS = 200;
+
+    bool isPattern(const std::string &filename) {
+        return filename.find_first_of("*?[") != std::string::npos;
+    }
+
+    // the server refused the request itself, e.g. 404 for a missing file, which no retry changes
+    bool isRejection(const std::string &message) {
+        return message.size() > 4 && message[0] == '4' && isdigit(message[1]) && isdigit(message[2]) &&
+               message[3] == ' ';
+    }
+
+    uint64_t fileSize(const std::string &path) {
+        struct stat fileStat{};
+        return stat(path.c_str(), &fileStat) == 0 ? fileStat.st_size : 0;
+    }
+}
+
+
+BatchTransfer::BatchTransfer(const BatchConfig &config) : _config(config), _pool(config.connection) {
+}
+
+
+int BatchTransfer::run() {
+    std::vector<std::string> jobs;
+    if (!readJobs(jobs) || !expandJobs(jobs)) {
+        return 2;
+    }
+    _outcomes.assign(_items.size(), BatchOutcome());
+
+    const size_t sessionCount = std::max<size_t>(1, std::min(_config.sessions, _items.size()));
+    std::cout << "Running " << _items.size() << " transfer(s) over " << sessionCount << " session(s)." << std::endl;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> sessions;
+    for (size_t i = 0; i < sessionCount; ++i) {
+        sessions.emplace_back([this, &next] { runSession(next); });
+    }
+    for (std::thread &session: sessions) {
+        session.join();
+    }
+    printReport(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    for (const BatchOutcome &outcome: _outcomes) {
+        if (!outcome.succeeded) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+bool BatchTransfer::readJobs(std::vector<std::string> &jobs) const {
+    jobs = _config.jobs;
+    for (const std::string &path: _config.manifests) {
+        std::ifstream file;
+        if (path != "-") {
+            file.open(path);
+            if (!file) {
+                std::cout << "\033[31m" << "Error: Unable to open " << path << "." << "\033[0m" << std::endl;
+                return false;
+            }
+        }
+        std::istream &input = path == "-" ? std::cin : file;
+
+        std::string line;
+        while (std::getline(input, line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#') {
+                continue;
+            }
+            jobs.push_back(line);
+        }
+    }
+    return true;
+}
+
+
+bool BatchTransfer::expandJobs(const std::vector<std::string> &jobs) {
+    std::vector<std::string> localFiles, remoteFiles;
+    bool localListed = false, remoteListed = false;
+    std::set<std::pair<std::string, std::string>> seen;
+
+    for (const std::string &job: jobs) {
+        std::istringstream stream(job);
+        std::string action, filename, extra;
+        stream >> action >> filename >> extra;
+        if (std::find(BATCH_ACTIONS.begin(), BATCH_ACTIONS.end(), action) == BATCH_ACTIONS.end() ||
+            filename.empty() || !extra.empty()) {
+            std::cout << "\033[31m" << "Error: Invalid job '" << job << "'. Expected GET, PUT or DELETE and a file"
+                    << " name or pattern." << "\033[0m" << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> matches;
+        if (!isPattern(filename)) {
+            matches.push_back(filename);
+        } else if (action == "PUT") {
+            if (!localListed && !listLocalFiles(localFiles)) {
+                return false;
+            }
+            localListed = true;
+            matches = localFiles;
+        } else {
+            if (!remoteListed) {
+                std::string error;
+                std::unique_ptr<PooledConnection> connection = _pool.acquire(error);
+                const bool listed = connection && connection->client.requestListing(remoteFiles);
+                if (connection) {
+                    error = connection->takeMessage();
+                    _pool.release(std::move(connection)); // the first session picks it up again
+                }
+                if (!listed) {
+                    std::cout << "\033[31m" << "Error: Unable to list the server's files: " << error << "\033[0m"
+                            << std::endl;
+                    return false;
+                }
+            }
+            remoteListed = true;
+            matches = remoteFiles;
+        }
+
+        size_t matched = 0;
+        for (const std::string &match: matches) {
+            if (isPattern(filename) && fnmatch(filename.c_str(), match.c_str(), FNM_PERIOD) != 0) {
+                continue;
+            }
+            ++matched;
+            if (seen.insert(std::make_pair(action, match)).second) {
+                _items.push_back({action, match});
+            }
+        }
+        if (matched == 0) {
+            std::cout << "No files match " << action << " " << filename << "." << std::endl;
+        }
+    }
+    return true;
+}
+
+
+bool BatchTransfer::listLocalFiles(std::vector<std::string> &filenames) const {
+    DIR *directory = opendir(_config.connection.directory.c_str());
+    if (directory == nullptr) {
+        std::cout << "\033[31m" << "Error: Unable to open " << _config.connection.directory << "." << "\033[0m"
+                << std::endl;
+        return false;
+    }
+
+    const dirent *entry;
+    while ((entry = readdir(directory)) != nullptr) {
+        const std::string filename = entry->d_name;
+        struct stat fileStat{};
+        // partial downloads are not ready to be uploaded
+        if (stat((_config.connection.directory + filename).c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode) &&
+            (filename.size() <= PARTIAL_SUFFIX.size() ||
+             filename.compare(filename.size() - PARTIAL_SUFFIX.size(), PARTIAL_SUFFIX.size(), PARTIAL_SUFFIX) != 0)) {
+            filenames.push_back(filename);
+        }
+    }
+    closedir(directory);
+    return true;
+}
+
+
+void BatchTransfer::runSession(std::atomic<size_t> &next) {
+    // a pooled connection keeps the files' messages for the report, since the sessions would print over each other
+    std::unique_ptr<PooledConnection> connection;
+
+    size_t index;
+    while ((index = next.fetch_add(1)) < _items.size()) {
+        const BatchItem &item = _items[index];
+        BatchOutcome &outcome = _outcomes[index];
+
+        for (size_t attempt = 0; attempt <= _config.retries && !outcome.succeeded; ++attempt) {
+            if (attempt > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_DELAY_MS << (attempt - 1)));
+            }
+
+            // a transfer that fails midway closes the connection, so the retry starts with a fresh session
+            if (!connection || !connection->client.isConnected()) {
+                connection = _pool.acquire(outcome.error);
+            }
+            ++outcome.attempts;
+            if (!connection) {
+                continue;
+            }
+            outcome.succeeded = transfer(connection->client, item, outcome.bytes);
+            const std::string message = connection->takeMessage();
+            if (!outcome.succeeded) {
+                outcome.error = message;
+                if (isRejection(outcome.error)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    _pool.release(std::move(connection));
+}
+
+
+bool BatchTransfer::transfer(Client &client, const BatchItem &item, uint64_t &bytes) const {
+    const std::string path = _config.connection.directory + item.filename;
+    if (item.action == "GET") {
+        if (!client.getFile(item.filename)) {
+            return false;
+        }
+        bytes = fileSize(path);
+        return true;
+    }
+    if (item.action == "PUT") {
+        if (!client.putFile(item.filename)) {
+            return false;
+        }
+        bytes = fileSize(path);
+        return true;
+    }
+    return client.deleteFile(item.filename);
+}
+
+
+void BatchTransfer::printReport(const double seconds) const {
+    size_t succeeded = 0, retried = 0;
+    uint64_t bytes = 0;
+    for (const BatchOutcome &outcome: _outcomes) {
+        succeeded += outcome.succeeded;
+        retried += outcome.attempts > 1;
+        bytes += outcome.bytes;
+    }
+    const double mebibytes = bytes / (1024.0 * 1024.0);
+
+    std::cout << std::fixed << std::setprecision(1) << "\nBatch complete in " << seconds << " s: " << succeeded
+            << " of " << _outcomes.size() << " file(s) succeeded, " << _outcomes.size() - succeeded << " failed, "
+            << retried << " retried.\n" << "Transferred " << mebibytes << " MiB at " << mebibytes / seconds
+            << " MiB/s, " << _outcomes.size() / seconds << " files/s." << std::endl;
+
+    for (size_t i = 0; i < _outcomes.size(); ++i) {
+        if (!_outcomes[i].succeeded) {
+            std::cout << "\033[31m" << "Failed: " << _items[i].action << " " << _items[i].filename << " after "
+                    << _outcomes[i].attempts << " attempt(s): "
+                    << _outcomes[i].error << "\033[0m"
+                    << std::endl;
+        }
+    }
+}
@@ -1,16 +1,70 @@
 #include "Client.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <thread>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
+#include <vector>
 
+#include <ChunkProof.h>
+#include <Crc32c.h>
+#include <DeltaSync.h>
+#include <FrameCodec.h>
+#include <Sha256.h>
 
-Client::Client(const std::string &directory) : _directory(directory) {
+
+constexpr uint32_t PREFERRED_FRAME_SIZE = 1024 * 1024;
+
+// LIST and STATS responses grow with the number of files and commands, unlike the other messages
+constexpr size_t MAX_RESPONSE_SIZE = 1024 * 1024;
+
+// files are split into one stripe per STRIPE_SIZE bytes, each moved over its own session
+constexpr off_t STRIPE_SIZE = 64 * 1024 * 1024;
+constexpr size_t MAX_STRIPES = 8;
+
+// smaller files are cheaper to send whole than to fetch signatures for
+constexpr off_t MIN_DELTA_FILE_SIZE = 1024 * 1024;
+
+
+// requests a batch keeps in flight, so neither side stalls on a full socket buffer while the other is still sending
+constexpr size_t PIPELINE_WINDOW = 256;
+const std::vector<std::string> BATCH_COMMANDS = {"LIST", "INFO", "DELETE", "SIZE", "STATS"};
+
+
+// LIST and INFO answer with plain text on success and a status line such as "404 NOT FOUND: ..." otherwise
+static bool isErrorResponse(const std::string &response) {
+    return response.size() > 4 && response[0] >= '3' && response[0] <= '5' && isdigit(response[1]) &&
+           isdigit(response[2]) && response[3] == ' ';
+}
+
+
+Client::Client(const std::string &directory) : _directory(directory), _output(&std::cout) {
 }
 
 
 int Client::connect(const char *serverIp, const int port) {
+    if (openConnection(serverIp, port) == -1) {
+        return -1;
+    }
+
+    *_output << "\nConnected to server at " << serverIp << ":" << port << "." << std::endl;
+    return 0;
+}
+
+
+int Client::openConnection(const char *serverIp, const int port, const char *version) {
+    _serverIp = serverIp;
+    _port = port;
+
     if (!_socket.createS()) {
         return -1;
     }
@@ -19,21 +73,30 @@ int Client::connect(const char *serverIp, const int port) {
         _socket.closeS();
         return -1;
     }
+    _socket.setNoDelay(true);
 
     const std::string connectionResponse = receiveResponse();
     if (connectionResponse != RESPONSE_OK) {
-        std::cout << connectionResponse << std::endl;
+        *_output << connectionResponse << std::endl;
         return -1;
     }
 
-    _socket.sendData("2.0");
+    TransferOptions requestedOptions;
+    requestedOptions.streamGet = true;
+    requestedOptions.frameSize = PREFERRED_FRAME_SIZE;
+    requestedOptions.compress = _compress;
+    requestedOptions.dedup = true;
+    requestedOptions.delta = true;
+    requestedOptions.checksum = true;
+    requestedOptions.inlineLimit = MAX_INLINE_SIZE;
+    _socket.sendData((std::string(version) + " " + requestedOptions.toString()).c_str());
+
     const std::string versionResponse = receiveResponse();
-    if (versionResponse != RESPONSE_OK) {
-        std::cout << versionResponse << std::endl;
+    if (versionResponse.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0) {
+        *_output << versionResponse << std::endl;
         return -1;
     }
-
-    std::cout << "\nConnected to server at " << serverIp << ":" << port << "." << std::endl;
+    _options = TransferOptions::parse(versionResponse.substr(RESPONSE_OK.size()));
     return 0;
 }
 
@@ -41,7 +104,7 @@ int Client::connect(const char *serverIp, const int port) {
 void Client::disconnect() {
     _socket.sendData("EXIT");
     _socket.closeS();
-    std::cout << "\nDisconnected from server." << std::endl;
+    *_output << "\nDisconnected from server." << std::endl;
 }
 
 
@@ -50,121 +113,871 @@ bool Client::isConnected() const {
 }
 
 
+// Between requests the server sends nothing, so anything readable means it closed the session.
+bool Client::checkConnection() {
+    pollfd pollFd{_socket.getS(), POLLIN, 0};
+    if (pollFd.fd == -1 || poll(&pollFd, 1, 0) != 0) {
+        _socket.closeS();
+        return false;
+    }
+    return true;
+}
+
+
 int Client::sendUsername(const std::string& username) {
     _socket.sendData(username.c_str());
 
     const std::string response = receiveResponse();
     if (response != RESPONSE_OK) {
-        std::cout << response << std::endl;
+        *_output << response << std::endl;
         return -1;
     }
 
+    _username = username;
     return 0;
 }
 
 
 void Client::listFiles() {
     _socket.sendData("LIST");
-    std::cout << receiveResponse() << std::endl;
+    *_output << receiveResponse() << std::endl;
+}
+
+
+bool Client::requestListing(std::vector<std::string> &filenames) {
+    _socket.sendData("LIST");
+
+    const std::string response = receiveResponse();
+    filenames.clear();
+    if (!isConnected() || isErrorResponse(response)) {
+        *_output << response << std::endl;
+        return false;
+    }
+    if (response.compare(0, 4, "204 ") == 0) {
+        return true;
+    }
+    std::istringstream stream(response);
+    std::string filename;
+    while (std::getline(stream, filename)) {
+        filenames.push_back(filename);
+    }
+    return true;
 }
 
 
-void Client::getFile(const std::string &filename) {
-    _socket.sendData(("GET " + filename).c_str());
-    downloadFile(filename);
+bool Client::getFile(const std::string &filename) {
+    struct stat partialStat{};
+    const std::string partialPath = _directory + filename + PARTIAL_SUFFIX;
+    const off_t offset = stat(partialPath.c_str(), &partialStat) == 0 ? partialStat.st_size : 0;
+
+    if (offset > 0) {
+        // the server continues only if these bytes are still the start of its file, and answers 412 otherwise
+        uint32_t prefixCrc = 0;
+        const int partialFd = open(partialPath.c_str(), O_RDONLY);
+        const bool checksummed = partialFd != -1 && crc32cFile(partialFd, 0, offset, prefixCrc);
+        if (partialFd != -1) {
+            close(partialFd);
+        }
+        if (checksummed) {
+            _socket.sendData(("GET " + filename + " " + std::to_string(offset) + " MATCH " +
+                              formatChecksum(prefixCrc)).c_str());
+            return downloadFile(filename, offset, receiveResponse());
+        }
+        unlink(partialPath.c_str());
+    }
+
+    off_t remoteSize = -1;
+    if (_options.inlineLimit != 0 && _options.streamGet && _stripeCount != 1) {
+        // a small file arrives with the answer and a streamed one announces its size, so rather than asking for the
+        // size first, a file worth striping is declined once its size is known
+        _socket.sendData(("GET " + filename).c_str());
+        const std::string response = receiveResponse();
+        if (response.compare(0, RESPONSE_OK.size() + 1, RESPONSE_OK + " ") == 0 &&
+            response.compare(0, RESPONSE_INLINE.size(), RESPONSE_INLINE) != 0) {
+            remoteSize = std::stoll(response.substr(RESPONSE_OK.size()));
+        }
+        if (remoteSize <= 0 || stripeCountFor(remoteSize) == 1) {
+            return downloadFile(filename, 0, response);
+        }
+        _socket.sendData(RESPONSE_NAK.c_str());
+    } else if (_stripeCount != 1) {
+        remoteSize = requestFileSize(filename);
+    }
+    const size_t stripeCount = remoteSize > 0 ? stripeCountFor(remoteSize) : 1;
+    if (stripeCount == 1) {
+        _socket.sendData(("GET " + filename).c_str());
+        return downloadFile(filename, 0, receiveResponse());
+    }
+
+    const int fileFd = open(partialPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fileFd == -1 || ftruncate(fileFd, remoteSize) == -1) {
+        *_output << "\033[31m" << "Error: Unable to create file." << "\033[0m" << std::endl;
+        if (fileFd != -1) {
+            close(fileFd);
+        }
+        return false;
+    }
+    close(fileFd);
+
+    *_output << "Downloading " << filename << " over " << stripeCount << " connections." << std::endl;
+    if (!transferStriped(filename, remoteSize, stripeCount, false)) {
+        unlink(partialPath.c_str()); // stripes land at arbitrary offsets, so the partial file cannot be resumed
+        *_output << "\033[31m" << "Error: Striped download failed." << "\033[0m" << std::endl;
+        return false;
+    }
+
+    if (rename(partialPath.c_str(), (_directory + filename).c_str()) == -1) {
+        *_output << "\033[31m" << "Error: Unable to store file." << "\033[0m" << std::endl;
+        return false;
+    }
+    *_output << "Download complete: " << filename << std::endl;
+    return true;
 }
 
 
-void Client::putFile(const std::string &filename) {
+bool Client::putFile(const std::string &filename) {
     const int fileFd = open((_directory + filename).c_str(), O_RDONLY);
     if (fileFd == -1) {
-        std::cout << "File not found on client." << std::endl;
-        return;
+        *_output << "File not found on client." << std::endl;
+        return false;
+    }
+
+    struct stat fileStat{};
+    fstat(fileFd, &fileStat);
+
+    // a file the server already has is updated in place, unless a stripe count is forced; otherwise a negotiated
+    // store takes the hashes first and the file's missing chunks are striped from there
+    bool complete;
+    if (_options.delta && fileStat.st_size >= MIN_DELTA_FILE_SIZE && _stripeCount <= 1 &&
+        uploadDelta(filename, fileFd, fileStat.st_size, complete)) {
+        return complete;
+    }
+    if (_options.dedup && fileStat.st_size > 0) {
+        return uploadDeduplicated(filename, fileFd, fileStat.st_size);
+    }
+
+    const size_t stripeCount = stripeCountFor(fileStat.st_size);
+    if (stripeCount > 1) {
+        close(fileFd);
+        *_output << "Uploading " << filename << " over " << stripeCount << " connections." << std::endl;
+        if (!transferStriped(filename, fileStat.st_size, stripeCount, true)) {
+            *_output << "\033[31m" << "Error: Upload failed." << "\033[0m" << std::endl;
+            return false;
+        }
+        *_output << "Upload complete: " << filename << std::endl;
+        return true;
     }
-    _socket.sendData(("PUT " + filename).c_str());
-    uploadFile(filename, fileFd);
+
+    _socket.sendData(("PUT " + filename + " RESUME " + std::to_string(fileStat.st_size)).c_str());
+    return uploadFile(filename, fileFd);
 }
 
 
-void Client::deleteFile(const std::string &filename) {
+bool Client::deleteFile(const std::string &filename) {
     _socket.sendData(("DELETE " + filename).c_str());
 
     const std::string response = receiveResponse();
-    if (response == RESPONSE_OK) {
-        std::cout << "Delete complete." << std::endl;
-    } else {
-        std::cout << response << std::endl;
+    if (response != RESPONSE_OK) {
+        *_output << response << std::endl;
+        return false;
     }
+    *_output << "Delete complete." << std::endl;
+    return true;
 }
 
 
 void Client::getFileInfo(const std::string &filename) {
     _socket.sendData(("INFO " + filename).c_str());
-    std::cout << receiveResponse() << std::endl;
+    *_output << receiveResponse() << std::endl;
+}
+
+
+bool Client::requestInfo(const std::string &filename, std::string &info) {
+    _socket.sendData(("INFO " + filename).c_str());
+
+    info = receiveResponse();
+    if (!isConnected() || isErrorResponse(info)) {
+        *_output << info << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+void Client::getStats() {
+    _socket.sendData("STATS");
+    *_output << receiveResponse() << std::endl;
+}
+
+
+void Client::runBatch(const std::vector<std::string> &commands) {
+    // only commands answered with a single message can be pipelined blindly
+    std::vector<std::string> responses(commands.size());
+    std::vector<size_t> batched;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const std::string action = commands[i].substr(0, commands[i].find(' '));
+        if (std::find(BATCH_COMMANDS.begin(), BATCH_COMMANDS.end(), action) != BATCH_COMMANDS.end()) {
+            batched.push_back(i);
+        } else {
+            responses[i] = "Skipped: only LIST, INFO, DELETE, SIZE and STATS can be batched.";
+        }
+    }
+
+    Client batch(_directory);
+    batch._output = _output;
+    if (batch.openConnection(_serverIp.c_str(), _port, "3.0") == -1 || batch.sendUsername(_username) == -1) {
+        *_output << "\033[31m" << "Error: Server does not support pipelined requests." << "\033[0m" << std::endl;
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t sent = 0, received = 0;
+    while (received < batched.size() && batch.isConnected()) {
+        batch._socket.setCork(true);
+        while (sent < batched.size() && sent - received < PIPELINE_WINDOW) {
+            const size_t index = batched[sent++];
+            batch._socket.sendData((std::to_string(index) + " " + commands[index]).c_str());
+        }
+        batch._socket.setCork(false);
+
+        // every response is preceded by the ID of the request it answers
+        const std::string requestId = batch.receiveResponse();
+        const std::string response = batch.receiveResponse();
+        if (!batch.isConnected()) {
+            break;
+        }
+        const size_t index = requestId.find_first_not_of("0123456789") == std::string::npos
+                                 ? std::strtoull(requestId.c_str(), nullptr, 10)
+                                 : commands.size();
+        if (index >= commands.size()) {
+            *_output << "\033[31m" << "Error: Response for unknown request " << requestId << "." << "\033[0m"
+                    << std::endl;
+            break;
+        }
+        responses[index] = response;
+        ++received;
+    }
+    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+
+    if (batch.isConnected()) {
+        batch._socket.sendData((std::to_string(commands.size()) + " EXIT").c_str());
+        batch._socket.closeS();
+    }
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        *_output << commands[i] << ": " << (responses[i].empty() ? "No response." : responses[i]) << std::endl;
+    }
+    *_output << received << " of " << batched.size() << " pipelined request(s) answered in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms." << std::endl;
+}
+
+
+void Client::setStripeCount(const size_t stripeCount) {
+    _stripeCount = stripeCount;
+}
+
+
+void Client::setCompression(const bool enabled) {
+    _compress = enabled;
+}
+
+
+void Client::setOutput(std::ostream &output) {
+    _output = &output;
 }
 
 
 std::string Client::receiveResponse() {
-    char buffer[MESSAGE_SIZE] = {};
-    const ssize_t bytesReceived = _socket.receiveData(buffer, sizeof(buffer));
+    const char *data;
+    const ssize_t bytesReceived = _socket.receiveView(data, MAX_RESPONSE_SIZE);
     if (bytesReceived <= 0) {
-        if (bytesReceived == 0) {
-            std::cout << "\033[31m" << "Error: Server closed the connection." << "\033[0m" << std::endl;
+        if (bytesReceived == 0 || errno == ECONNRESET) {
+            *_output << "\033[31m" << "Error: Server closed the connection." << "\033[0m" << std::endl;
         } else {
-            std::cout << "\033[31m" << "Error: No response from server. Closing socket." << "\033[0m" << std::endl;
+            *_output << "\033[31m" << "Error: No response from server. Closing socket." << "\033[0m" << std::endl;
         }
         _socket.closeS();
         return "";
     }
-    return {buffer};
+    return {data, static_cast<size_t>(bytesReceived)};
+}
+
+
+// Takes the server's answer to a GET from offset and receives the rest of the file.
+bool Client::downloadFile(const std::string &filename, const off_t offset, const std::string &response) {
+    const std::string partialPath = _directory + filename + PARTIAL_SUFFIX;
+
+    if (offset > 0 && (response.compare(0, 3, "416") == 0 || response.compare(0, 3, "412") == 0)) {
+        unlink(partialPath.c_str()); // the server's file is now shorter than our partial copy, or another version
+        return getFile(filename);
+    }
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0) {
+        *_output << response << std::endl;
+        return false;
+    }
+
+    const bool inlined = response.compare(0, RESPONSE_INLINE.size(), RESPONSE_INLINE) == 0;
+    if (!inlined) {
+        _socket.sendData(RESPONSE_ACK.c_str());
+    }
+
+    // streamed data is read back for its checksum, hence O_RDWR
+    const int fileFd = open(partialPath.c_str(), O_RDWR | O_CREAT | (offset > 0 ? 0 : O_TRUNC), 0666);
+    if (fileFd == -1) {
+        *_output << "\033[31m" << "Error: Unable to create file." << "\033[0m" << std::endl;
+        return false;
+    }
+    if (offset > 0) {
+        lseek(fileFd, offset, SEEK_SET);
+        *_output << "Resuming download of " << filename << " at byte " << offset << "." << std::endl;
+    }
+
+    off_t receivedSize = -1;
+    uint32_t crc = 0;
+    std::string summary;
+    bool intact;
+    if (inlined) {
+        receivedSize = writeInline(response, fileFd, offset, intact);
+    } else {
+        if (_options.streamGet) {
+            const size_t remainingSize = std::stoull(response.substr(RESPONSE_OK.size()));
+            if (_socket.receiveFile(fileFd, remainingSize) == static_cast<ssize_t>(remainingSize)) {
+                receivedSize = static_cast<off_t>(remainingSize);
+            }
+        } else {
+            receivedSize = receiveFrames(fileFd, offset, summary, _options.checksum ? &crc : nullptr);
+        }
+        intact = receivedSize == -1 || verifyDownload(fileFd, offset, receivedSize, crc);
+    }
+    close(fileFd);
+
+    if (receivedSize == -1) {
+        *_output << "\033[31m" << "Error: Download interrupted. GET the file again to resume." << "\033[0m" <<
+                std::endl;
+        _socket.closeS();
+        return false;
+    }
+    if (!intact) {
+        unlink(partialPath.c_str());
+        return false;
+    }
+
+    if (rename(partialPath.c_str(), (_directory + filename).c_str()) == -1) {
+        *_output << "\033[31m" << "Error: Unable to store file." << "\033[0m" << std::endl;
+        return false;
+    }
+    *_output << "Download complete: " << filename << (summary.empty() ? "" : ", " + summary) << std::endl;
+    return true;
+}
+
+
+bool Client::uploadFile(const std::string &filename, const int fileFd) {
+    std::string response = receiveResponse();
+    off_t resumeOffset = 0;
+    std::string prefixChecksum;
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) == 0) {
+        std::istringstream(response.substr(RESPONSE_OK.size())) >> resumeOffset >> prefixChecksum;
+    }
+    if (!prefixChecksum.empty()) {
+        // the server holds part of an earlier upload, which is continued only if it is the start of this file
+        uint32_t serverCrc, localCrc;
+        const bool matches = parseChecksum(prefixChecksum, serverCrc) &&
+                             crc32cFile(fileFd, 0, resumeOffset, localCrc) && localCrc == serverCrc;
+        _socket.sendData((matches ? RESPONSE_ACK : RESPONSE_NAK).c_str());
+        response = receiveResponse();
+        resumeOffset = 0;
+        if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) == 0) {
+            std::istringstream(response.substr(RESPONSE_OK.size())) >> resumeOffset;
+        }
+    }
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0) {
+        *_output << response << std::endl;
+        close(fileFd);
+        return false;
+    }
+
+    if (resumeOffset > 0) {
+        *_output << "Resuming upload of " << filename << " at byte " << resumeOffset << "." << std::endl;
+    }
+
+    std::string summary;
+    uint32_t crc = 0;
+    sendFrames(fileFd, {{resumeOffset, std::numeric_limits<off_t>::max()}}, summary,
+               _options.checksum ? &crc : nullptr);
+    close(fileFd);
+    if (_options.checksum) {
+        sendChecksumTrailer(_socket, crc);
+    }
+
+    if (receiveResponse() != RESPONSE_OK) {
+        *_output << "\033[31m" << "Error: Upload failed." << "\033[0m" << std::endl;
+        return false;
+    }
+    *_output << "Upload complete: " << filename << (summary.empty() ? "" : ", " + summary) << std::endl;
+    return true;
+}
+
+
+// Sends the chunk hashes first, then only the chunks the server does not already hold, striped over several
+// sessions when there is enough of them. The server keeps the chunks that arrived, so running the same PUT again
+// after an interruption sends only the rest.
+bool Client::uploadDeduplicated(const std::string &filename, const int fileFd, const off_t fileSize) {
+    // every upload is hashed in full before anything is sent, so the chunks are spread over up to MAX_STRIPES threads
+    const size_t chunkCount = (fileSize + DEDUP_CHUNK_SIZE - 1) / DEDUP_CHUNK_SIZE;
+    std::string hashes(chunkCount * SHA256_DIGEST_SIZE, '\0');
+    std::vector<uint32_t> chunkCrcs(chunkCount);
+    const size_t hasherCount = std::min<size_t>(
+        {MAX_STRIPES, std::max<size_t>(std::thread::hardware_concurrency(), 1), chunkCount});
+    std::vector<char> results(hasherCount, 1);
+    std::vector<std::thread> hashers;
+    for (size_t i = 0; i < hasherCount; ++i) {
+        hashers.emplace_back([&hashes, &chunkCrcs, &results, fileFd, fileSize, chunkCount, hasherCount, i] {
+            std::vector<char> buffer(DEDUP_CHUNK_SIZE);
+            for (size_t chunk = i; chunk < chunkCount; chunk += hasherCount) {
+                const off_t offset = static_cast<off_t>(chunk) * DEDUP_CHUNK_SIZE;
+                const off_t length = std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - offset);
+                if (pread(fileFd, buffer.data(), length, offset) != length) {
+                    results[i] = 0;
+                    return;
+                }
+                hashes.replace(chunk * SHA256_DIGEST_SIZE, SHA256_DIGEST_SIZE, Sha256::digest(buffer.data(), length));
+                chunkCrcs[chunk] = crc32c(0, buffer.data(), length);
+            }
+        });
+    }
+    for (std::thread &hasher: hashers) {
+        hasher.join();
+    }
+    if (std::find(results.begin(), results.end(), 0) != results.end()) {
+        *_output << "\033[31m" << "Error: Unable to read file." << "\033[0m" << std::endl;
+        close(fileFd);
+        return false;
+    }
+    const Crc32cAppender chunkAppender(DEDUP_CHUNK_SIZE);
+    uint32_t crc = 0;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const off_t length = std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - i * DEDUP_CHUNK_SIZE);
+        crc = length == DEDUP_CHUNK_SIZE ? chunkAppender.append(crc, chunkCrcs[i])
+                                         : crc32cCombine(crc, chunkCrcs[i], length);
+    }
+
+    _socket.sendData(("PUT " + filename + " DEDUP " + std::to_string(fileSize)).c_str());
+    std::string response = receiveResponse();
+    if (response == RESPONSE_OK) {
+        for (size_t sent = 0; sent < hashes.size(); sent += DEDUP_HASH_BATCH * SHA256_DIGEST_SIZE) {
+            _socket.sendData(hashes.data() + sent,
+                             std::min<size_t>(DEDUP_HASH_BATCH * SHA256_DIGEST_SIZE, hashes.size() - sent));
+        }
+        response = receiveResponse();
+    }
+    // "200 OK <upload>" names the upload the chunks and the commit refer to
+    if (response.compare(0, RESPONSE_OK.size() + 1, RESPONSE_OK + " ") != 0) {
+        *_output << response << std::endl;
+        close(fileFd);
+        return false;
+    }
+    const std::string uploadId = response.substr(RESPONSE_OK.size() + 1);
+
+    // bit i of the first bitmap is set when chunk i has to be sent, of the second when it has to be proven
+    const std::string bitmap = receiveResponse();
+    const std::string proofBitmap = bitmap.size() == (chunkCount + 7) / 8 ? receiveResponse() : "";
+    const std::string nonce = proofBitmap.size() == bitmap.size() ? receiveResponse() : "";
+    if (nonce.size() != CHUNK_PROOF_NONCE_SIZE) {
+        *_output << "\033[31m" << "Error: Invalid chunk request from server." << "\033[0m" << std::endl;
+        close(fileFd);
+        _socket.closeS();
+        return false;
+    }
+    std::vector<size_t> requested;
+    std::vector<bool> sent(chunkCount, false), proven(chunkCount, false);
+    off_t requestedBytes = 0;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+            requested.push_back(i);
+            requestedBytes += std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - static_cast<off_t>(i) * DEDUP_CHUNK_SIZE);
+            sent[i] = true;
+        }
+        proven[i] = (proofBitmap[i / 8] & (1 << (i % 8))) != 0;
+    }
+
+    // each stripe covers a run of the requested chunks, and stripe 0 also the chunks before it
+    const size_t stripeCount = requested.empty() ? 0 : std::min(stripeCountFor(requestedBytes), requested.size());
+    if (stripeCount > 1) {
+        *_output << "Uploading " << requested.size() << " chunks of " << filename << " over " << stripeCount
+                << " connections." << std::endl;
+    }
+    std::vector<std::function<bool(Client &)>> stripes;
+    for (size_t i = 0; i < stripeCount; ++i) {
+        const size_t first = i == 0 ? 0 : requested[i * requested.size() / stripeCount];
+        const size_t end = i + 1 == stripeCount ? chunkCount : requested[(i + 1) * requested.size() / stripeCount];
+        stripes.emplace_back([&filename, &uploadId, &sent, first, end, fileSize](Client &session) {
+            return session.uploadChunks(filename, uploadId, first, end - first, sent, fileSize);
+        });
+    }
+    if (!runStripes(stripes)) {
+        close(fileFd);
+        *_output << "\033[31m" << "Error: Upload interrupted. PUT the file again to resume." << "\033[0m"
+                << std::endl;
+        return false;
+    }
+
+    // the server links the chunks it already holds only once the file proves they are ours too
+    const std::string proof = chunkProof(fileFd, fileSize, proven, nonce);
+    close(fileFd);
+    if (proof.empty()) {
+        *_output << "\033[31m" << "Error: Unable to read file." << "\033[0m" << std::endl;
+        return false;
+    }
+    _socket.sendData(("PUT " + filename + " COMMIT " + uploadId).c_str());
+    response = receiveResponse();
+    if (response != RESPONSE_OK) {
+        *_output << response << std::endl;
+        return false;
+    }
+    _socket.sendData(proof.data(), proof.size());
+    if (_options.checksum) {
+        sendChecksumTrailer(_socket, crc); // of the whole file, which the server assembles from its own chunks too
+    }
+
+    response = receiveResponse();
+    if (response != RESPONSE_OK) {
+        *_output << "\033[31m" << "Error: Upload failed." << "\033[0m" << std::endl;
+        return false;
+    }
+    *_output << "Upload complete: " << filename << ", " << requested.size() << " of " << chunkCount
+            << " chunks sent (" << (chunkCount - requested.size()) * 100 / chunkCount << "% skipped)" << std::endl;
+    return true;
 }
 
 
-void Client::downloadFile(const std::string &filename) {
+// Sends the chunks of [firstChunk, firstChunk + chunkCount) marked in sent for a deduplicated upload.
+bool Client::uploadChunks(const std::string &filename, const std::string &uploadId, const size_t firstChunk,
+                          const size_t chunkCount, const std::vector<bool> &sent, const off_t fileSize) {
+    const int fileFd = open((_directory + filename).c_str(), O_RDONLY);
+    if (fileFd == -1) {
+        return false;
+    }
+
+    _socket.sendData(("PUT " + filename + " CHUNKS " + uploadId + " " + std::to_string(firstChunk) + " " +
+                      std::to_string(chunkCount)).c_str());
     const std::string response = receiveResponse();
     if (response != RESPONSE_OK) {
-        std::cout << response << std::endl;
-        return;
+        *_output << response << std::endl;
+        close(fileFd);
+        return false;
+    }
+
+    std::vector<std::pair<off_t, off_t>> ranges;
+    for (size_t i = firstChunk; i < firstChunk + chunkCount; ++i) {
+        if (sent[i]) {
+            const off_t offset = static_cast<off_t>(i) * DEDUP_CHUNK_SIZE;
+            ranges.push_back(std::make_pair(offset, std::min<off_t>(offset + DEDUP_CHUNK_SIZE, fileSize)));
+        }
+    }
+    std::string summary;
+    sendFrames(fileFd, ranges, summary, nullptr);
+    close(fileFd);
+    return receiveResponse() == RESPONSE_OK;
+}
+
+
+// Sends only what changed against the server's copy; false (with fileFd still open) if the server has none,
+// otherwise complete tells whether the update went through.
+bool Client::uploadDelta(const std::string &filename, const int fileFd, const off_t fileSize, bool &complete) {
+    complete = false;
+    _socket.sendData(("PUT " + filename + " DELTA " + std::to_string(fileSize)).c_str());
+    const std::string response = receiveResponse();
+    if (response.compare(0, 3, "404") == 0) {
+        return false;
+    }
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0 || response.size() <= RESPONSE_OK.size()) {
+        *_output << response << std::endl;
+        close(fileFd);
+        return true;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<BlockSignature> signatures;
+    if (!receiveSignatures(_socket, signatures)) {
+        *_output << "\033[31m" << "Error: Invalid block signatures from server." << "\033[0m" << std::endl;
+        close(fileFd);
+        _socket.closeS();
+        return true;
     }
 
+    DeltaEncoder encoder(signatures, std::stoull(response.substr(RESPONSE_OK.size())));
+    std::unique_ptr<FrameCompressor> compressor(
+        _options.compress ? new FrameCompressor(_options.dataFrameSize()) : nullptr);
+    _socket.setCork(true);
+    const bool sent = encoder.send(_socket, fileFd, fileSize, _options.dataFrameSize(), compressor.get()) &&
+                      (!_options.checksum || sendChecksumTrailer(_socket, encoder.checksum()));
+    _socket.setCork(false);
+    close(fileFd);
+    if (!sent) {
+        *_output << "\033[31m" << "Error: Unable to send file changes." << "\033[0m" << std::endl;
+        _socket.closeS(); // the server cannot tell where the instructions stopped
+        return true;
+    }
+
+    if (receiveResponse() != RESPONSE_OK) {
+        *_output << "\033[31m" << "Error: Upload failed." << "\033[0m" << std::endl;
+        return true;
+    }
+    *_output << "Update complete: " << filename << ", " << encoder.summary() << " in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+    complete = true;
+    return true;
+}
+
+
+off_t Client::requestFileSize(const std::string &filename) {
+    _socket.sendData(("SIZE " + filename).c_str());
+
+    const std::string response = receiveResponse();
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0 || response.size() <= RESPONSE_OK.size()) {
+        return -1; // missing file or server without SIZE; a plain GET reports the error
+    }
+    return std::stoll(response.substr(RESPONSE_OK.size()));
+}
+
+
+size_t Client::stripeCountFor(const off_t fileSize) const {
+    if (_stripeCount != 0) {
+        return _stripeCount;
+    }
+    return std::max<size_t>(1, std::min<size_t>(MAX_STRIPES, fileSize / STRIPE_SIZE));
+}
+
+
+bool Client::transferStriped(const std::string &filename, const off_t fileSize, const size_t stripeCount,
+                             const bool upload) {
+    const off_t stripeSize = (fileSize + stripeCount - 1) / stripeCount;
+    std::vector<std::function<bool(Client &)>> stripes;
+    for (size_t i = 0; i < stripeCount && static_cast<off_t>(i) * stripeSize < fileSize; ++i) {
+        const off_t offset = i * stripeSize;
+        const off_t length = std::min(stripeSize, fileSize - offset);
+        stripes.emplace_back([&filename, offset, length, fileSize, upload](Client &session) {
+            return upload ? session.uploadRange(filename, offset, length, fileSize)
+                          : session.downloadRange(filename, offset, length);
+        });
+    }
+    return runStripes(stripes);
+}
+
+
+// Runs the first stripe over this session and the others at the same time over freshly authenticated ones.
+bool Client::runStripes(const std::vector<std::function<bool(Client &)>> &stripes) {
+    std::vector<char> results(stripes.size(), 0);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < stripes.size(); ++i) {
+        workers.emplace_back([this, &stripes, &results, i] {
+            Client stripe(_directory);
+            stripe._output = _output;
+            if (stripe.openConnection(_serverIp.c_str(), _port) == -1 || stripe.sendUsername(_username) == -1) {
+                return;
+            }
+            results[i] = stripes[i](stripe);
+            stripe._socket.sendData("EXIT");
+            stripe._socket.closeS();
+        });
+    }
+
+    if (!stripes.empty()) {
+        results[0] = stripes[0](*this);
+    }
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+    return std::find(results.begin(), results.end(), 0) == results.end();
+}
+
+
+bool Client::downloadRange(const std::string &filename, const off_t offset, const off_t length) {
+    _socket.sendData(("GET " + filename + " " + std::to_string(offset) + " " + std::to_string(length)).c_str());
+
+    const std::string response = receiveResponse();
+    if (response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) != 0) {
+        *_output << response << std::endl;
+        return false;
+    }
+    if (response.compare(0, RESPONSE_INLINE.size(), RESPONSE_INLINE) == 0) {
+        const int fileFd = open((_directory + filename + PARTIAL_SUFFIX).c_str(), O_WRONLY);
+        bool intact = false;
+        const bool complete = fileFd != -1 && writeInline(response, fileFd, offset, intact) == length;
+        if (fileFd != -1) {
+            close(fileFd);
+        }
+        return complete && intact;
+    }
+    if (_options.streamGet && std::stoll(response.substr(RESPONSE_OK.size())) != length) {
+        *_output << "\033[31m" << "Error: File changed during download." << "\033[0m" << std::endl;
+        _socket.closeS();
+        return false;
+    }
     _socket.sendData(RESPONSE_ACK.c_str());
 
-    const int fileFd = open((_directory + filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    const int fileFd = open((_directory + filename + PARTIAL_SUFFIX).c_str(), O_RDWR);
     if (fileFd == -1) {
-        std::cout << "\033[31m" << "Error: Unable to create file." << "\033[0m" << std::endl;
-        return;
+        _socket.closeS();
+        return false;
     }
 
-    char buffer[FILE_BUFFER_SIZE];
-    ssize_t bytesReceived;
-    while ((bytesReceived = _socket.receiveData(buffer, sizeof(buffer))) > 0) {
-        write(fileFd, buffer, bytesReceived);
+    bool complete;
+    uint32_t crc = 0;
+    if (_options.streamGet) {
+        lseek(fileFd, offset, SEEK_SET);
+        complete = _socket.receiveFile(fileFd, length) == length;
+    } else {
+        std::string summary;
+        complete = receiveFrames(fileFd, offset, summary, _options.checksum ? &crc : nullptr) == length;
     }
-
+    const bool intact = !complete || verifyDownload(fileFd, offset, length, crc);
     close(fileFd);
-    std::cout << "Download complete: " << filename << std::endl;
+
+    if (!complete) {
+        _socket.closeS();
+    }
+    return complete && intact;
 }
 
 
-void Client::uploadFile(const std::string &filename, const int fileFd) {
+bool Client::uploadRange(const std::string &filename, const off_t offset, const off_t length, const off_t totalSize) {
+    const int fileFd = open((_directory + filename).c_str(), O_RDONLY);
+    if (fileFd == -1) {
+        return false;
+    }
+
+    _socket.sendData(("PUT " + filename + " STRIPE " + std::to_string(offset) + " " + std::to_string(length) + " " +
+                      std::to_string(totalSize)).c_str());
     const std::string response = receiveResponse();
     if (response != RESPONSE_OK) {
-        std::cout << response << std::endl;
-        return;
+        *_output << response << std::endl;
+        close(fileFd);
+        return false;
     }
 
-    char buffer[FILE_BUFFER_SIZE];
-    ssize_t bytesRead;
-    while ((bytesRead = read(fileFd, buffer, sizeof(buffer))) > 0) {
-        _socket.sendData(buffer, bytesRead);
+    std::string summary;
+    uint32_t crc = 0;
+    sendFrames(fileFd, {{offset, offset + length}}, summary, _options.checksum ? &crc : nullptr);
+    close(fileFd);
+    if (_options.checksum) {
+        sendChecksumTrailer(_socket, crc);
     }
 
+    return receiveResponse() == RESPONSE_OK;
+}
+
+
+// Compares [offset, offset + length) of the download with the server's checksum trailer, if checksums were
+// negotiated. A stream never passed through user space, so its checksum is read back from the file.
+bool Client::verifyDownload(const int fileFd, const off_t offset, const off_t length, uint32_t crc) {
+    if (!_options.checksum) {
+        return true;
+    }
+
+    uint32_t serverCrc;
+    if (!receiveChecksumTrailer(_socket, serverCrc)) {
+        *_output << "\033[31m" << "Error: Server sent no checksum." << "\033[0m" << std::endl;
+        _socket.closeS();
+        return false;
+    }
+    if ((_options.streamGet && !crc32cFile(fileFd, offset, length, crc)) || crc != serverCrc) {
+        *_output << "\033[31m" << "Error: Checksum mismatch in bytes " << offset << "-" << offset + length - 1
+                << ", data discarded." << "\033[0m" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+// Writes the data of a "200 OK INLINE <size>[ <crc>]\n<data>" answer at offset; returns its size, or -1 if the
+// answer is malformed. intact is false when the data does not match the checksum.
+off_t Client::writeInline(const std::string &response, const int fileFd, const off_t offset, bool &intact) {
+    intact = false;
+    const std::string::size_type headerEnd = response.find('\n');
+    if (headerEnd == std::string::npos) {
+        return -1;
+    }
+    std::istringstream header(response.substr(RESPONSE_INLINE.size(), headerEnd - RESPONSE_INLINE.size()));
+    off_t size = -1;
+    std::string checksum;
+    header >> size >> checksum;
+    if (size != static_cast<off_t>(response.size() - headerEnd - 1) || (_options.checksum && checksum.size() != 8)) {
+        return -1;
+    }
+
+    const char *data = response.data() + headerEnd + 1;
+    if (pwrite(fileFd, data, size, offset) != size) {
+        return -1;
+    }
+    if (_options.checksum && checksum != formatChecksum(crc32c(0, data, size))) {
+        *_output << "\033[31m" << "Error: Checksum mismatch in bytes " << offset << "-" << offset + size - 1
+                << ", data discarded." << "\033[0m" << std::endl;
+        return size;
+    }
+    intact = true;
+    return size;
+}
+
+
+// Writes incoming data frames at offset until the end-of-transfer frame; returns the byte count or -1.
+off_t Client::receiveFrames(const int fileFd, const off_t offset, std::string &summary, uint32_t *crc) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_ptr<FrameDecompressor> decompressor(
+        _options.compress ? new FrameDecompressor(_options.dataFrameSize()) : nullptr);
+
+    const char *frame;
+    off_t position = offset;
+    ssize_t bytesReceived;
+    while ((bytesReceived = decompressor ? decompressor->receiveFrame(_socket, frame)
+                                         : _socket.receiveView(frame, _options.dataFrameSize())) > 0) {
+        pwrite(fileFd, frame, bytesReceived, position);
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, frame, bytesReceived);
+        }
+        position += bytesReceived;
+    }
+
+    if (decompressor) {
+        summary = compressionSummary(decompressor->rawBytes(), decompressor->wireBytes(),
+                                     std::chrono::steady_clock::now() - start);
+    }
+    return bytesReceived == 0 ? position - offset : -1;
+}
+
+
+// Sends each [position, end) range of the file, or up to its end, as data frames followed by the end-of-transfer frame.
+void Client::sendFrames(const int fileFd, const std::vector<std::pair<off_t, off_t>> &ranges, std::string &summary,
+                        uint32_t *crc) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const size_t frameSize = _options.dataFrameSize();
+    std::unique_ptr<FrameCompressor> compressor(_options.compress ? new FrameCompressor(frameSize) : nullptr);
+    std::vector<char> buffer(compressor ? 0 : frameSize);
+    char *data = compressor ? compressor->input() : buffer.data();
+
+    _socket.setCork(true);
+    for (const std::pair<off_t, off_t> &range: ranges) {
+        off_t position = range.first;
+        ssize_t bytesRead;
+        while (position < range.second &&
+               (bytesRead = pread(fileFd, data, std::min<off_t>(frameSize, range.second - position), position)) > 0) {
+            if (crc != nullptr) {
+                *crc = crc32c(*crc, data, bytesRead);
+            }
+            if (compressor) {
+                compressor->sendFrame(_socket, bytesRead);
+            } else {
+                _socket.sendData(data, bytesRead);
+            }
+            position += bytesRead;
+        }
+    }
     _socket.sendData("", 0);
-    close(fileFd);
+    _socket.setCork(false);
 
-    if (receiveResponse() == RESPONSE_OK) {
-        std::cout << "Upload complete: " << filename << std::endl;
-    } else {
-        std::cout << "\033[31m" << "Error: Upload failed." << "\033[0m" << std::endl;
+    if (compressor) {
+        summary = compressionSummary(compressor->rawBytes(), compressor->wireBytes(),
+                                     std::chrono::steady_clock::now() - start);
     }
 }
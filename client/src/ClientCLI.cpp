@@ -1,10 +1,12 @@
 #include "ClientCLI.h"
 
+#include <fstream>
 #include <iostream>
 #include <sstream>
 
 
-ClientCLI::ClientCLI(const std::string &directory) : client(directory) {
+ClientCLI::ClientCLI(const std::string &directory, const bool compress) : client(directory) {
+    client.setCompression(compress);
 }
 
 
@@ -43,12 +45,16 @@ void ClientCLI::run(const char *serverIp, const int port) {
             client.getFileInfo(commandParts[1]);
         } else if (command == "DELETE" && commandParts.size() == 2) {
             client.deleteFile(commandParts[1]);
+        } else if (command == "STATS") {
+            client.getStats();
+        } else if (command == "BATCH" && commandParts.size() == 2) {
+            runBatch(commandParts[1]);
         } else if (command == "EXIT") {
             client.disconnect();
             break;
         } else {
             std::cout <<
-                    "Invalid command. Type 'LIST', 'GET <filename>', 'PUT <filename>', 'INFO <filename>', 'DELETE <filename>', or 'EXIT'."
+                    "Invalid command. Type 'LIST', 'GET <filename>', 'PUT <filename>', 'INFO <filename>', 'DELETE <filename>', 'STATS', 'BATCH <path>', or 'EXIT'."
                     << std::endl;
         }
     }
@@ -61,11 +67,37 @@ void ClientCLI::printMenu() {
             << "3. PUT <filename>     - Upload a file to the server\n"
             << "4. INFO <filename>    - Get file info from the server\n"
             << "5. DELETE <filename>  - Delete a file on the server\n"
-            << "6. EXIT               - Disconnect and exit\n"
+            << "6. STATS              - Show live per-command server statistics\n"
+            << "7. BATCH <path>       - Pipeline the LIST/INFO/DELETE/SIZE/STATS commands listed in a local file\n"
+            << "8. EXIT               - Disconnect and exit\n"
             << "===========================================================\n";
 }
 
 
+void ClientCLI::runBatch(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "\033[31m" << "Error: Unable to open " << path << "." << "\033[0m" << std::endl;
+        return;
+    }
+
+    std::vector<std::string> commands;
+    std::string line;
+    while (std::getline(file, line)) {
+        const std::vector<std::string> parts = parseInput(line);
+        if (parts.empty()) {
+            continue;
+        }
+        std::string command = parts[0];
+        for (size_t i = 1; i < parts.size(); ++i) {
+            command += " " + parts[i];
+        }
+        commands.push_back(command);
+    }
+    client.runBatch(commands);
+}
+
+
 std::vector<std::string> ClientCLI::parseInput(const std::string &input) {
     std::istringstream iss(input);
     std::vector<std::string> tokens;
@@ -0,0 +1,113 @@
+#include "ConnectionPool.h"
+
+#include <algorithm>
+
+
+PooledConnection::PooledConnection(const PoolConfig &config) : client(config.directory),
+                                                                lastUsed(std::chrono::steady_clock::now()) {
+    client.setOutput(output);
+    client.setCompression(config.compress);
+}
+
+
+std::string PooledConnection::takeMessage() {
+    std::string message;
+    std::istringstream stream(output.str());
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty()) {
+            message = line;
+        }
+    }
+    output.str("");
+
+    std::string::size_type escape;
+    while ((escape = message.find("\033[")) != std::string::npos) {
+        const std::string::size_type end = message.find('m', escape);
+        message.erase(escape, end == std::string::npos ? std::string::npos : end - escape + 1);
+    }
+    return message;
+}
+
+
+ConnectionPool::ConnectionPool(const PoolConfig &config) : _config(config) {
+}
+
+
+ConnectionPool::~ConnectionPool() {
+    for (const std::unique_ptr<PooledConnection> &connection: _idle) {
+        connection->client.disconnect();
+    }
+}
+
+
+size_t ConnectionPool::warmUp(const size_t count) {
+    std::string error;
+    for (size_t i = idleCount(); i < std::min(count, _config.maxIdle); ++i) {
+        std::unique_ptr<PooledConnection> connection = open(error);
+        if (!connection) {
+            break;
+        }
+        release(std::move(connection));
+    }
+    return idleCount();
+}
+
+
+std::unique_ptr<PooledConnection> ConnectionPool::acquire(std::string &error) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_idle.empty()) {
+        std::unique_ptr<PooledConnection> connection = std::move(_idle.back());
+        _idle.pop_back();
+        if (now - connection->lastUsed < _config.maxIdleTime && connection->client.checkConnection()) {
+            return connection;
+        }
+        if (connection->client.isConnected()) {
+            connection->client.disconnect();
+        }
+    }
+    lock.unlock();
+    return open(error);
+}
+
+
+void ConnectionPool::release(std::unique_ptr<PooledConnection> connection) {
+    if (!connection || !connection->client.isConnected()) {
+        return;
+    }
+    connection->output.str("");
+    connection->lastUsed = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_idle.size() < _config.maxIdle) {
+        _idle.push_back(std::move(connection));
+        return;
+    }
+    lock.unlock();
+    connection->client.disconnect();
+}
+
+
+size_t ConnectionPool::idleCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _idle.size();
+}
+
+
+std::unique_ptr<PooledConnection> ConnectionPool::open(std::string &error) const {
+    std::unique_ptr<PooledConnection> connection(new PooledConnection(_config));
+    if (connection->client.connect(_config.host.c_str(), _config.port) == -1 ||
+        connection->client.sendUsername(_config.username) == -1) {
+        error = connection->takeMessage();
+        if (error.empty()) {
+            error = "Unable to connect to " + _config.host + ":" + std::to_string(_config.port) + ".";
+        }
+        if (connection->client.isConnected()) {
+            connection->client.disconnect();
+        }
+        return nullptr;
+    }
+    connection->output.str("");
+    return connection;
+}
@@ -1,7 +1,80 @@
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "BatchTransfer.h"
 #include "ClientCLI.h"
 
-int main() {
-    ClientCLI cli("files/");
-    cli.run("127.0.0.1", 9080);
+
+namespace {
+    void printUsage(const char *program) {
+        std::cout << "Usage: " << program << " [--compress] [--host=IP] [--port=N] [--dir=PATH]\n"
+                << "       " << program << " --user=NAME [--batch=MANIFEST|-] [--get=PATTERN] [--put=PATTERN]"
+                << " [--delete=PATTERN]\n"
+                << "           [--parallel=N] [--retries=N] [--host=IP] [--port=N] [--dir=PATH] [--compress]"
+                << std::endl;
+    }
+
+    bool parseCount(const std::string &value, size_t &count) {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        count = std::strtoull(value.c_str(), nullptr, 10);
+        return true;
+    }
+}
+
+
+int main(const int argc, char **argv) {
+    BatchConfig batch;
+    bool batchMode = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const std::string::size_type equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+        size_t count = 0;
+
+        if (argument == "--compress") {
+            batch.connection.compress = true;
+        } else if (name == "--batch" && !value.empty()) {
+            batch.manifests.push_back(value);
+            batchMode = true;
+        } else if ((name == "--get" || name == "--put" || name == "--delete") && !value.empty()) {
+            std::string action = name.substr(2);
+            for (char &c: action) {
+                c = static_cast<char>(std::toupper(c));
+            }
+            batch.jobs.push_back(action + " " + value);
+            batchMode = true;
+        } else if (name == "--user" && !value.empty()) {
+            batch.connection.username = value;
+        } else if (name == "--parallel" && parseCount(value, count) && count > 0) {
+            batch.sessions = count;
+        } else if (name == "--retries" && parseCount(value, count)) {
+            batch.retries = count;
+        } else if (name == "--host" && !value.empty()) {
+            batch.connection.host = value;
+        } else if (name == "--port" && parseCount(value, count) && count > 0 && count < 65536) {
+            batch.connection.port = static_cast<int>(count);
+        } else if (name == "--dir" && !value.empty()) {
+            batch.connection.directory = value.back() == '/' ? value : value + "/";
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (batchMode) {
+        if (batch.connection.username.empty()) {
+            std::cout << "\033[31m" << "Error: Batch mode needs --user." << "\033[0m" << std::endl;
+            return 2;
+        }
+        return BatchTransfer(batch).run();
+    }
+
+    ClientCLI cli(batch.connection.directory, batch.connection.compress);
+    cli.run(batch.connection.host.c_str(), batch.connection.port);
     return 0;
 }
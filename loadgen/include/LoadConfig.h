@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+const std::vector<std::string> LOAD_COMMANDS = {"GET", "PUT", "LIST", "INFO", "DELETE"};
+
+
+struct WeightedSize {
+    size_t size;
+    unsigned weight;
+};
+
+
+struct LoadConfig {
+    std::string host{"127.0.0.1"};
+    int port{9080};
+    std::string user{"loadgen"};
+    size_t sessions{8};
+    double durationSeconds{10};
+    uint64_t operationsPerSession{0}; // when set, sessions stop after this many commands instead of the duration
+    std::vector<unsigned> mix{60, 20, 10, 5, 5}; // weight of each of LOAD_COMMANDS
+    std::vector<WeightedSize> sizes{{64 * 1024, 1}}; // PUT sizes; GET reads what was PUT
+    double thinkMillis{0}; // mean pause between a session's commands, exponentially distributed
+    size_t filesPerSession{8};
+    uint64_t reconnectEvery{0}; // reconnect after this many commands, to sample connection setup under load
+    uint32_t frameSize{256 * 1024};
+    uint64_t seed{1};
+    std::string jsonPath; // "-" for stdout
+    bool keepFiles{false};
+
+    size_t largestSize() const;
+    std::string describeMix() const;
+    std::string describeSizes() const;
+};
+
+
+// --name=value options; false after printing what is wrong
+bool parseLoadConfig(int argc, char **argv, LoadConfig &config);
+void printLoadUsage(const char *program);
+
+// "64K", "1M", "512"
+bool parseSize(const std::string &text, size_t &size);
+std::string formatSize(size_t size);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "LoadConfig.h"
+
+
+struct CommandSamples {
+    std::vector<double> latencies; // seconds, successful commands only
+    uint64_t errors{0};
+    uint64_t bytes{0};
+};
+
+
+// What one session measured; sessions record on their own and are merged after the run.
+struct LoadResults {
+    std::map<std::string, CommandSamples> commands; // LOAD_COMMANDS plus "CONNECT"
+
+    void record(const std::string &command, double seconds, uint64_t bytes);
+    void recordError(const std::string &command);
+    void merge(const LoadResults &other);
+};
+
+
+// Table with overall and per-command throughput, error counts and p50/p99/p999 latency.
+std::string formatLoadTable(const LoadConfig &config, LoadResults &results, double seconds);
+// The same numbers as one JSON object, for tracking across releases.
+std::string formatLoadJson(const LoadConfig &config, LoadResults &results, double seconds);
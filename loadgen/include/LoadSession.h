@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LoadConfig.h"
+#include "LoadReport.h"
+#include "Socket.h"
+#include "TransferOptions.h"
+
+
+// Lets every session finish its setup before the measured run starts at the same moment for all of them.
+class StartSignal {
+public:
+    void wait(std::chrono::steady_clock::time_point &deadline) const;
+    void release(std::chrono::steady_clock::time_point deadline);
+
+private:
+    std::atomic<bool> _released{false};
+    std::chrono::steady_clock::time_point _deadline;
+};
+
+
+// One client connection speaking protocol 2.0 with negotiated frames, kept lean compared to Client: nothing is
+// printed and file data comes from and goes to memory. Each session works on its own files, so a GET never races
+// another session's DELETE.
+class LoadSession {
+public:
+    LoadSession(const LoadConfig &config, size_t index, const std::vector<char> &payload);
+
+    // uploads the session's files; false if the server could not be reached
+    bool prepare(LoadResults &results);
+    // issues commands from the configured mix until the deadline or the command limit
+    void run(const StartSignal &start, LoadResults &results);
+    // removes the session's files unless they are to be kept, and says goodbye
+    void finish();
+
+    ~LoadSession();
+
+private:
+    const LoadConfig &_config;
+    const std::vector<char> &_payload;
+    const std::string _prefix;
+    Socket _socket;
+    TransferOptions _options;
+    std::mt19937_64 _random;
+    std::vector<bool> _stored; // which of the session's files the server holds
+
+    bool connect(LoadResults &results);
+    void disconnect();
+
+    bool execute(const std::string &command, LoadResults &results);
+    bool get(const std::string &filename, uint64_t &bytes, bool &broken);
+    bool put(const std::string &filename, size_t size, bool &broken);
+    bool request(const std::string &message, std::string &response, bool &broken);
+    bool receiveResponse(std::string &response, bool &broken);
+
+    std::string filename(size_t file) const;
+    size_t pickSize();
+    size_t pickCommand();
+    long pickStoredFile();
+};
@@ -0,0 +1,222 @@
+#include "LoadConfig.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "TransferOptions.h"
+
+
+namespace {
+    bool parseNumber(const std::string &text, uint64_t &value) {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        value = std::strtoull(text.c_str(), nullptr, 10);
+        return true;
+    }
+
+    bool parseDecimal(const std::string &text, double &value) {
+        char *end;
+        value = std::strtod(text.c_str(), &end);
+        return !text.empty() && *end == '\0' && value >= 0;
+    }
+
+    std::vector<std::string> split(const std::string &text, const char separator) {
+        std::vector<std::string> parts;
+        std::istringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, separator)) {
+            parts.push_back(part);
+        }
+        return parts;
+    }
+
+    // "get=60,put=20,list=20": commands left out get no weight
+    bool parseMix(const std::string &text, std::vector<unsigned> &mix) {
+        std::vector<unsigned> weights(LOAD_COMMANDS.size(), 0);
+        for (const std::string &entry: split(text, ',')) {
+            const size_t equals = entry.find('=');
+            std::string command = entry.substr(0, equals);
+            std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+            const size_t index = std::find(LOAD_COMMANDS.begin(), LOAD_COMMANDS.end(), command) - LOAD_COMMANDS.begin();
+            uint64_t weight;
+            if (equals == std::string::npos || index == LOAD_COMMANDS.size() ||
+                !parseNumber(entry.substr(equals + 1), weight)) {
+                return false;
+            }
+            weights[index] = static_cast<unsigned>(weight);
+        }
+        if (std::count(weights.begin(), weights.end(), 0u) == static_cast<long>(weights.size())) {
+            return false;
+        }
+        mix = weights;
+        return true;
+    }
+
+    // "4K:50,1M:40,64M:10", or a single size
+    bool parseSizes(const std::string &text, std::vector<WeightedSize> &sizes) {
+        std::vector<WeightedSize> parsed;
+        for (const std::string &entry: split(text, ',')) {
+            const size_t colon = entry.find(':');
+            WeightedSize size{0, 1};
+            uint64_t weight = 1;
+            if (!parseSize(entry.substr(0, colon), size.size) ||
+                (colon != std::string::npos && (!parseNumber(entry.substr(colon + 1), weight) || weight == 0))) {
+                return false;
+            }
+            size.weight = static_cast<unsigned>(weight);
+            parsed.push_back(size);
+        }
+        if (parsed.empty()) {
+            return false;
+        }
+        sizes = parsed;
+        return true;
+    }
+}
+
+
+size_t LoadConfig::largestSize() const {
+    size_t largest = 0;
+    for (const WeightedSize &size: sizes) {
+        largest = std::max(largest, size.size);
+    }
+    return largest;
+}
+
+
+std::string LoadConfig::describeMix() const {
+    std::string description;
+    for (size_t i = 0; i < LOAD_COMMANDS.size(); ++i) {
+        if (mix[i] > 0) {
+            description += (description.empty() ? "" : " ") + LOAD_COMMANDS[i] + "=" + std::to_string(mix[i]);
+        }
+    }
+    return description;
+}
+
+
+std::string LoadConfig::describeSizes() const {
+    std::string description;
+    for (const WeightedSize &size: sizes) {
+        description += (description.empty() ? "" : " ") + formatSize(size.size) +
+                (sizes.size() > 1 ? ":" + std::to_string(size.weight) : "");
+    }
+    return description;
+}
+
+
+bool parseLoadConfig(const int argc, char **argv, LoadConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+        uint64_t number = 0;
+        size_t size = 0;
+
+        bool valid;
+        if (name == "--host") {
+            config.host = value;
+            valid = !value.empty();
+        } else if (name == "--port") {
+            valid = parseNumber(value, number) && number > 0 && number < 65536;
+            config.port = static_cast<int>(number);
+        } else if (name == "--user") {
+            config.user = value;
+            valid = !value.empty() && std::find_if(value.begin(), value.end(),
+                                                   [](const char c) { return !isalnum(c); }) == value.end();
+        } else if (name == "--sessions") {
+            valid = parseNumber(value, number) && number > 0;
+            config.sessions = number;
+        } else if (name == "--duration") {
+            valid = parseDecimal(value, config.durationSeconds) && config.durationSeconds > 0;
+        } else if (name == "--ops") {
+            valid = parseNumber(value, config.operationsPerSession) && config.operationsPerSession > 0;
+        } else if (name == "--mix") {
+            valid = parseMix(value, config.mix);
+        } else if (name == "--sizes") {
+            valid = parseSizes(value, config.sizes);
+        } else if (name == "--think") {
+            valid = parseDecimal(value, config.thinkMillis);
+        } else if (name == "--files") {
+            valid = parseNumber(value, number) && number > 0;
+            config.filesPerSession = number;
+        } else if (name == "--reconnect") {
+            valid = parseNumber(value, config.reconnectEvery);
+        } else if (name == "--frame") {
+            valid = parseSize(value, size) && size >= MIN_FRAME_SIZE && size <= MAX_FRAME_SIZE;
+            config.frameSize = static_cast<uint32_t>(size);
+        } else if (name == "--seed") {
+            valid = parseNumber(value, config.seed);
+        } else if (name == "--json") {
+            config.jsonPath = value.empty() ? "-" : value;
+            valid = true;
+        } else if (name == "--keep-files") {
+            config.keepFiles = true;
+            valid = value.empty();
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cout << "\033[31mInvalid option: " << argument << "\033[0m" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void printLoadUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options]\n"
+            << "  --host=ADDRESS        server address (127.0.0.1)\n"
+            << "  --port=PORT           server port (9080)\n"
+            << "  --user=NAME           username shared by all sessions (loadgen)\n"
+            << "  --sessions=N          concurrent sessions, one connection each (8)\n"
+            << "  --duration=SECONDS    measured run time (10)\n"
+            << "  --ops=N               stop each session after N commands instead\n"
+            << "  --mix=CMD=W,...       command weights (get=60,put=20,list=10,info=5,delete=5)\n"
+            << "  --sizes=SIZE[:W],...  PUT file sizes and their weights, e.g. 4K:50,1M:45,64M:5 (64K)\n"
+            << "  --think=MS            mean pause between a session's commands (0)\n"
+            << "  --files=N             files per session, uploaded before the run (8)\n"
+            << "  --reconnect=N         reconnect after every N commands (0: never)\n"
+            << "  --frame=SIZE          negotiated GET/PUT frame size (256K)\n"
+            << "  --seed=N              random seed (1)\n"
+            << "  --json[=PATH]         also write the results as JSON, to stdout without a path\n"
+            << "  --keep-files          leave the uploaded files on the server" << std::endl;
+}
+
+
+bool parseSize(const std::string &text, size_t &size) {
+    if (text.empty()) {
+        return false;
+    }
+    size_t multiplier = 1;
+    std::string digits = text;
+    const char unit = static_cast<char>(toupper(text.back()));
+    if (unit == 'K' || unit == 'M' || unit == 'G') {
+        multiplier = unit == 'K' ? 1024 : unit == 'M' ? 1024 * 1024 : 1024 * 1024 * 1024;
+        digits.pop_back();
+    }
+    uint64_t number;
+    if (!parseNumber(digits, number)) {
+        return false;
+    }
+    size = number * multiplier;
+    return true;
+}
+
+
+std::string formatSize(const size_t size) {
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+        return std::to_string(size / (1024 * 1024)) + "M";
+    }
+    if (size >= 1024 && size % 1024 == 0) {
+        return std::to_string(size / 1024) + "K";
+    }
+    return std::to_string(size);
+}
@@ -0,0 +1,133 @@
+#include "LoadReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+
+namespace {
+    const std::vector<std::string> REPORT_ROWS = {"CONNECT", "GET", "PUT", "LIST", "INFO", "DELETE"};
+    const std::vector<double> PERCENTILES = {0.5, 0.99, 0.999};
+
+    // nearest rank, on latencies sorted beforehand
+    double percentile(const std::vector<double> &sorted, const double fraction) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        const size_t rank = std::max<size_t>(1, static_cast<size_t>(std::ceil(fraction * sorted.size())));
+        return sorted[rank - 1];
+    }
+
+    double mebibytes(const uint64_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    struct Totals {
+        uint64_t operations{0};
+        uint64_t errors{0};
+        uint64_t bytes{0};
+    };
+
+    // connection setup is reported on its own row but is not one of the commands the throughput counts
+    Totals commandTotals(const LoadResults &results) {
+        Totals totals;
+        for (const std::pair<const std::string, CommandSamples> &command: results.commands) {
+            if (command.first != "CONNECT") {
+                totals.operations += command.second.latencies.size();
+                totals.errors += command.second.errors;
+                totals.bytes += command.second.bytes;
+            }
+        }
+        return totals;
+    }
+}
+
+
+void LoadResults::record(const std::string &command, const double seconds, const uint64_t bytes) {
+    CommandSamples &samples = commands[command];
+    samples.latencies.push_back(seconds);
+    samples.bytes += bytes;
+}
+
+
+void LoadResults::recordError(const std::string &command) {
+    ++commands[command].errors;
+}
+
+
+void LoadResults::merge(const LoadResults &other) {
+    for (const std::pair<const std::string, CommandSamples> &command: other.commands) {
+        CommandSamples &samples = commands[command.first];
+        samples.latencies.insert(samples.latencies.end(), command.second.latencies.begin(),
+                                 command.second.latencies.end());
+        samples.errors += command.second.errors;
+        samples.bytes += command.second.bytes;
+    }
+}
+
+
+std::string formatLoadTable(const LoadConfig &config, LoadResults &results, const double seconds) {
+    const Totals totals = commandTotals(results);
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1) << "Load: " << config.sessions << " session(s) against "
+            << config.host << ":" << config.port << " for " << seconds << " s, mix " << config.describeMix()
+            << ", sizes " << config.describeSizes() << ", think " << config.thinkMillis << " ms\n"
+            << "Throughput: " << totals.operations / seconds << " ops/s, " << mebibytes(totals.bytes) / seconds
+            << " MiB/s, " << totals.errors << " error(s)\n\n"
+            << std::left << std::setw(9) << "Command" << std::setw(10) << "Count" << std::setw(8) << "Errors"
+            << std::setw(11) << "ops/s" << std::setw(10) << "MiB/s" << "Latency ms p50/p99/p999";
+
+    for (const std::string &row: REPORT_ROWS) {
+        const auto it = results.commands.find(row);
+        if (it == results.commands.end()) {
+            continue;
+        }
+        CommandSamples &samples = it->second;
+        std::sort(samples.latencies.begin(), samples.latencies.end());
+
+        std::ostringstream latencies;
+        latencies << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < PERCENTILES.size(); ++i) {
+            latencies << (i == 0 ? "" : "/") << percentile(samples.latencies, PERCENTILES[i]) * 1000;
+        }
+        stream << "\n" << std::setw(9) << row << std::setw(10) << samples.latencies.size() << std::setw(8)
+                << samples.errors << std::setw(11) << samples.latencies.size() / seconds << std::setw(10)
+                << mebibytes(samples.bytes) / seconds << (samples.latencies.empty() ? "-" : latencies.str());
+    }
+    return stream.str();
+}
+
+
+std::string formatLoadJson(const LoadConfig &config, LoadResults &results, const double seconds) {
+    const Totals totals = commandTotals(results);
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3) << "{\"host\": \"" << config.host << "\", \"port\": " << config.port
+            << ", \"sessions\": " << config.sessions << ", \"seconds\": " << seconds << ", \"mix\": \""
+            << config.describeMix() << "\", \"sizes\": \"" << config.describeSizes() << "\", \"think_ms\": "
+            << config.thinkMillis << ", \"frame_size\": " << config.frameSize << ",\n \"operations\": "
+            << totals.operations << ", \"errors\": " << totals.errors << ", \"ops_per_second\": "
+            << totals.operations / seconds << ", \"mib_per_second\": " << mebibytes(totals.bytes) / seconds
+            << ",\n \"commands\": {";
+
+    bool first = true;
+    for (const std::string &row: REPORT_ROWS) {
+        const auto it = results.commands.find(row);
+        if (it == results.commands.end()) {
+            continue;
+        }
+        CommandSamples &samples = it->second;
+        std::sort(samples.latencies.begin(), samples.latencies.end());
+        stream << (first ? "" : ",") << "\n  \"" << row << "\": {\"count\": " << samples.latencies.size()
+                << ", \"errors\": " << samples.errors << ", \"bytes\": " << samples.bytes
+                << ", \"ops_per_second\": " << samples.latencies.size() / seconds;
+        for (const double fraction: PERCENTILES) {
+            stream << ", \"p" << (fraction == 0.5 ? "50" : fraction == 0.99 ? "99" : "999") << "_ms\": "
+                    << percentile(samples.latencies, fraction) * 1000;
+        }
+        stream << "}";
+        first = false;
+    }
+    stream << "\n }\n}\n";
+    return stream.str();
+}
@@ -0,0 +1,302 @@
+#include "LoadSession.h"
+
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+
+namespace {
+    constexpr int RESPONSE_TIMEOUT_SECONDS = 60;
+    constexpr size_t MAX_RESPONSE_SIZE = 64 * 1024 * 1024; // LIST of a folder shared by many sessions
+    constexpr int RECONNECT_PAUSE_MS = 100;
+
+    double secondsSince(const std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // "404 NOT FOUND: ..." and the like; LIST and INFO answer with plain text otherwise
+    bool isErrorResponse(const std::string &response) {
+        return response.size() >= 4 && (response[0] == '4' || response[0] == '5') && isdigit(response[1]) &&
+               isdigit(response[2]) && response[3] == ' ';
+    }
+}
+
+
+void StartSignal::wait(std::chrono::steady_clock::time_point &deadline) const {
+    while (!_released.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    deadline = _deadline;
+}
+
+
+void StartSignal::release(const std::chrono::steady_clock::time_point deadline) {
+    _deadline = deadline;
+    _released.store(true, std::memory_order_release);
+}
+
+
+LoadSession::LoadSession(const LoadConfig &config, const size_t index, const std::vector<char> &payload) :
+    _config(config), _payload(payload), _prefix("s" + std::to_string(index) + "-"),
+    _random(config.seed * 1000003 + index), _stored(config.filesPerSession, false) {
+}
+
+
+bool LoadSession::prepare(LoadResults &results) {
+    if (!connect(results)) {
+        return false;
+    }
+    for (size_t file = 0; file < _stored.size(); ++file) {
+        bool broken = false;
+        _stored[file] = put(filename(file), pickSize(), broken);
+        if (broken) {
+            disconnect();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void LoadSession::run(const StartSignal &start, LoadResults &results) {
+    std::chrono::steady_clock::time_point deadline;
+    start.wait(deadline);
+
+    std::exponential_distribution<double> think(_config.thinkMillis > 0 ? 1.0 / _config.thinkMillis : 1.0);
+    uint64_t sinceConnect = 0;
+    for (uint64_t done = 0;; ++done) {
+        if (_config.operationsPerSession > 0 ? done >= _config.operationsPerSession
+                                             : std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+
+        if (_socket.getS() == -1) {
+            sinceConnect = 0;
+            if (!connect(results)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_PAUSE_MS));
+                continue;
+            }
+        }
+
+        if (!execute(LOAD_COMMANDS[pickCommand()], results)) {
+            disconnect(); // the connection is in an unknown state
+        } else if (_config.reconnectEvery > 0 && ++sinceConnect >= _config.reconnectEvery) {
+            disconnect();
+        }
+
+        if (_config.thinkMillis > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(think(_random)));
+        }
+    }
+}
+
+
+void LoadSession::finish() {
+    LoadResults ignored;
+    if (_socket.getS() == -1 && !connect(ignored)) {
+        return;
+    }
+    for (size_t file = 0; file < _stored.size() && !_config.keepFiles; ++file) {
+        std::string response;
+        bool broken = false;
+        if (_stored[file] && !request("DELETE " + filename(file), response, broken) && broken) {
+            break;
+        }
+    }
+    disconnect();
+}
+
+
+LoadSession::~LoadSession() {
+    _socket.closeS();
+}
+
+
+bool LoadSession::connect(LoadResults &results) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _socket = Socket(); // a fresh receive buffer, nothing left over from the previous connection
+    if (!_socket.createS() || !_socket.connectS(_config.host.c_str(), _config.port)) {
+        _socket.closeS();
+        results.recordError("CONNECT");
+        return false;
+    }
+    _socket.setNoDelay(true);
+    _socket.setTimeoutSeconds(RESPONSE_TIMEOUT_SECONDS);
+
+    TransferOptions requestedOptions;
+    requestedOptions.frameSize = _config.frameSize;
+    std::string response;
+    bool broken = false;
+    bool connected = receiveResponse(response, broken) && response == RESPONSE_OK &&
+                     request("2.0 " + requestedOptions.toString(), response, broken) &&
+                     response.compare(0, RESPONSE_OK.size(), RESPONSE_OK) == 0;
+    if (connected) {
+        _options = TransferOptions::parse(response.substr(RESPONSE_OK.size()));
+        connected = request(_config.user, response, broken) && response == RESPONSE_OK;
+    }
+    if (!connected) {
+        _socket.closeS();
+        results.recordError("CONNECT");
+        return false;
+    }
+    results.record("CONNECT", secondsSince(start), 0);
+    return true;
+}
+
+
+void LoadSession::disconnect() {
+    if (_socket.getS() != -1) {
+        _socket.sendData("EXIT");
+        _socket.closeS();
+    }
+}
+
+
+bool LoadSession::execute(const std::string &command, LoadResults &results) {
+    // commands on a file need one the server holds; without any, the session uploads instead
+    const bool onStoredFile = command == "GET" || command == "INFO" || command == "DELETE";
+    const long storedFile = onStoredFile ? pickStoredFile() : -1;
+    const std::string effectiveCommand = onStoredFile && storedFile < 0 ? "PUT" : command;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string response;
+    uint64_t bytes = 0;
+    bool broken = false, ok;
+    if (effectiveCommand == "GET") {
+        ok = get(filename(storedFile), bytes, broken);
+    } else if (effectiveCommand == "PUT") {
+        const size_t file = std::uniform_int_distribution<size_t>(0, _stored.size() - 1)(_random);
+        bytes = pickSize();
+        ok = put(filename(file), bytes, broken);
+        _stored[file] = _stored[file] || ok;
+    } else if (effectiveCommand == "LIST") {
+        ok = request("LIST", response, broken);
+    } else if (effectiveCommand == "INFO") {
+        ok = request("INFO " + filename(storedFile), response, broken);
+    } else {
+        ok = request("DELETE " + filename(storedFile), response, broken) && response == RESPONSE_OK;
+        _stored[storedFile] = !ok;
+    }
+
+    if (ok) {
+        results.record(effectiveCommand, secondsSince(start), bytes);
+    } else {
+        results.recordError(effectiveCommand);
+    }
+    return !broken;
+}
+
+
+bool LoadSession::get(const std::string &filename, uint64_t &bytes, bool &broken) {
+    std::string response;
+    if (!request("GET " + filename, response, broken) || response != RESPONSE_OK) {
+        return false;
+    }
+    if (_socket.sendData(RESPONSE_ACK.c_str()) == -1) {
+        broken = true;
+        return false;
+    }
+
+    const char *frame;
+    ssize_t frameSize;
+    while ((frameSize = _socket.receiveView(frame, _options.dataFrameSize())) > 0) {
+        bytes += frameSize;
+    }
+    broken = frameSize == -1;
+    return !broken;
+}
+
+
+bool LoadSession::put(const std::string &filename, const size_t size, bool &broken) {
+    std::string response;
+    if (!request("PUT " + filename + " SIZE " + std::to_string(size), response, broken) || response != RESPONSE_OK) {
+        return false;
+    }
+
+    const size_t frameSize = _options.dataFrameSize();
+    for (size_t position = 0; position < size; position += frameSize) {
+        if (_socket.sendData(_payload.data() + position, std::min(frameSize, size - position)) == -1) {
+            broken = true;
+            return false;
+        }
+    }
+    if (_socket.sendData("", 0) == -1) {
+        broken = true;
+        return false;
+    }
+    return receiveResponse(response, broken) && response == RESPONSE_OK;
+}
+
+
+// false on an error response as well as a lost connection; only the latter sets broken
+bool LoadSession::request(const std::string &message, std::string &response, bool &broken) {
+    if (_socket.sendData(message.c_str()) == -1) {
+        broken = true;
+        return false;
+    }
+    return receiveResponse(response, broken);
+}
+
+
+bool LoadSession::receiveResponse(std::string &response, bool &broken) {
+    const char *data;
+    const ssize_t size = _socket.receiveView(data, MAX_RESPONSE_SIZE);
+    if (size == -1) {
+        broken = true;
+        return false;
+    }
+    response.assign(data, size);
+    return !isErrorResponse(response);
+}
+
+
+std::string LoadSession::filename(const size_t file) const {
+    return _prefix + std::to_string(file) + ".bin";
+}
+
+
+size_t LoadSession::pickSize() {
+    unsigned total = 0;
+    for (const WeightedSize &size: _config.sizes) {
+        total += size.weight;
+    }
+    unsigned pick = std::uniform_int_distribution<unsigned>(0, total - 1)(_random);
+    for (const WeightedSize &size: _config.sizes) {
+        if (pick < size.weight) {
+            return size.size;
+        }
+        pick -= size.weight;
+    }
+    return _config.sizes.back().size;
+}
+
+
+size_t LoadSession::pickCommand() {
+    unsigned total = 0;
+    for (const unsigned weight: _config.mix) {
+        total += weight;
+    }
+    unsigned pick = std::uniform_int_distribution<unsigned>(0, total - 1)(_random);
+    for (size_t command = 0; command < _config.mix.size(); ++command) {
+        if (pick < _config.mix[command]) {
+            return command;
+        }
+        pick -= _config.mix[command];
+    }
+    return 0;
+}
+
+
+long LoadSession::pickStoredFile() {
+    const long storedCount = std::count(_stored.begin(), _stored.end(), true);
+    if (storedCount == 0) {
+        return -1;
+    }
+    long pick = std::uniform_int_distribution<long>(0, storedCount - 1)(_random);
+    for (size_t file = 0; file < _stored.size(); ++file) {
+        if (_stored[file] && pick-- == 0) {
+            return static_cast<long>(file);
+        }
+    }
+    return -1;
+}
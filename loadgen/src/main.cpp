@@ -0,0 +1,93 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+
+#include "LoadConfig.h"
+#include "LoadReport.h"
+#include "LoadSession.h"
+
+
+int main(const int argc, char **argv) {
+    LoadConfig config;
+    if (argc == 2 && std::string(argv[1]) == "--help") {
+        printLoadUsage(argv[0]);
+        return 0;
+    }
+    if (!parseLoadConfig(argc, argv, config)) {
+        printLoadUsage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // a server that goes away shows up as failed sends
+
+    std::vector<char> payload(config.largestSize());
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i * 31 + i / 4096);
+    }
+
+    std::vector<std::unique_ptr<LoadSession>> sessions;
+    std::vector<LoadResults> results(config.sessions);
+    std::vector<char> prepared(config.sessions, false);
+    for (size_t i = 0; i < config.sessions; ++i) {
+        sessions.emplace_back(new LoadSession(config, i, payload));
+    }
+
+    // sessions connect and upload their files first; the clock starts once all of them are ready
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < config.sessions; ++i) {
+        threads.emplace_back([&, i] { prepared[i] = sessions[i]->prepare(results[i]); });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    threads.clear();
+    for (size_t i = 0; i < config.sessions; ++i) {
+        if (!prepared[i]) {
+            std::cout << "\033[31mSession " << i << " could not connect to " << config.host << ":" << config.port
+                    << " or upload its files.\033[0m" << std::endl;
+            return 1;
+        }
+    }
+
+    StartSignal start;
+    for (size_t i = 0; i < config.sessions; ++i) {
+        threads.emplace_back([&, i] { sessions[i]->run(start, results[i]); });
+    }
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    start.release(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double>(config.durationSeconds)));
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    threads.clear();
+
+    for (size_t i = 0; i < config.sessions; ++i) {
+        threads.emplace_back([&, i] { sessions[i]->finish(); });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+
+    LoadResults total;
+    for (const LoadResults &sessionResults: results) {
+        total.merge(sessionResults);
+    }
+    std::cout << formatLoadTable(config, total, seconds) << std::endl;
+
+    if (config.jsonPath == "-") {
+        std::cout << formatLoadJson(config, total, seconds);
+    } else if (!config.jsonPath.empty()) {
+        std::ofstream json(config.jsonPath);
+        json << formatLoadJson(config, total, seconds);
+        if (!json) {
+            std::cout << "\033[31mUnable to write " << config.jsonPath << ".\033[0m" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
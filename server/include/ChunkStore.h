@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/types.h>
+
+
+// Content-addressed store shared by all users, kept in <directory>/.store. A file uploaded with a deduplicated PUT
+// becomes an object named after the hash of its chunk list, and user folders hold hard links to it, so identical
+// uploads take disk space once and stay regular files for LIST, INFO and GET. The chunk index lets a new upload
+// copy the chunks the store already holds from existing objects instead of receiving them.
+class ChunkStore {
+public:
+    explicit ChunkStore(const std::string &directory);
+
+    bool open();
+    bool isOpen() const;
+
+    static std::string objectId(const std::vector<std::string> &chunkHashes, off_t fileSize);
+
+    // links the object to targetPath, replacing it; false when the store does not hold the object
+    bool linkObject(const std::string &objectId, const std::string &targetPath);
+    // read-only descriptor of a stored object, -1 when the store does not hold it
+    int openObject(const std::string &objectId);
+    int createTemporary(std::string &path);
+    bool copyChunk(const std::string &chunkHash, size_t length, int targetFd, off_t targetOffset);
+    // turns a fully written temporary file into an object, indexes its chunks and links it to targetPath
+    bool addObject(const std::string &temporaryPath, const std::string &objectId,
+                   const std::vector<std::string> &chunkHashes, const std::string &targetPath);
+    // called before path is unlinked or replaced; drops the object it links to once no other user does
+    void release(const std::string &path);
+
+    void recordUpload(uint64_t fileBytes, uint64_t receivedBytes);
+    std::string report() const;
+
+    static bool copyRange(int sourceFd, off_t sourceOffset, int targetFd, off_t targetOffset, size_t length);
+
+    ~ChunkStore();
+
+private:
+    struct ChunkLocation {
+        std::string objectId;
+        off_t offset;
+        size_t length;
+    };
+
+    const std::string _root;
+    const std::string _objectsDirectory;
+    const std::string _temporaryDirectory;
+    bool _open{false};
+    int _indexFd{-1};
+
+    std::unordered_multimap<std::string, ChunkLocation> _chunks; // raw chunk hash -> every object holding it
+    std::unordered_map<std::string, std::vector<std::string>> _objects; // object -> its distinct chunk hashes
+    std::map<std::pair<dev_t, ino_t>, std::string> _objectInodes;
+    mutable std::mutex _mutex;
+
+    std::atomic<uint64_t> _uploadedBytes{0};
+    std::atomic<uint64_t> _receivedBytes{0};
+    std::atomic<uint64_t> _nextTemporary{0};
+
+    bool removeOrphans();
+    bool loadIndex();
+    void indexObject(const std::string &objectId, const std::vector<std::string> &chunkHashes, off_t fileSize);
+    void releaseLocked(const std::string &path);
+    bool replaceTarget(const std::string &temporaryPath, const std::string &targetPath);
+    std::string objectPath(const std::string &objectId) const;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Per-command call counts with latency and bytes-transferred histograms, plus wait-time histograms for the server's
+// queues. Every thread records into its own shard with relaxed atomic increments, so recording never takes a lock;
+// snapshots merge the shards.
+class CommandStatistics {
+public:
+    CommandStatistics(const std::vector<std::string> &commands, const std::vector<std::string> &queues);
+
+    void record(const std::string &command, std::chrono::steady_clock::duration latency, uint64_t bytes);
+    void recordWait(const std::string &queue, std::chrono::steady_clock::duration wait);
+    std::string snapshot() const;
+
+private:
+    // log-linear buckets: exact below 8, then 8 sub-buckets per power of two (at most 12.5% error)
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 47;
+    static constexpr int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+    static constexpr size_t SHARD_COUNT = 8;
+
+    struct Histogram {
+        std::atomic<uint64_t> buckets[BUCKET_COUNT]{};
+
+        void add(uint64_t value);
+    };
+
+    struct CommandCounters {
+        std::atomic<uint64_t> count{0};
+        Histogram latencyMicros;
+        Histogram bytes;
+    };
+
+    struct WaitCounters {
+        std::atomic<uint64_t> count{0};
+        Histogram waitMicros;
+    };
+
+    struct Shard {
+        Shard(size_t commandCount, size_t queueCount) : commands(commandCount), queues(queueCount) {
+        }
+
+        std::vector<CommandCounters> commands;
+        std::vector<WaitCounters> queues;
+    };
+
+    const std::vector<std::string> _commands; // the last slot counts unknown commands
+    const std::vector<std::string> _queues;
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    size_t commandIndex(const std::string &command) const;
+    Shard &threadShard();
+
+    static size_t bucketFor(uint64_t value);
+    static uint64_t bucketUpperBound(size_t bucket);
+    static void mergeInto(const Histogram &histogram, std::vector<uint64_t> &buckets);
+    static std::string percentiles(const std::vector<uint64_t> &buckets);
+    static uint64_t percentile(const std::vector<uint64_t> &buckets, uint64_t total, double fraction);
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+
+// CPUs this process may run on, in ascending order; empty where thread affinity is not supported.
+std::vector<int> allowedCpus();
+
+// Restricts a thread to the given CPUs; false where thread affinity is not supported.
+bool pinThread(std::thread::native_handle_type thread, const std::vector<int> &cpus);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+
+class EventLoop {
+public:
+    EventLoop();
+
+    bool add(int fd, bool oneShot) const;
+    bool rearm(int fd) const;
+    void remove(int fd) const;
+
+    int wait(std::vector<int> &readyFds, int timeoutMs) const;
+    void wakeup() const;
+
+    ~EventLoop();
+
+private:
+    int _pollFd{-1};
+    int _wakeupPipe[2]{-1, -1};
+
+    void drainWakeupPipe() const;
+};
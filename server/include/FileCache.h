@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+
+
+// Contents of small files kept in memory for GET, the least recently used dropped once the byte budget is spent.
+// Every lookup stats the file and discards an entry whose inode, size or modification time has changed, so writes
+// by other processes are noticed; the server's own PUT and DELETE paths invalidate entries directly.
+// The contents are copied rather than mmapped, since a file truncated behind the server's back would turn reads
+// of the mapping into SIGBUS.
+class FileCache {
+public:
+    struct Entry {
+        struct stat fileStat;
+        std::string data;
+        uint32_t crc; // CRC-32C of data
+    };
+
+    static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+    static constexpr size_t MAX_FILE_SIZE = 1024 * 1024;
+
+    explicit FileCache(size_t budget);
+
+    bool isEnabled() const;
+
+    // nullptr when the file is not cached or has changed since it was
+    std::shared_ptr<const Entry> find(const std::string &path);
+    // reads the open file into the cache; nullptr if it is too large or changed while being read
+    std::shared_ptr<const Entry> load(const std::string &path, int fileFd, const struct stat &fileStat);
+    void invalidate(const std::string &path);
+
+    std::string report() const;
+
+private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<const Entry>>> LruList;
+
+    const size_t _budget;
+    size_t _usedBytes{0};
+    LruList _lru; // most recently used first
+    std::unordered_map<std::string, LruList::iterator> _entries;
+    mutable std::mutex _mutex;
+
+    uint64_t _hits{0};
+    uint64_t _misses{0};
+    uint64_t _evictions{0};
+    uint64_t _invalidations{0};
+
+    void erase(std::unordered_map<std::string, LruList::iterator>::iterator it);
+    static bool isSameVersion(const struct stat &cached, const struct stat &current);
+};
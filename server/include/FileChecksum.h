@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+
+
+// The CRC-32C of a whole file is kept in its "user.crc32c" extended attribute together with the size and
+// modification time it was computed for, so GET and INFO can use it without reading the file. A file changed
+// behind the server's back no longer matches and counts as having none. Nothing is stored where extended
+// attributes are unavailable (non-Linux, or a filesystem without user xattrs).
+bool loadChecksum(int fileFd, const struct stat &fileStat, uint32_t &crc);
+bool loadChecksum(const std::string &path, const struct stat &fileStat, uint32_t &crc);
+
+// records crc for the file's current size and modification time, so call it after the last write
+void storeChecksum(int fileFd, uint32_t crc);
+void storeChecksum(const std::string &path, uint32_t crc);
+// records crc for the version of the file described by fileStat; lost if the file has changed since
+void storeChecksum(int fileFd, const struct stat &fileStat, uint32_t crc);
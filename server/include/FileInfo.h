@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <sys/stat.h>
+
+
+// "rwxr-x---" for the permission bits of mode
+std::string formatPermissions(mode_t mode);
+
+// INFO's answer for a file: sizes, times, permissions and the stored CRC-32C when it has one
+std::string formatFileInfo(const std::string &path, const struct stat &fileStat);
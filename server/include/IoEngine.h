@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <sys/types.h>
+
+#include "FrameCodec.h"
+#include "Socket.h"
+
+
+enum class IoEngineType {
+    BLOCKING,
+    URING
+};
+
+
+// Moves file contents between disk and a client socket for framed GET and PUT transfers.
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+
+    virtual const char *name() const = 0;
+
+    // Sends [offset, offset + length) of fileFd as data frames of at most frameSize bytes, without the terminator.
+    // Every transfer function continues the CRC-32C in *crc over the file data when crc is not null.
+    virtual bool sendFileFrames(const Socket &socket, int fileFd, off_t offset, off_t length,
+                                size_t frameSize, uint32_t *crc) = 0;
+
+    // Writes incoming data frames to fileFd starting at offset until the end-of-transfer frame. Returns the number
+    // of bytes written, or -1 with errno set when receiving or writing fails or more than limit bytes arrive.
+    virtual off_t receiveFileFrames(const Socket &socket, int fileFd, off_t offset, size_t frameSize,
+                                    off_t limit, uint32_t *crc) = 0;
+
+    // Compressed variants of the above. Compression is CPU bound, so every engine runs them with plain pread/pwrite.
+    static bool sendCompressedFrames(const Socket &socket, int fileFd, off_t offset, off_t length, size_t frameSize,
+                                     FrameCompressor &compressor, uint32_t *crc);
+    static off_t receiveCompressedFrames(const Socket &socket, int fileFd, off_t offset, off_t limit,
+                                         FrameDecompressor &decompressor, uint32_t *crc);
+
+    static std::unique_ptr<IoEngine> create(IoEngineType type);
+};
+
+
+class BlockingIoEngine : public IoEngine {
+public:
+    const char *name() const override;
+
+    bool sendFileFrames(const Socket &socket, int fileFd, off_t offset, off_t length, size_t frameSize,
+                        uint32_t *crc) override;
+    off_t receiveFileFrames(const Socket &socket, int fileFd, off_t offset, size_t frameSize, off_t limit,
+                            uint32_t *crc) override;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum class LogLevel {
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    OFF
+};
+
+
+// Asynchronous logger: each thread appends to its own lock-free ring and a background thread writes the rings out
+// in batches, so workers never wait on the output stream. A full ring drops the message instead of blocking.
+class Logger {
+public:
+    static Logger &instance();
+
+    void setLevel(LogLevel level);
+    void setSampling(unsigned everyNth); // keep one in N DEBUG/INFO messages per thread; warnings and errors are kept
+    void setOutput(int fd);
+
+    bool enabled(LogLevel level) const;
+    void log(LogLevel level, std::string message);
+    void flush();
+
+    ~Logger();
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point time;
+        LogLevel level;
+        std::string message;
+    };
+
+    // single-producer (the owning thread), single-consumer (the writer thread)
+    struct Ring {
+        static constexpr size_t CAPACITY = 4096;
+
+        Entry entries[CAPACITY];
+        std::atomic<size_t> head{0}; // next entry to write out, advanced by the writer
+        std::atomic<size_t> tail{0}; // next free slot, advanced by the owner
+    };
+
+    std::atomic<LogLevel> _level{LogLevel::INFO};
+    std::atomic<unsigned> _sampling{1};
+    std::atomic<int> _outputFd{1};
+    std::atomic<uint64_t> _dropped{0};
+
+    std::vector<std::shared_ptr<Ring>> _rings;
+    std::mutex _ringsMutex;
+
+    std::atomic<bool> _running{true};
+    std::atomic<uint64_t> _flushRequests{0};
+    std::atomic<uint64_t> _flushesDone{0};
+    std::mutex _wakeupMutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _flushed;
+    std::thread _writer;
+
+    Logger();
+
+    Ring &threadRing();
+    void run();
+    size_t drain(std::string &output);
+    void write(const std::string &output) const;
+};
+
+
+void logDebug(const std::string &message);
+void logInfo(const std::string &message);
+void logWarning(const std::string &message);
+void logError(const std::string &message);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "EventLoop.h"
+
+
+enum class CacheLookup {
+    HIT,
+    MISSING,
+    UNAVAILABLE // user not cached or cache not running; ask the filesystem
+};
+
+
+// In-memory copy of every user's directory, so LIST, INFO and SIZE are answered without filesystem calls.
+// Kept coherent by inotify and by the server's own PUT/DELETE paths. Without inotify (non-Linux) start() fails
+// and every lookup is UNAVAILABLE.
+class MetadataCache {
+public:
+    using HiddenFilter = bool (*)(const std::string &filename);
+
+    MetadataCache(const std::string &directory, HiddenFilter isHidden);
+
+    bool start(size_t warmupThreads);
+    void stop();
+
+    void addUser(const std::string &username);
+    void refresh(const std::string &username, const std::string &filename);
+    void remove(const std::string &username, const std::string &filename);
+
+    CacheLookup list(const std::string &username, std::string &listing);
+    CacheLookup info(const std::string &username, const std::string &filename, std::string &info);
+    CacheLookup size(const std::string &username, const std::string &filename, off_t &size);
+
+    ~MetadataCache();
+
+private:
+    struct FileEntry {
+        struct stat fileStat;
+        std::string info; // rendered on the first INFO after a change
+    };
+
+    struct UserEntry {
+        std::mutex mutex;
+        std::map<std::string, FileEntry> files;
+        std::string listing;
+        bool listingValid{false};
+    };
+
+    const std::string _directory;
+    const HiddenFilter _isHidden;
+    std::atomic<bool> _running{false};
+
+    std::unordered_map<std::string, std::shared_ptr<UserEntry>> _users;
+    std::unordered_map<int, std::string> _watchedUsers; // inotify watch descriptor -> username
+    std::mutex _usersMutex;
+
+    int _inotifyFd{-1};
+    int _rootWatch{-1};
+    EventLoop _eventLoop;
+    std::thread _watcher;
+
+    std::shared_ptr<UserEntry> findUser(const std::string &username);
+    void loadUser(const std::string &username);
+    void dropUser(int watch);
+    bool scanUser(const std::string &username, UserEntry &user) const;
+    void rescanUsers();
+
+    void watch();
+    void handleEvents();
+};
@@ -1,5 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ChunkStore.h"
+#include "CommandStatistics.h"
+#include "EventLoop.h"
+#include "FileCache.h"
+#include "IoEngine.h"
+#include "MetadataCache.h"
+#include "Session.h"
 #include "ThreadPool.h"
 #include "Socket.h"
 
@@ -17,53 +34,197 @@ struct ReceiveResult {
     ssize_t bytesReceived;
 };
 
+struct StripedUpload {
+    uint64_t id; // tells a restarted upload from the one its stragglers belonged to
+    off_t totalSize;
+    off_t receivedBytes;
+    std::map<off_t, off_t> reservedRanges; // offset -> length of every stripe in flight or received; never overlap
+    std::set<off_t> receivedOffsets;
+    std::map<off_t, std::pair<off_t, uint32_t>> stripeChecksums; // offset -> length and CRC-32C, with "crc=1"
+    size_t activeStripes;
+    std::chrono::steady_clock::time_point lastActivity;
+};
+
+// A deduplicated PUT between its chunk list and its commit. The chunks it asked for may arrive over several sessions
+// at once and across reconnects; the temporary file keeps the ones that arrived intact until the commit links it in.
+struct DedupUpload {
+    uint64_t id; // tells a restarted upload from the one its stragglers belonged to
+    std::string objectId;
+    off_t fileSize;
+    std::vector<std::string> chunkHashes;
+    std::vector<bool> missing; // chunks the store lacked
+    std::vector<bool> received; // missing chunks that arrived intact
+    std::vector<bool> stored; // chunks taken from the store, which the client has to prove it holds
+    std::vector<uint32_t> chunkCrcs; // CRC-32C of each chunk received or proven
+    std::vector<std::pair<off_t, off_t>> repeatedChunks; // chunk -> earlier chunk with the same content
+    std::string temporaryPath; // empty when the store held the whole file at the handshake
+    std::string nonce;
+    off_t receivedBytes;
+    std::map<off_t, off_t> activeRanges; // first chunk -> chunk count of every CHUNKS request in flight
+    std::chrono::steady_clock::time_point lastActivity;
+};
+
+// accepted while the server was at its client limit; greeted once a session slot frees up
+struct WaitingClient {
+    Socket socket;
+    std::chrono::steady_clock::time_point acceptedAt;
+};
+
+// One of the server's listeners, each bound to the port with SO_REUSEPORT so the kernel spreads new connections over
+// them. A shard accepts, polls and serves its sessions with its own event loop and workers, so sessions on
+// different shards never contend for the same lock.
+struct ListenerShard {
+    ListenerShard(size_t minWorkerThreads, size_t maxWorkerThreads) : threadPool(minWorkerThreads, maxWorkerThreads) {
+    }
+
+    Socket serverSocket;
+    ThreadPool threadPool;
+    EventLoop eventLoop;
+    std::unordered_map<int, std::shared_ptr<Session>> sessions;
+    std::deque<WaitingClient> waitingClients;
+    std::mutex sessionsMutex; // guards sessions and waitingClients
+    std::vector<int> cpus; // the shard's threads run only on these; empty when unpinned
+    std::atomic<uint64_t> acceptedClients{0};
+    bool acceptPaused{false}; // the listener sits out a tick after running out of descriptors; event loop thread only
+    bool descriptorsExhausted{false}; // reported until an accept succeeds again; event loop thread only
+    std::thread thread; // runs the event loop of every shard but the first, which uses start()'s thread
+};
+
 
 class Server {
 public:
-    explicit Server(const std::string &directory, size_t maxSimultaneousClients);
+    // largest file a PUT may announce; also bounds the chunk list of a deduplicated PUT
+    static constexpr off_t DEFAULT_MAX_FILE_SIZE = 64LL * 1024 * 1024 * 1024;
+
+    explicit Server(const std::string &directory, size_t minWorkerThreads, size_t maxWorkerThreads,
+                    size_t maxSimultaneousClients, IoEngineType ioEngine = IoEngineType::BLOCKING,
+                    size_t fileCacheBytes = FileCache::DEFAULT_BUDGET, size_t listenerShards = 1,
+                    bool pinShards = false, off_t maxFileSize = DEFAULT_MAX_FILE_SIZE);
 
     void start(int port);
     void shutdown();
 
     void handleList(const Socket &clientSocket, const std::string &username) const;
-    size_t handleGet(const Socket &clientSocket, const std::string &username, const std::string &filename) const;
-    size_t handlePut(const Socket &clientSocket, const std::string &username, const std::string &filename) const;
+    ssize_t handleGet(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                     const TransferOptions &options, off_t offset = 0, off_t length = -1,
+                     const uint32_t *prefixCrc = nullptr) const;
+    ssize_t handlePut(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                     const TransferOptions &options, bool resume = false, off_t clientFileSize = 0) const;
+    ssize_t handlePutDedup(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                           const TransferOptions &options, off_t fileSize);
+    ssize_t handlePutChunks(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                            const TransferOptions &options, uint64_t uploadId, off_t firstChunk, off_t chunkCount);
+    ssize_t handlePutCommit(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                            const TransferOptions &options, uint64_t uploadId);
+    ssize_t handlePutDelta(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                           const TransferOptions &options, off_t fileSize) const;
+    ssize_t handlePutStripe(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                           const TransferOptions &options, off_t offset, off_t length, off_t totalSize);
     void handleDelete(const Socket &clientSocket, const std::string &username, const std::string &filename) const;
     void handleInfo(const Socket &clientSocket,  const std::string &username, const std::string &filename) const;
+    void handleSize(const Socket &clientSocket, const std::string &username, const std::string &filename) const;
+
+    static ReceiveResult receiveMessage(const Socket &clientSocket, char *buffer, size_t bufferSize, const char *username = nullptr);
+    static ReceiveResult classifyReceive(ssize_t bytesReceived, const char *username);
+    static bool isValidUsername(const std::string &username);
+    static bool isValidFilename(const std::string &filename);
+    static bool isPartialFilename(const std::string &filename);
 
     ~Server();
 
 private:
-    Socket _serverSocket;
     const std::string _directory;
 
-    ThreadPool _threadPool;
-    size_t _maxSimultaneousClients;
+    // worker and client limits are split evenly over the shards
+    std::vector<std::unique_ptr<ListenerShard>> _shards;
+    const bool _pinShards;
+    const off_t _maxFileSize;
+    size_t _maxSimultaneousClients; // per shard
     std::atomic<bool> _stopFlag{false};
-
-    std::unordered_map<std::string, int> _commandStatistics;
-    std::mutex _statisticsMutex;
-
-    void run();
-    Socket acceptClient() const;
-    void defineVersionAndHandleClient(Socket clientSocket);
-
-    void handleClient1dot0(Socket &clientSocket);
-    void handleClient2dot0(Socket &clientSocket);
+    std::unique_ptr<IoEngine> _ioEngine;
+    std::unique_ptr<MetadataCache> _metadataCache;
+    std::unique_ptr<ChunkStore> _chunkStore;
+    std::unique_ptr<FileCache> _fileCache;
+
+    std::unordered_map<std::string, StripedUpload> _stripedUploads;
+    std::mutex _stripedUploadsMutex;
+    uint64_t _nextStripedUploadId{0}; // guarded by _stripedUploadsMutex
+    std::unordered_map<std::string, DedupUpload> _dedupUploads; // by target path
+    std::mutex _dedupUploadsMutex;
+    uint64_t _nextDedupUploadId{0}; // guarded by _dedupUploadsMutex
+    mutable std::atomic<uint64_t> _nextUpload{0}; // numbers the hidden files plain PUTs write to
+
+    CommandStatistics _commandStatistics;
+
+    bool openListener(ListenerShard &shard, int port) const;
+    void assignCpus();
+    void run(ListenerShard &shard);
+    bool acceptClient(ListenerShard &shard);
+    static void admitClient(ListenerShard &shard, const Socket &clientSocket,
+                            std::vector<std::shared_ptr<Session>> &admitted);
+    void admitWaitingClients(ListenerShard &shard, std::vector<std::shared_ptr<Session>> &admitted);
+    void greetClients(ListenerShard &shard, const std::vector<std::shared_ptr<Session>> &admitted);
+    static void expireWaitingClients(ListenerShard &shard);
+    void dispatchSession(ListenerShard &shard, int clientFd);
+    void submitSession(ListenerShard &shard, const std::shared_ptr<Session> &session);
+    void serveSession(ListenerShard &shard, const std::shared_ptr<Session> &session);
+    void rearmSession(ListenerShard &shard, const std::shared_ptr<Session> &session, bool served);
+    void closeSession(ListenerShard &shard, const std::shared_ptr<Session> &session);
+    void closeIdleSessions(ListenerShard &shard);
+    static void closeAllSessions(ListenerShard &shard);
+
+    bool defineVersionAndHandleClient(Session &session);
+
+    static bool handleClient1dot0(Session &session);
+    bool handleClient2dot0(Session &session) const;
 
     static bool authenticateClient(const Socket &clientSocket, std::string &username) ;
-    void processCommands(const Socket &clientSocket, std::string &username);
+    bool processCommands(const Session &session);
+    bool processCommand(const Session &session);
+    bool executeCommand(const Session &session, const std::string &action, std::istringstream &stream,
+                        ssize_t &transferredBytes);
+    bool sendFileFrames(const Socket &clientSocket, const TransferOptions &options, int fileFd, off_t offset,
+                        off_t length, const std::string &filename, uint32_t *crc) const;
+    std::shared_ptr<const FileCache::Entry> cacheFile(const std::string &filePath, int fileFd,
+                                                      const struct stat &fileStat) const;
+    static ssize_t sendInlineFile(const Socket &clientSocket, const TransferOptions &options,
+                                  const FileCache::Entry *cached, int fileFd, const struct stat &fileStat, off_t offset,
+                                  off_t length, const std::string &filename, const std::string &username);
+    static ssize_t sendCachedFile(const Socket &clientSocket, const TransferOptions &options,
+                                  const FileCache::Entry &cached, off_t offset, off_t length,
+                                  const std::string &filename, const std::string &username);
+    off_t receiveFileFrames(const Socket &clientSocket, const TransferOptions &options, int fileFd, off_t offset,
+                            off_t limit, const std::string &filename, uint32_t *crc) const;
+    off_t receiveMissingChunks(const Socket &clientSocket, const TransferOptions &options, int fileFd, off_t fileSize,
+                               const std::vector<std::pair<off_t, std::string>> &pending,
+                               std::vector<std::pair<off_t, uint32_t>> &arrived) const;
+    off_t receiveDelta(const Socket &clientSocket, const TransferOptions &options, int basisFd, off_t basisSize,
+                       size_t blockSize, int fileFd, off_t fileSize, off_t &literalBytes,
+                       const std::vector<uint32_t> &blockChecksums, uint32_t *crc) const;
+    static bool receiveUploadChecksum(const Socket &clientSocket, const std::string &username, uint32_t &crc);
+    static bool rangeChecksum(int fileFd, const struct stat &fileStat, off_t offset, off_t length, uint32_t &crc);
+    std::string reserveStripe(const std::string &stripedPath, off_t offset, off_t length, off_t totalSize,
+                              uint64_t &uploadId, int &fileFd);
+    void releaseStripe(const std::string &stripedPath, uint64_t uploadId, off_t offset);
+    void abortStripedUpload(const std::string &stripedPath, uint64_t uploadId);
+    bool findDedupUpload(const std::string &filePath, const std::string &objectId, std::string &error);
+    bool prepareDedupUpload(DedupUpload &upload) const;
+    static bool reserveSpace(int fileFd, off_t offset, off_t length);
     static void cleanupClient(Socket &clientSocket, const char* username = nullptr);
 
-    static ReceiveResult receiveMessage(const Socket &clientSocket, char *buffer, size_t bufferSize, const char *username = nullptr);
 
-    static bool isValidUsername(const std::string &username);
-    static bool isValidFilename(const std::string &filename);
+    TransferOptions negotiateOptions(const std::string &requestedOptions) const;
+    static bool parseOffset(const std::string &token, off_t &value);
+    static bool isValidRequestId(const std::string &requestId);
+    static std::string partialFilename(const std::string &filename);
+    static std::string stripedFilename(const std::string &filename);
+    static std::string deltaFilename(const std::string &filename);
+    static std::string uploadFilename(const std::string &filename, uint64_t number);
     bool createClientFolderIfNotExists(const std::string &clientName) const;
+    bool scanDirectory(const std::string &username, std::string &listing) const;
 
-    static std::string getFilePermissions(mode_t mode);
 
-    void updateCommandStatistics(const std::string &command);
-    void displayCommandStatistics();
+    std::string statisticsReport() const;
+    void displayCommandStatistics() const;
 
 };
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "Socket.h"
+#include "TransferOptions.h"
+
+
+enum class SessionState {
+    AWAITING_VERSION,
+    AWAITING_USERNAME,
+    PROCESSING_COMMANDS
+};
+
+struct Session {
+    explicit Session(const Socket &clientSocket) : socket(clientSocket), state(SessionState::AWAITING_VERSION),
+                                                   busy(false), lastActivity(std::chrono::steady_clock::now()) {
+    }
+
+    Socket socket;
+    SessionState state;
+    std::string username;
+    TransferOptions options;
+    bool busy;
+    std::chrono::steady_clock::time_point lastActivity;
+};
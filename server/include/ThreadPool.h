@@ -1,29 +1,144 @@
 #pragma once
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
+// Move-only callable. Small captures (a pointer and a shared_ptr, as the server submits) live inside the object,
+// so submitting them does not allocate; larger ones fall back to the heap.
+class Task {
+public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+    Task() = default;
+
+    template<typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&function) { // NOLINT: implicit, so lambdas can be passed to submit() directly
+        typedef typename std::decay<F>::type Callable;
+        emplace<Callable>(std::forward<F>(function), std::integral_constant<bool, fitsInline<Callable>()>());
+    }
+
+    Task(Task &&other) noexcept;
+    Task &operator=(Task &&other) noexcept;
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    explicit operator bool() const;
+    void operator()();
+
+    ~Task();
+
+private:
+    struct Operations {
+        void (*invoke)(void *storage);
+        void (*move)(void *from, void *to); // move-constructs into `to` and destroys `from`
+        void (*destroy)(void *storage);
+    };
+
+    typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type _storage;
+    const Operations *_operations{nullptr};
+
+    template<typename Callable>
+    static constexpr bool fitsInline() {
+        return sizeof(Callable) <= INLINE_SIZE && alignof(Callable) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Callable>::value;
+    }
+
+    template<typename Callable, typename F>
+    void emplace(F &&function, std::true_type) {
+        static const Operations operations = {
+            [](void *storage) { (*static_cast<Callable *>(storage))(); },
+            [](void *from, void *to) {
+                new(to) Callable(std::move(*static_cast<Callable *>(from)));
+                static_cast<Callable *>(from)->~Callable();
+            },
+            [](void *storage) { static_cast<Callable *>(storage)->~Callable(); }
+        };
+        new(&_storage) Callable(std::forward<F>(function));
+        _operations = &operations;
+    }
+
+    template<typename Callable, typename F>
+    void emplace(F &&function, std::false_type) {
+        static const Operations operations = {
+            [](void *storage) { (**static_cast<Callable **>(storage))(); },
+            [](void *from, void *to) { *static_cast<Callable **>(to) = *static_cast<Callable **>(from); },
+            [](void *storage) { delete *static_cast<Callable **>(storage); }
+        };
+        *reinterpret_cast<Callable **>(&_storage) = new Callable(std::forward<F>(function));
+        _operations = &operations;
+    }
+};
+
+
+// Each worker owns a deque and runs its tasks in submission order, so a session that keeps resubmitting itself cannot
+// starve the ones queued behind it. An idle worker steals from the back of another worker's deque. Tasks submitted
+// from outside the pool are spread round-robin over the workers; a worker's own submissions stay on its deque.
+// The pool starts with minThreads workers and adds one whenever more tasks are queued than workers are idle, up to
+// maxThreads. Workers above minThreads exit after idleTimeout without work, the newest first.
 class ThreadPool {
 public:
     explicit ThreadPool(size_t numThreads);
+    ThreadPool(size_t minThreads, size_t maxThreads,
+               std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(DEFAULT_IDLE_TIMEOUT_MS));
 
-    void submit(const std::function<void()>& task);
+    void submit(Task task);
     void shutdown();
 
+    // pins the running workers and every worker started later to the given CPUs
+    void setCpuAffinity(const std::vector<int> &cpus);
+
+    size_t threadCount() const;
     size_t activeThreads() const;
+    size_t queuedTasks() const;
 
     ~ThreadPool();
 
 private:
-    std::queue<std::function<void()>> _taskQueue;
-    std::vector<std::thread> _workers;
+    static constexpr int DEFAULT_IDLE_TIMEOUT_MS = 30000;
+
+    // circular buffer that only grows, so a steady stream of tasks does not allocate (std::deque frees and
+    // reallocates its blocks as the front advances)
+    struct WorkerQueue {
+        std::vector<Task> slots = std::vector<Task>(16);
+        size_t front{0};
+        std::atomic<size_t> size{0}; // changed under the mutex, read without it to skip empty queues
+        std::mutex mutex;
 
-    void executionCycle();
+        void pushBack(Task &&task);
+        void popFront(Task &task);
+        void popBack(Task &task);
+    };
 
+    const size_t _minThreads;
+    const size_t _maxThreads;
+    const std::chrono::milliseconds _idleTimeout;
+
+    // one slot per possible worker; the running workers always occupy slots [0, _threadCount)
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<size_t> _threadCount{0};
+    std::atomic<size_t> _nextQueue{0};
+    std::vector<int> _cpus; // guarded by _idleMutex
+
+    std::mutex _idleMutex;
     std::condition_variable _cv;
-    std::mutex _mutex;
+    std::atomic<size_t> _idleWorkers{0};
 
     std::atomic<bool> _stopFlag{false};
     std::atomic<size_t> _activeThreads{0};
-};
+    std::atomic<long> _queuedTasks{0};
 
+    void startWorker();
+    void executionCycle(size_t index);
+    bool takeTask(size_t index, Task &task);
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "IoEngine.h"
+
+
+// Overlaps disk and socket I/O through an io_uring per worker thread: GET reads the next frame while the current
+// one is being sent and PUT writes a frame to disk while the next one is being received.
+class UringIoEngine : public IoEngine {
+public:
+    static bool isSupported();
+
+    const char *name() const override;
+
+    bool sendFileFrames(const Socket &socket, int fileFd, off_t offset, off_t length, size_t frameSize,
+                        uint32_t *crc) override;
+    off_t receiveFileFrames(const Socket &socket, int fileFd, off_t offset, size_t frameSize, off_t limit,
+                            uint32_t *crc) override;
+
+private:
+    class Ring;
+
+    static Ring *threadRing();
+
+    BlockingIoEngine _fallback;
+};
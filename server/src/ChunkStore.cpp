@@ -0,0 +1,438 @@
+#include "ChunkStore.h"
+#include "Logger.h"
+#include "Sha256.h"
+#include "TransferOptions.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+constexpr size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+
+static bool fromHex(const std::string &hex, std::string &bytes) {
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+
+    bytes.resize(hex.size() / 2);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        char *end;
+        const std::string pair = hex.substr(2 * i, 2);
+        bytes[i] = static_cast<char>(std::strtoul(pair.c_str(), &end, 16));
+        if (*end != '\0' || !isxdigit(pair[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static double toMebibytes(const uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+
+ChunkStore::ChunkStore(const std::string &directory) :
+    _root(directory + ".store/"), _objectsDirectory(_root + "objects/"), _temporaryDirectory(_root + "tmp/") {
+}
+
+
+bool ChunkStore::open() {
+    for (const std::string &path: {_root, _objectsDirectory, _temporaryDirectory}) {
+        if (mkdir(path.c_str(), 0777) == -1 && errno != EEXIST) {
+            perror("Error creating chunk store");
+            return false;
+        }
+    }
+
+    // uploads interrupted by a crash or shutdown leave their temporary files behind
+    DIR *dir = opendir(_temporaryDirectory.c_str());
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            unlink((_temporaryDirectory + entry->d_name).c_str());
+        }
+    }
+    closedir(dir);
+
+    if (!removeOrphans() || !loadIndex()) {
+        return false;
+    }
+    _open = true;
+    return true;
+}
+
+
+bool ChunkStore::isOpen() const {
+    return _open;
+}
+
+
+std::string ChunkStore::objectId(const std::vector<std::string> &chunkHashes, const off_t fileSize) {
+    Sha256 hash;
+    for (const std::string &chunkHash: chunkHashes) {
+        hash.update(chunkHash.data(), chunkHash.size());
+    }
+    const std::string size = std::to_string(fileSize);
+    hash.update(size.data(), size.size());
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    hash.finish(digest);
+    return Sha256::toHex(std::string(reinterpret_cast<const char *>(digest), sizeof(digest)));
+}
+
+
+bool ChunkStore::linkObject(const std::string &objectId, const std::string &targetPath) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_objects.count(objectId) == 0) {
+        return false;
+    }
+
+    std::string temporaryPath;
+    const int temporaryFd = createTemporary(temporaryPath);
+    if (temporaryFd == -1) {
+        return false;
+    }
+    close(temporaryFd);
+    unlink(temporaryPath.c_str());
+
+    // link() cannot replace an existing name, so the link is made aside and renamed over the target
+    if (link(objectPath(objectId).c_str(), temporaryPath.c_str()) == -1) {
+        perror("link");
+        return false;
+    }
+    return replaceTarget(temporaryPath, targetPath);
+}
+
+
+int ChunkStore::openObject(const std::string &objectId) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_objects.count(objectId) == 0) {
+        return -1;
+    }
+    return ::open(objectPath(objectId).c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+
+int ChunkStore::createTemporary(std::string &path) {
+    int fileFd;
+    do {
+        path = _temporaryDirectory + "upload." + std::to_string(_nextTemporary++);
+        fileFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    } while (fileFd == -1 && errno == EEXIST);
+
+    if (fileFd == -1) {
+        perror("open");
+    }
+    return fileFd;
+}
+
+
+bool ChunkStore::copyChunk(const std::string &chunkHash, const size_t length, const int targetFd,
+                           const off_t targetOffset) {
+    int sourceFd;
+    off_t sourceOffset;
+    {
+        // once open, the object stays readable even if its last user deletes it meanwhile
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto range = _chunks.equal_range(chunkHash);
+        auto it = range.first;
+        while (it != range.second && it->second.length != length) {
+            ++it;
+        }
+        if (it == range.second) {
+            return false;
+        }
+        sourceFd = ::open(objectPath(it->second.objectId).c_str(), O_RDONLY | O_CLOEXEC);
+        sourceOffset = it->second.offset;
+    }
+    if (sourceFd == -1) {
+        return false;
+    }
+
+    const bool copied = copyRange(sourceFd, sourceOffset, targetFd, targetOffset, length);
+    close(sourceFd);
+    return copied;
+}
+
+
+bool ChunkStore::addObject(const std::string &temporaryPath, const std::string &objectId,
+                           const std::vector<std::string> &chunkHashes, const std::string &targetPath) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::string path = objectPath(objectId);
+
+    if (link(temporaryPath.c_str(), path.c_str()) == -1) {
+        if (errno != EEXIST) {
+            perror("link");
+            unlink(temporaryPath.c_str());
+            return false;
+        }
+        // the same file was stored by a concurrent upload; its copy is linked instead
+        unlink(temporaryPath.c_str());
+        if (link(path.c_str(), temporaryPath.c_str()) == -1) {
+            perror("link");
+            return false;
+        }
+    }
+
+    struct stat objectStat{};
+    if (stat(path.c_str(), &objectStat) == 0 && _objects.count(objectId) == 0) {
+        _objects[objectId];
+        _objectInodes[std::make_pair(objectStat.st_dev, objectStat.st_ino)] = objectId;
+        indexObject(objectId, chunkHashes, objectStat.st_size);
+    }
+    return replaceTarget(temporaryPath, targetPath);
+}
+
+
+void ChunkStore::release(const std::string &path) {
+    if (!_open) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    releaseLocked(path);
+}
+
+
+void ChunkStore::recordUpload(const uint64_t fileBytes, const uint64_t receivedBytes) {
+    _uploadedBytes += fileBytes;
+    _receivedBytes += receivedBytes;
+}
+
+
+std::string ChunkStore::report() const {
+    std::vector<std::string> objectIds;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const std::pair<const std::string, std::vector<std::string>> &object: _objects) {
+            objectIds.push_back(object.first);
+        }
+    }
+
+    // every link besides the store's own is a user file
+    uint64_t storedBytes = 0, userBytes = 0, userFiles = 0;
+    for (const std::string &objectId: objectIds) {
+        struct stat objectStat{};
+        if (stat(objectPath(objectId).c_str(), &objectStat) == 0 && objectStat.st_nlink > 1) {
+            storedBytes += objectStat.st_size;
+            userBytes += objectStat.st_size * (objectStat.st_nlink - 1);
+            userFiles += objectStat.st_nlink - 1;
+        }
+    }
+
+    const uint64_t uploadedBytes = _uploadedBytes, receivedBytes = _receivedBytes;
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1) << "Store: " << objectIds.size() << " objects linked to " << userFiles
+            << " user files, " << toMebibytes(storedBytes) << " MiB on disk for " << toMebibytes(userBytes)
+            << " MiB of user data (" << toMebibytes(userBytes > storedBytes ? userBytes - storedBytes : 0)
+            << " MiB saved)\nDeduplicated PUTs: " << toMebibytes(receivedBytes) << " MiB received for "
+            << toMebibytes(uploadedBytes) << " MiB uploaded ("
+            << (uploadedBytes == 0 ? 0.0 : 100.0 * (uploadedBytes - receivedBytes) / uploadedBytes) << "% skipped)";
+    return report.str();
+}
+
+
+ChunkStore::~ChunkStore() {
+    if (_indexFd != -1) {
+        close(_indexFd);
+    }
+}
+
+
+bool ChunkStore::removeOrphans() {
+    DIR *dir = opendir(_objectsDirectory.c_str());
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
+
+    // objects only the store links to were left behind when a user file was replaced while the server was down
+    size_t removed = 0;
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        struct stat objectStat{};
+        const std::string objectId = entry->d_name;
+        if (objectId[0] == '.' || stat(objectPath(objectId).c_str(), &objectStat) != 0) {
+            continue;
+        }
+        if (objectStat.st_nlink <= 1) {
+            unlink(objectPath(objectId).c_str());
+            ++removed;
+            continue;
+        }
+        _objects[objectId];
+        _objectInodes[std::make_pair(objectStat.st_dev, objectStat.st_ino)] = objectId;
+    }
+    closedir(dir);
+
+    if (removed > 0) {
+        logInfo("Chunk store: removed " + std::to_string(removed) + " unreferenced objects.");
+    }
+    return true;
+}
+
+
+bool ChunkStore::loadIndex() {
+    const std::string indexPath = _root + "index";
+    const std::string compactedPath = _root + "index.tmp";
+
+    // each line is "<chunk hash> <object> <offset> <length>"; lines of removed objects are dropped on the way
+    std::ifstream index(indexPath);
+    std::string line, compacted;
+    while (std::getline(index, line)) {
+        std::istringstream fields(line);
+        std::string chunkHex, chunkHash;
+        ChunkLocation location;
+        if (!(fields >> chunkHex >> location.objectId >> location.offset >> location.length) ||
+            !fromHex(chunkHex, chunkHash) || chunkHash.size() != SHA256_DIGEST_SIZE) {
+            continue;
+        }
+
+        const auto object = _objects.find(location.objectId);
+        if (object != _objects.end()) {
+            object->second.push_back(chunkHash);
+            _chunks.insert(std::make_pair(chunkHash, location));
+            compacted += line + "\n";
+        }
+    }
+    index.close();
+
+    const int compactedFd = ::open(compactedPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (compactedFd == -1) {
+        perror("open");
+        return false;
+    }
+    const bool written = write(compactedFd, compacted.data(), compacted.size()) ==
+                         static_cast<ssize_t>(compacted.size());
+    close(compactedFd);
+    if (!written || rename(compactedPath.c_str(), indexPath.c_str()) == -1) {
+        perror("Error writing chunk index");
+        return false;
+    }
+
+    _indexFd = ::open(indexPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (_indexFd == -1) {
+        perror("open");
+        return false;
+    }
+    return true;
+}
+
+
+void ChunkStore::indexObject(const std::string &objectId, const std::vector<std::string> &chunkHashes,
+                             const off_t fileSize) {
+    std::vector<std::string> &objectChunks = _objects[objectId];
+    std::unordered_set<std::string> indexed;
+    std::string lines;
+
+    // every object lists all of its chunks, so they stay available when other objects holding them are removed
+    for (size_t i = 0; i < chunkHashes.size(); ++i) {
+        const off_t offset = static_cast<off_t>(i) * DEDUP_CHUNK_SIZE;
+        if (offset >= fileSize || !indexed.insert(chunkHashes[i]).second) {
+            continue;
+        }
+
+        ChunkLocation location;
+        location.objectId = objectId;
+        location.offset = offset;
+        location.length = std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - offset);
+        _chunks.insert(std::make_pair(chunkHashes[i], location));
+        objectChunks.push_back(chunkHashes[i]);
+        lines += Sha256::toHex(chunkHashes[i]) + " " + objectId + " " + std::to_string(location.offset) + " " +
+                std::to_string(location.length) + "\n";
+    }
+
+    // one append per object, so a crash loses whole objects' entries rather than leaving a torn line behind
+    if (!lines.empty() && write(_indexFd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size())) {
+        perror("Error appending to chunk index");
+    }
+}
+
+
+void ChunkStore::releaseLocked(const std::string &path) {
+    struct stat fileStat{};
+    if (stat(path.c_str(), &fileStat) != 0 || fileStat.st_nlink > 2) {
+        return; // not stored, or still linked by another user
+    }
+
+    const auto it = _objectInodes.find(std::make_pair(fileStat.st_dev, fileStat.st_ino));
+    if (it == _objectInodes.end()) {
+        return;
+    }
+    const std::string objectId = it->second;
+    _objectInodes.erase(it);
+    unlink(objectPath(objectId).c_str());
+
+    const auto object = _objects.find(objectId);
+    if (object != _objects.end()) {
+        for (const std::string &chunkHash: object->second) {
+            const auto range = _chunks.equal_range(chunkHash);
+            for (auto it = range.first; it != range.second;) {
+                it = it->second.objectId == objectId ? _chunks.erase(it) : std::next(it);
+            }
+        }
+        _objects.erase(object);
+    }
+}
+
+
+bool ChunkStore::replaceTarget(const std::string &temporaryPath, const std::string &targetPath) {
+    releaseLocked(targetPath);
+    if (rename(temporaryPath.c_str(), targetPath.c_str()) == -1) {
+        perror("rename");
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+std::string ChunkStore::objectPath(const std::string &objectId) const {
+    return _objectsDirectory + objectId;
+}
+
+
+bool ChunkStore::copyRange(const int sourceFd, off_t sourceOffset, const int targetFd, off_t targetOffset,
+                           size_t length) {
+#ifdef __linux__
+    // stays in the kernel, and shares extents instead of copying on reflink filesystems (XFS, Btrfs)
+    while (length > 0) {
+        loff_t sourcePosition = sourceOffset, targetPosition = targetOffset;
+        const ssize_t copied = copy_file_range(sourceFd, &sourcePosition, targetFd, &targetPosition, length, 0);
+        if (copied <= 0) {
+            break; // unsupported here; the loop below finishes the copy
+        }
+        sourceOffset += copied;
+        targetOffset += copied;
+        length -= copied;
+    }
+#endif
+
+    std::vector<char> buffer(std::min(length, COPY_BUFFER_SIZE));
+    while (length > 0) {
+        const ssize_t bytesRead = pread(sourceFd, buffer.data(), std::min(length, buffer.size()), sourceOffset);
+        if (bytesRead <= 0 || pwrite(targetFd, buffer.data(), bytesRead, targetOffset) != bytesRead) {
+            return false;
+        }
+        sourceOffset += bytesRead;
+        targetOffset += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+#include "CommandStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+
+constexpr int CommandStatistics::BUCKET_COUNT;
+constexpr size_t CommandStatistics::SHARD_COUNT;
+
+
+CommandStatistics::CommandStatistics(const std::vector<std::string> &commands, const std::vector<std::string> &queues) :
+    _commands(commands), _queues(queues) {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        _shards.emplace_back(new Shard(_commands.size() + 1, _queues.size()));
+    }
+}
+
+
+void CommandStatistics::record(const std::string &command, const std::chrono::steady_clock::duration latency,
+                               const uint64_t bytes) {
+    CommandCounters &counters = threadShard().commands[commandIndex(command)];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.latencyMicros.add(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    counters.bytes.add(bytes);
+}
+
+
+void CommandStatistics::recordWait(const std::string &queue, const std::chrono::steady_clock::duration wait) {
+    const size_t index = std::find(_queues.begin(), _queues.end(), queue) - _queues.begin();
+    if (index == _queues.size()) {
+        return;
+    }
+    WaitCounters &counters = threadShard().queues[index];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.waitMicros.add(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+}
+
+
+std::string CommandStatistics::snapshot() const {
+    std::ostringstream stream;
+    stream << std::left << std::setw(9) << "Command" << std::setw(9) << "Count" << std::setw(26)
+            << "Latency us p50/p99/p999" << "Bytes p50/p99/p999";
+
+    for (size_t command = 0; command <= _commands.size(); ++command) {
+        uint64_t count = 0;
+        std::vector<uint64_t> latencies(BUCKET_COUNT), bytes(BUCKET_COUNT);
+        for (const std::unique_ptr<Shard> &shard: _shards) {
+            const CommandCounters &counters = shard->commands[command];
+            count += counters.count.load(std::memory_order_relaxed);
+            mergeInto(counters.latencyMicros, latencies);
+            mergeInto(counters.bytes, bytes);
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        stream << "\n" << std::setw(9) << (command < _commands.size() ? _commands[command] : "INVALID")
+                << std::setw(9) << count << std::setw(26) << percentiles(latencies) << percentiles(bytes);
+    }
+
+    if (!_queues.empty()) {
+        stream << "\n\n" << std::setw(9) << "Queue" << std::setw(9) << "Count" << "Wait us p50/p99/p999";
+    }
+    for (size_t queue = 0; queue < _queues.size(); ++queue) {
+        uint64_t count = 0;
+        std::vector<uint64_t> waits(BUCKET_COUNT);
+        for (const std::unique_ptr<Shard> &shard: _shards) {
+            count += shard->queues[queue].count.load(std::memory_order_relaxed);
+            mergeInto(shard->queues[queue].waitMicros, waits);
+        }
+        stream << "\n" << std::setw(9) << _queues[queue] << std::setw(9) << count
+                << (count == 0 ? "-" : percentiles(waits));
+    }
+    return stream.str();
+}
+
+
+void CommandStatistics::Histogram::add(const uint64_t value) {
+    buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+size_t CommandStatistics::commandIndex(const std::string &command) const {
+    return std::find(_commands.begin(), _commands.end(), command) - _commands.begin();
+}
+
+
+CommandStatistics::Shard &CommandStatistics::threadShard() {
+    static std::atomic<size_t> nextShard{0};
+    static thread_local const size_t shard = nextShard++ % SHARD_COUNT;
+    return *_shards[shard];
+}
+
+
+size_t CommandStatistics::bucketFor(const uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    const uint64_t subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+
+
+uint64_t CommandStatistics::bucketUpperBound(const size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+
+    const int exponent = static_cast<int>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+    const uint64_t subBucket = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + subBucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+
+void CommandStatistics::mergeInto(const Histogram &histogram, std::vector<uint64_t> &buckets) {
+    for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        buckets[bucket] += histogram.buckets[bucket].load(std::memory_order_relaxed);
+    }
+}
+
+
+// histograms are read bucket by bucket while other threads record, so the total comes from the buckets
+std::string CommandStatistics::percentiles(const std::vector<uint64_t> &buckets) {
+    const uint64_t total = std::accumulate(buckets.begin(), buckets.end(), uint64_t{0});
+    std::ostringstream stream;
+    stream << percentile(buckets, total, 0.5) << "/" << percentile(buckets, total, 0.99) << "/"
+            << percentile(buckets, total, 0.999);
+    return stream.str();
+}
+
+
+uint64_t CommandStatistics::percentile(const std::vector<uint64_t> &buckets, const uint64_t total,
+                                       const double fraction) {
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * total)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return bucketUpperBound(bucket);
+        }
+    }
+    return 0;
+}
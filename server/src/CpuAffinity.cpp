@@ -0,0 +1,49 @@
+#include "CpuAffinity.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_getaffinity");
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+
+bool pinThread(const std::thread::native_handle_type thread, const std::vector<int> &cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu: cpus) {
+        CPU_SET(cpu, &set);
+    }
+    const int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (error != 0) {
+        errno = error;
+        perror("pthread_setaffinity_np");
+        return false;
+    }
+    return true;
+#else
+    (void) thread;
+    (void) cpus;
+    return false; // macOS only offers affinity hints, which do not bind a thread to a core
+#endif
+}
@@ -0,0 +1,140 @@
+#include "EventLoop.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+
+constexpr int MAX_EVENTS = 256;
+
+
+EventLoop::EventLoop() {
+#ifdef __linux__
+    _pollFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    _pollFd = kqueue();
+#endif
+    if (_pollFd == -1) {
+        perror("Error creating event loop");
+        return;
+    }
+
+    if (pipe(_wakeupPipe) == -1) {
+        perror("Error creating wakeup pipe");
+        return;
+    }
+    fcntl(_wakeupPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_wakeupPipe[1], F_SETFL, O_NONBLOCK);
+    add(_wakeupPipe[0], false);
+}
+
+
+bool EventLoop::add(const int fd, const bool oneShot) const {
+#ifdef __linux__
+    epoll_event event{};
+    event.events = EPOLLIN | (oneShot ? static_cast<uint32_t>(EPOLLONESHOT) : 0u);
+    event.data.fd = fd;
+    const int result = epoll_ctl(_pollFd, EPOLL_CTL_ADD, fd, &event);
+#else
+    struct kevent event{};
+    EV_SET(&event, fd, EVFILT_READ, EV_ADD | (oneShot ? EV_ONESHOT : 0), 0, 0, nullptr);
+    const int result = kevent(_pollFd, &event, 1, nullptr, 0, nullptr);
+#endif
+    if (result == -1) {
+        perror("Error registering descriptor");
+        return false;
+    }
+    return true;
+}
+
+
+bool EventLoop::rearm(const int fd) const {
+#ifdef __linux__
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    const int result = epoll_ctl(_pollFd, EPOLL_CTL_MOD, fd, &event);
+#else
+    struct kevent event{};
+    EV_SET(&event, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, nullptr);
+    const int result = kevent(_pollFd, &event, 1, nullptr, 0, nullptr);
+#endif
+    if (result == -1) {
+        perror("Error re-arming descriptor");
+        return false;
+    }
+    return true;
+}
+
+
+void EventLoop::remove(const int fd) const {
+#ifdef __linux__
+    epoll_ctl(_pollFd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+    struct kevent event{};
+    EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    kevent(_pollFd, &event, 1, nullptr, 0, nullptr); // fails harmlessly for already fired one-shot events
+#endif
+}
+
+
+int EventLoop::wait(std::vector<int> &readyFds, const int timeoutMs) const {
+    readyFds.clear();
+
+#ifdef __linux__
+    epoll_event events[MAX_EVENTS];
+    const int count = epoll_wait(_pollFd, events, MAX_EVENTS, timeoutMs);
+#else
+    struct kevent events[MAX_EVENTS];
+    timespec timeout{};
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    const int count = kevent(_pollFd, nullptr, 0, events, MAX_EVENTS, &timeout);
+#endif
+    if (count == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+#ifdef __linux__
+        const int fd = events[i].data.fd;
+#else
+        const int fd = static_cast<int>(events[i].ident);
+#endif
+        if (fd == _wakeupPipe[0]) {
+            drainWakeupPipe();
+        } else {
+            readyFds.push_back(fd);
+        }
+    }
+    return static_cast<int>(readyFds.size());
+}
+
+
+void EventLoop::wakeup() const {
+    const char byte = 1;
+    write(_wakeupPipe[1], &byte, sizeof(byte));
+}
+
+
+EventLoop::~EventLoop() {
+    for (const int fd: {_wakeupPipe[0], _wakeupPipe[1], _pollFd}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+
+void EventLoop::drainWakeupPipe() const {
+    char buffer[64];
+    while (read(_wakeupPipe[0], buffer, sizeof(buffer)) > 0) {
+    }
+}
@@ -0,0 +1,129 @@
+#include "FileCache.h"
+
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+#include <Crc32c.h>
+
+
+constexpr size_t FileCache::DEFAULT_BUDGET;
+constexpr size_t FileCache::MAX_FILE_SIZE;
+
+
+FileCache::FileCache(const size_t budget) : _budget(budget) {
+}
+
+
+bool FileCache::isEnabled() const {
+    return _budget > 0;
+}
+
+
+std::shared_ptr<const FileCache::Entry> FileCache::find(const std::string &path) {
+    if (!isEnabled()) {
+        return nullptr;
+    }
+
+    struct stat fileStat{};
+    const bool exists = stat(path.c_str(), &fileStat) == 0;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _entries.find(path);
+    if (it == _entries.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    if (!exists || !isSameVersion(it->second->second->fileStat, fileStat)) {
+        erase(it);
+        ++_invalidations;
+        ++_misses;
+        return nullptr;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second);
+    ++_hits;
+    return it->second->second;
+}
+
+
+std::shared_ptr<const FileCache::Entry> FileCache::load(const std::string &path, const int fileFd,
+                                                        const struct stat &fileStat) {
+    if (!isEnabled() || !S_ISREG(fileStat.st_mode) || static_cast<size_t>(fileStat.st_size) > MAX_FILE_SIZE ||
+        static_cast<size_t>(fileStat.st_size) > _budget) {
+        return nullptr;
+    }
+
+    const std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->fileStat = fileStat;
+    entry->data.resize(fileStat.st_size);
+    off_t position = 0;
+    while (position < fileStat.st_size) {
+        const ssize_t bytesRead = pread(fileFd, &entry->data[position], fileStat.st_size - position, position);
+        if (bytesRead <= 0) {
+            return nullptr;
+        }
+        position += bytesRead;
+    }
+    struct stat afterRead{};
+    if (fstat(fileFd, &afterRead) == -1 || !isSameVersion(fileStat, afterRead)) {
+        return nullptr; // written to while we read; the caller serves it from disk
+    }
+    entry->crc = crc32c(0, entry->data.data(), entry->data.size());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto existing = _entries.find(path);
+    if (existing != _entries.end()) {
+        erase(existing);
+    }
+    while (_usedBytes + entry->data.size() > _budget && !_lru.empty()) {
+        erase(_entries.find(_lru.back().first));
+        ++_evictions;
+    }
+    _lru.emplace_front(path, entry);
+    _entries[path] = _lru.begin();
+    _usedBytes += entry->data.size();
+    return entry;
+}
+
+
+void FileCache::invalidate(const std::string &path) {
+    if (!isEnabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _entries.find(path);
+    if (it != _entries.end()) {
+        erase(it);
+        ++_invalidations;
+    }
+}
+
+
+std::string FileCache::report() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const uint64_t lookups = _hits + _misses;
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1) << "File cache: " << _hits << " hits, " << _misses << " misses ("
+            << (lookups == 0 ? 0.0 : _hits * 100.0 / lookups) << "% hit ratio), " << _entries.size() << " files in "
+            << _usedBytes / (1024.0 * 1024.0) << " of " << _budget / (1024.0 * 1024.0) << " MiB, " << _evictions
+            << " evictions, " << _invalidations << " invalidations";
+    return stream.str();
+}
+
+
+void FileCache::erase(const std::unordered_map<std::string, LruList::iterator>::iterator it) {
+    _usedBytes -= it->second->second->data.size();
+    _lru.erase(it->second);
+    _entries.erase(it);
+}
+
+
+bool FileCache::isSameVersion(const struct stat &cached, const struct stat &current) {
+#ifdef __APPLE__
+    const timespec &cachedTime = cached.st_mtimespec, &currentTime = current.st_mtimespec;
+#else
+    const timespec &cachedTime = cached.st_mtim, &currentTime = current.st_mtim;
+#endif
+    return cached.st_dev == current.st_dev && cached.st_ino == current.st_ino && cached.st_size == current.st_size &&
+           cachedTime.tv_sec == currentTime.tv_sec && cachedTime.tv_nsec == currentTime.tv_nsec;
+}
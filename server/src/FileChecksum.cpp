@@ -0,0 +1,88 @@
+#include "FileChecksum.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/xattr.h>
+
+
+namespace {
+    const char CHECKSUM_ATTRIBUTE[] = "user.crc32c";
+    constexpr size_t CHECKSUM_VALUE_SIZE = 64;
+
+    // "<crc> <size> <mtime seconds> <mtime nanoseconds>"
+    std::string formatValue(const uint32_t crc, const struct stat &fileStat) {
+        char value[CHECKSUM_VALUE_SIZE];
+        snprintf(value, sizeof(value), "%08" PRIx32 " %lld %lld %ld", crc, static_cast<long long>(fileStat.st_size),
+                 static_cast<long long>(fileStat.st_mtim.tv_sec), static_cast<long>(fileStat.st_mtim.tv_nsec));
+        return value;
+    }
+
+    bool parseValue(const char *value, const ssize_t size, const struct stat &fileStat, uint32_t &crc) {
+        if (size <= 0 || size >= static_cast<ssize_t>(CHECKSUM_VALUE_SIZE)) {
+            return false;
+        }
+        const std::string text(value, size);
+        uint32_t storedCrc;
+        if (sscanf(text.c_str(), "%8" SCNx32, &storedCrc) != 1 || text != formatValue(storedCrc, fileStat)) {
+            return false; // written for another version of the file
+        }
+        crc = storedCrc;
+        return true;
+    }
+}
+
+
+bool loadChecksum(const int fileFd, const struct stat &fileStat, uint32_t &crc) {
+    char value[CHECKSUM_VALUE_SIZE];
+    return parseValue(value, fgetxattr(fileFd, CHECKSUM_ATTRIBUTE, value, sizeof(value)), fileStat, crc);
+}
+
+
+bool loadChecksum(const std::string &path, const struct stat &fileStat, uint32_t &crc) {
+    char value[CHECKSUM_VALUE_SIZE];
+    return parseValue(value, getxattr(path.c_str(), CHECKSUM_ATTRIBUTE, value, sizeof(value)), fileStat, crc);
+}
+
+
+void storeChecksum(const int fileFd, const struct stat &fileStat, const uint32_t crc) {
+    const std::string value = formatValue(crc, fileStat);
+    fsetxattr(fileFd, CHECKSUM_ATTRIBUTE, value.data(), value.size(), 0); // best effort, INFO just omits it
+}
+
+#else
+
+bool loadChecksum(int, const struct stat &, uint32_t &) {
+    return false;
+}
+
+
+bool loadChecksum(const std::string &, const struct stat &, uint32_t &) {
+    return false;
+}
+
+
+void storeChecksum(int, const struct stat &, uint32_t) {
+}
+
+#endif
+
+
+void storeChecksum(const int fileFd, const uint32_t crc) {
+    struct stat fileStat{};
+    if (fstat(fileFd, &fileStat) == 0) {
+        storeChecksum(fileFd, fileStat, crc);
+    }
+}
+
+
+void storeChecksum(const std::string &path, const uint32_t crc) {
+    const int fileFd = open(path.c_str(), O_RDONLY);
+    if (fileFd != -1) {
+        storeChecksum(fileFd, crc);
+        close(fileFd);
+    }
+}
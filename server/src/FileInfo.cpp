@@ -0,0 +1,47 @@
+#include "FileInfo.h"
+#include "Crc32c.h"
+#include "FileChecksum.h"
+
+#include <ctime>
+#include <sstream>
+
+
+std::string formatPermissions(const mode_t mode) {
+    std::ostringstream permissions;
+
+    permissions << ((mode & S_IRUSR) ? "r" : "-");
+    permissions << ((mode & S_IWUSR) ? "w" : "-");
+    permissions << ((mode & S_IXUSR) ? "x" : "-");
+
+    permissions << ((mode & S_IRGRP) ? "r" : "-");
+    permissions << ((mode & S_IWGRP) ? "w" : "-");
+    permissions << ((mode & S_IXGRP) ? "x" : "-");
+
+    permissions << ((mode & S_IROTH) ? "r" : "-");
+    permissions << ((mode & S_IWOTH) ? "w" : "-");
+    permissions << ((mode & S_IXOTH) ? "x" : "-");
+
+    return permissions.str();
+}
+
+
+std::string formatFileInfo(const std::string &path, const struct stat &fileStat) {
+#ifdef __APPLE__
+    const time_t &creationTime = fileStat.st_birthtime;
+#else
+    const time_t &creationTime = fileStat.st_ctime; // no birth time in struct stat outside of BSD/macOS
+#endif
+    char timeBuffer[32]; // ctime_r() needs 26 bytes
+
+    std::ostringstream metadataStream;
+    metadataStream << "Size: " << fileStat.st_size << " bytes\n";
+    metadataStream << "Last Modified: " << ctime_r(&fileStat.st_mtime, timeBuffer);
+    metadataStream << "Last Accessed: " << ctime_r(&fileStat.st_atime, timeBuffer);
+    metadataStream << "Creation Time: " << ctime_r(&creationTime, timeBuffer);
+    metadataStream << "Permissions: " << formatPermissions(fileStat.st_mode);
+    uint32_t crc;
+    if (loadChecksum(path, fileStat, crc)) {
+        metadataStream << "\nCRC32C: " << formatChecksum(crc);
+    }
+    return metadataStream.str();
+}
@@ -0,0 +1,128 @@
+#include "IoEngine.h"
+#include "Crc32c.h"
+#include "Logger.h"
+#include "UringIoEngine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+#include <unistd.h>
+
+
+std::unique_ptr<IoEngine> IoEngine::create(const IoEngineType type) {
+    if (type == IoEngineType::URING) {
+        if (UringIoEngine::isSupported()) {
+            return std::unique_ptr<IoEngine>(new UringIoEngine());
+        }
+        logWarning("io_uring is not available, falling back to blocking file I/O.");
+    }
+    return std::unique_ptr<IoEngine>(new BlockingIoEngine());
+}
+
+
+bool IoEngine::sendCompressedFrames(const Socket &socket, const int fileFd, const off_t offset, const off_t length,
+                                    const size_t frameSize, FrameCompressor &compressor, uint32_t *crc) {
+    off_t position = offset;
+    const off_t end = offset + length;
+
+    while (position < end) {
+        const ssize_t bytesRead = pread(fileFd, compressor.input(), std::min<off_t>(frameSize, end - position),
+                                        position);
+        if (bytesRead <= 0) {
+            return false;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, compressor.input(), bytesRead);
+        }
+        if (compressor.sendFrame(socket, bytesRead) == -1) {
+            return false;
+        }
+        position += bytesRead;
+    }
+    return true;
+}
+
+
+off_t IoEngine::receiveCompressedFrames(const Socket &socket, const int fileFd, const off_t offset, const off_t limit,
+                                        FrameDecompressor &decompressor, uint32_t *crc) {
+    off_t written = 0;
+
+    while (true) {
+        const char *frame;
+        const ssize_t bytesReceived = decompressor.receiveFrame(socket, frame);
+        if (bytesReceived == 0) {
+            return written; // end-of-transfer frame
+        }
+        if (bytesReceived < 0) {
+            return -1;
+        }
+        if (written + bytesReceived > limit) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (pwrite(fileFd, frame, bytesReceived, offset + written) != bytesReceived) {
+            return -1;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, frame, bytesReceived);
+        }
+        written += bytesReceived;
+    }
+}
+
+
+const char *BlockingIoEngine::name() const {
+    return "blocking";
+}
+
+
+bool BlockingIoEngine::sendFileFrames(const Socket &socket, const int fileFd, const off_t offset, const off_t length,
+                                      const size_t frameSize, uint32_t *crc) {
+    std::vector<char> buffer(frameSize);
+    off_t position = offset;
+    const off_t end = offset + length;
+
+    while (position < end) {
+        const ssize_t bytesRead = pread(fileFd, buffer.data(), std::min<off_t>(buffer.size(), end - position),
+                                        position);
+        if (bytesRead <= 0) {
+            return false;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, buffer.data(), bytesRead);
+        }
+        if (socket.sendData(buffer.data(), bytesRead) == -1) {
+            return false;
+        }
+        position += bytesRead;
+    }
+    return true;
+}
+
+
+off_t BlockingIoEngine::receiveFileFrames(const Socket &socket, const int fileFd, const off_t offset,
+                                          const size_t frameSize, const off_t limit, uint32_t *crc) {
+    off_t written = 0;
+
+    while (true) {
+        const char *frame;
+        const ssize_t bytesReceived = socket.receiveView(frame, frameSize);
+        if (bytesReceived == 0) {
+            return written; // end-of-transfer frame
+        }
+        if (bytesReceived < 0) {
+            return -1;
+        }
+        if (written + bytesReceived > limit) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (pwrite(fileFd, frame, bytesReceived, offset + written) != bytesReceived) {
+            return -1;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, frame, bytesReceived);
+        }
+        written += bytesReceived;
+    }
+}
@@ -0,0 +1,204 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+
+constexpr std::chrono::milliseconds DRAIN_INTERVAL(5);
+
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+
+Logger::Logger() : _writer(&Logger::run, this) {
+}
+
+
+void Logger::setLevel(const LogLevel level) {
+    _level = level;
+}
+
+
+void Logger::setSampling(const unsigned everyNth) {
+    _sampling = std::max(everyNth, 1u);
+}
+
+
+void Logger::setOutput(const int fd) {
+    flush();
+    _outputFd = fd;
+}
+
+
+bool Logger::enabled(const LogLevel level) const {
+    return level != LogLevel::OFF && level >= _level.load(std::memory_order_relaxed);
+}
+
+
+void Logger::log(const LogLevel level, std::string message) {
+    if (!enabled(level)) {
+        return;
+    }
+    if (level <= LogLevel::INFO) {
+        static thread_local unsigned sampleCounter = 0;
+        if (sampleCounter++ % _sampling.load(std::memory_order_relaxed) != 0) {
+            return;
+        }
+    }
+
+    Ring &ring = threadRing();
+    const size_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail - ring.head.load(std::memory_order_acquire) == Ring::CAPACITY) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry &entry = ring.entries[tail % Ring::CAPACITY];
+    entry.time = std::chrono::steady_clock::now();
+    entry.level = level;
+    entry.message.swap(message);
+    ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(_wakeupMutex);
+    if (!_running) {
+        return;
+    }
+    const uint64_t request = ++_flushRequests;
+    _wakeup.notify_one();
+    _flushed.wait(lock, [this, request] { return _flushesDone >= request; });
+}
+
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(_wakeupMutex);
+        _running = false;
+    }
+    _wakeup.notify_one();
+    _writer.join();
+}
+
+
+Logger::Ring &Logger::threadRing() {
+    static thread_local std::shared_ptr<Ring> ring;
+    if (!ring) {
+        ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(_ringsMutex);
+        _rings.push_back(ring);
+    }
+    return *ring;
+}
+
+
+void Logger::run() {
+    std::string output;
+    bool running = true;
+    while (running) {
+        uint64_t flushRequests;
+        {
+            std::unique_lock<std::mutex> lock(_wakeupMutex);
+            _wakeup.wait_for(lock, DRAIN_INTERVAL, [this] {
+                return !_running || _flushRequests != _flushesDone;
+            });
+            running = _running;
+            flushRequests = _flushRequests;
+        }
+
+        drain(output);
+        write(output);
+        output.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(_wakeupMutex);
+            _flushesDone = flushRequests;
+        }
+        _flushed.notify_all();
+    }
+}
+
+
+size_t Logger::drain(std::string &output) {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(_ringsMutex);
+        // rings of threads that have exited are only referenced from here once they are empty
+        _rings.erase(std::remove_if(_rings.begin(), _rings.end(), [](const std::shared_ptr<Ring> &ring) {
+            return ring.use_count() == 1 && ring->head.load() == ring->tail.load();
+        }), _rings.end());
+        rings = _rings;
+    }
+
+    std::vector<Entry> entries;
+    for (const std::shared_ptr<Ring> &ring: rings) {
+        const size_t tail = ring->tail.load(std::memory_order_acquire);
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        for (; head != tail; ++head) {
+            Entry &entry = ring->entries[head % Ring::CAPACITY];
+            entries.push_back(Entry{entry.time, entry.level, std::string()});
+            entries.back().message.swap(entry.message);
+        }
+        ring->head.store(head, std::memory_order_release);
+    }
+
+    // each ring is already in order, the merge only interleaves threads
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.time < b.time;
+    });
+
+    for (const Entry &entry: entries) {
+        if (entry.level >= LogLevel::WARNING) {
+            output += "\033[31m" + entry.message + "\033[0m\n";
+        } else {
+            output += entry.message + "\n";
+        }
+    }
+
+    const uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped != 0) {
+        output += "\033[31m" + std::to_string(dropped) + " log messages dropped.\033[0m\n";
+    }
+    return entries.size();
+}
+
+
+void Logger::write(const std::string &output) const {
+    const int fd = _outputFd;
+    size_t written = 0;
+    while (written < output.size()) {
+        const ssize_t result = ::write(fd, output.data() + written, output.size() - written);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; // nowhere left to report it
+        }
+        written += result;
+    }
+}
+
+
+void logDebug(const std::string &message) {
+    Logger::instance().log(LogLevel::DEBUG, message);
+}
+
+
+void logInfo(const std::string &message) {
+    Logger::instance().log(LogLevel::INFO, message);
+}
+
+
+void logWarning(const std::string &message) {
+    Logger::instance().log(LogLevel::WARNING, message);
+}
+
+
+void logError(const std::string &message) {
+    Logger::instance().log(LogLevel::ERROR, message);
+}
@@ -0,0 +1,359 @@
+#include "MetadataCache.h"
+#include "FileInfo.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+
+// IN_CLOSE_NOWRITE follows every GET, which keeps "Last Accessed" current without watching each read
+constexpr uint32_t USER_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                 IN_CLOSE_NOWRITE | IN_ATTRIB | IN_ONLYDIR;
+constexpr uint32_t ROOT_EVENTS = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+#endif
+
+
+MetadataCache::MetadataCache(const std::string &directory, const HiddenFilter isHidden) :
+    _directory(directory), _isHidden(isHidden) {
+}
+
+
+bool MetadataCache::start(const size_t warmupThreads) {
+#ifdef __linux__
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd == -1) {
+        perror("inotify_init1");
+        return false;
+    }
+
+    // new user folders are picked up through the root watch, existing ones are loaded below
+    _rootWatch = inotify_add_watch(_inotifyFd, _directory.c_str(), ROOT_EVENTS);
+    DIR *dir = _rootWatch == -1 ? nullptr : opendir(_directory.c_str());
+    if (!dir) {
+        perror("Error watching server directory");
+        close(_inotifyFd);
+        _inotifyFd = -1;
+        return false;
+    }
+
+    std::vector<std::string> usernames;
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        struct stat dirStat{};
+        const std::string name = entry->d_name;
+        if (name != "." && name != ".." && stat((_directory + name).c_str(), &dirStat) == 0 &&
+            S_ISDIR(dirStat.st_mode)) {
+            usernames.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    // folders are independent, so warming is spread over several threads
+    std::atomic<size_t> nextUser{0};
+    std::vector<std::thread> loaders;
+    const size_t loaderCount = std::min(std::max<size_t>(warmupThreads, 1), usernames.size());
+    for (size_t i = 0; i < loaderCount; ++i) {
+        loaders.emplace_back([this, &usernames, &nextUser] {
+            size_t index;
+            while ((index = nextUser++) < usernames.size()) {
+                loadUser(usernames[index]);
+            }
+        });
+    }
+    for (std::thread &loader: loaders) {
+        loader.join();
+    }
+
+    if (!_eventLoop.add(_inotifyFd, false)) {
+        close(_inotifyFd);
+        _inotifyFd = -1;
+        return false;
+    }
+    _running = true;
+    _watcher = std::thread(&MetadataCache::watch, this);
+    return true;
+#else
+    (void) warmupThreads;
+    return false;
+#endif
+}
+
+
+void MetadataCache::stop() {
+    if (!_running) {
+        return;
+    }
+    _running = false;
+    _eventLoop.wakeup();
+    _watcher.join();
+    _eventLoop.remove(_inotifyFd);
+    close(_inotifyFd);
+    _inotifyFd = -1;
+}
+
+
+void MetadataCache::addUser(const std::string &username) {
+    if (_running) {
+        loadUser(username);
+    }
+}
+
+
+void MetadataCache::refresh(const std::string &username, const std::string &filename) {
+    const std::shared_ptr<UserEntry> user = findUser(username);
+    if (!user) {
+        return;
+    }
+
+    struct stat fileStat{};
+    const bool exists = stat((_directory + username + "/" + filename).c_str(), &fileStat) == 0 &&
+                        S_ISREG(fileStat.st_mode);
+
+    std::lock_guard<std::mutex> lock(user->mutex);
+    if (!exists) {
+        if (user->files.erase(filename) != 0) {
+            user->listingValid = false;
+        }
+        return;
+    }
+
+    const std::pair<std::map<std::string, FileEntry>::iterator, bool> inserted =
+            user->files.insert(std::make_pair(filename, FileEntry()));
+    inserted.first->second.fileStat = fileStat;
+    inserted.first->second.info.clear();
+    if (inserted.second) {
+        user->listingValid = false;
+    }
+}
+
+
+void MetadataCache::remove(const std::string &username, const std::string &filename) {
+    const std::shared_ptr<UserEntry> user = findUser(username);
+    if (!user) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(user->mutex);
+    if (user->files.erase(filename) != 0) {
+        user->listingValid = false;
+    }
+}
+
+
+CacheLookup MetadataCache::list(const std::string &username, std::string &listing) {
+    const std::shared_ptr<UserEntry> user = findUser(username);
+    if (!user) {
+        return CacheLookup::UNAVAILABLE;
+    }
+
+    std::lock_guard<std::mutex> lock(user->mutex);
+    if (!user->listingValid) {
+        std::string rebuilt;
+        for (const std::pair<const std::string, FileEntry> &file: user->files) {
+            if (_isHidden(file.first)) {
+                continue;
+            }
+            if (!rebuilt.empty()) {
+                rebuilt += "\n";
+            }
+            rebuilt += file.first;
+        }
+        user->listing.swap(rebuilt);
+        user->listingValid = true;
+    }
+    listing = user->listing;
+    return CacheLookup::HIT;
+}
+
+
+CacheLookup MetadataCache::info(const std::string &username, const std::string &filename, std::string &info) {
+    const std::shared_ptr<UserEntry> user = findUser(username);
+    if (!user) {
+        return CacheLookup::UNAVAILABLE;
+    }
+
+    std::lock_guard<std::mutex> lock(user->mutex);
+    const std::map<std::string, FileEntry>::iterator it = user->files.find(filename);
+    if (it == user->files.end()) {
+        return CacheLookup::MISSING;
+    }
+    if (it->second.info.empty()) {
+        it->second.info = formatFileInfo(_directory + username + "/" + filename, it->second.fileStat);
+    }
+    info = it->second.info;
+    return CacheLookup::HIT;
+}
+
+
+CacheLookup MetadataCache::size(const std::string &username, const std::string &filename, off_t &size) {
+    const std::shared_ptr<UserEntry> user = findUser(username);
+    if (!user) {
+        return CacheLookup::UNAVAILABLE;
+    }
+
+    std::lock_guard<std::mutex> lock(user->mutex);
+    const std::map<std::string, FileEntry>::const_iterator it = user->files.find(filename);
+    if (it == user->files.end()) {
+        return CacheLookup::MISSING;
+    }
+    size = it->second.fileStat.st_size;
+    return CacheLookup::HIT;
+}
+
+
+MetadataCache::~MetadataCache() {
+    stop();
+}
+
+
+std::shared_ptr<MetadataCache::UserEntry> MetadataCache::findUser(const std::string &username) {
+    if (!_running) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_usersMutex);
+    const auto it = _users.find(username);
+    return it == _users.end() ? nullptr : it->second;
+}
+
+
+void MetadataCache::loadUser(const std::string &username) {
+#ifdef __linux__
+    if (username.empty() || username[0] == '.') {
+        return; // the chunk store, not a user folder
+    }
+
+    const std::shared_ptr<UserEntry> user = std::make_shared<UserEntry>();
+    // held until the scan is done, so lookups never see a half-loaded folder
+    std::unique_lock<std::mutex> userLock(user->mutex);
+
+    int watch;
+    {
+        std::lock_guard<std::mutex> lock(_usersMutex);
+        if (_users.count(username) != 0) {
+            return;
+        }
+        // the watch comes first, so changes made while scanning are replayed afterwards
+        watch = inotify_add_watch(_inotifyFd, (_directory + username).c_str(), USER_EVENTS);
+        if (watch == -1) {
+            perror("inotify_add_watch");
+            return;
+        }
+        _users[username] = user;
+        _watchedUsers[watch] = username;
+    }
+
+    if (!scanUser(username, *user)) {
+        userLock.unlock();
+        dropUser(watch);
+    }
+#else
+    (void) username;
+#endif
+}
+
+
+void MetadataCache::dropUser(const int watch) {
+    std::lock_guard<std::mutex> lock(_usersMutex);
+    const auto it = _watchedUsers.find(watch);
+    if (it != _watchedUsers.end()) {
+        _users.erase(it->second);
+        _watchedUsers.erase(it);
+    }
+}
+
+
+bool MetadataCache::scanUser(const std::string &username, UserEntry &user) const {
+    const std::string userDirectory = _directory + username + "/";
+    DIR *dir = opendir(userDirectory.c_str());
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
+
+    user.files.clear();
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        FileEntry file{};
+        if (stat((userDirectory + entry->d_name).c_str(), &file.fileStat) == 0 && S_ISREG(file.fileStat.st_mode)) {
+            user.files[entry->d_name] = file;
+        }
+    }
+    closedir(dir);
+    user.listingValid = false;
+    return true;
+}
+
+
+void MetadataCache::rescanUsers() {
+    std::vector<std::pair<std::string, std::shared_ptr<UserEntry>>> users;
+    {
+        std::lock_guard<std::mutex> lock(_usersMutex);
+        users.assign(_users.begin(), _users.end());
+    }
+
+    for (const std::pair<std::string, std::shared_ptr<UserEntry>> &user: users) {
+        std::lock_guard<std::mutex> lock(user.second->mutex);
+        scanUser(user.first, *user.second);
+    }
+}
+
+
+void MetadataCache::watch() {
+    std::vector<int> readyFds;
+    while (_running) {
+        if (_eventLoop.wait(readyFds, -1) == -1) {
+            perror("Metadata cache wait failed");
+            break;
+        }
+        if (!readyFds.empty()) {
+            handleEvents();
+        }
+    }
+}
+
+
+void MetadataCache::handleEvents() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[64 * 1024];
+    bool overflowed = false;
+
+    ssize_t length;
+    while ((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char *position = buffer; position < buffer + length;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(position);
+            position += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+            } else if (event->wd == _rootWatch) {
+                if ((event->mask & IN_ISDIR) && event->len > 0) {
+                    loadUser(event->name);
+                }
+            } else if (event->mask & IN_IGNORED) {
+                dropUser(event->wd); // the folder itself was removed
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                std::string username;
+                {
+                    std::lock_guard<std::mutex> lock(_usersMutex);
+                    const auto it = _watchedUsers.find(event->wd);
+                    if (it == _watchedUsers.end()) {
+                        continue;
+                    }
+                    username = it->second;
+                }
+                refresh(username, event->name);
+            }
+        }
+    }
+
+    if (overflowed) {
+        rescanUsers(); // events were dropped, so no entry can be trusted
+    }
+#endif
+}
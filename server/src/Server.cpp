@@ -1,354 +1,2066 @@
 #include "Server.h"
+#include "ChunkProof.h"
+#include "CpuAffinity.h"
+#include "Crc32c.h"
+#include "DeltaSync.h"
+#include "FileChecksum.h"
+#include "FileInfo.h"
+#include "Logger.h"
+#include "Sha256.h"
 #include "ThreadPool.h"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <sstream>
+#include <cstring>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <thread>
 #include <sys/fcntl.h>
 
 
-const std::vector<std::string> COMMANDS = {"GET", "PUT", "LIST", "DELETE", "INFO", "EXIT"};
+const std::vector<std::string> COMMANDS = {"GET", "PUT", "LIST", "DELETE", "INFO", "SIZE", "STATS", "EXIT"};
+const std::vector<std::string> QUEUES = {"ADMIT", "WORKER"};
 
+const std::string PARTIAL_SUFFIX = ".part";
+const std::string STRIPED_SUFFIX = ".stripes";
+const std::string DELTA_SUFFIX = ".delta";
+const std::string UPLOAD_SUFFIX = ".upload";
 
-Server::Server(const std::string &directory, const size_t maxSimultaneousClients) : _directory(directory),
-    _threadPool(maxSimultaneousClients), _maxSimultaneousClients(maxSimultaneousClients) {
-    for (const std::string &command: COMMANDS) {
-        _commandStatistics[command] = 0;
+constexpr int CLIENT_TIMEOUT_SECONDS = 600;
+constexpr size_t MAX_REQUEST_ID_LENGTH = 20;
+constexpr int EVENT_LOOP_TICK_MS = 1000;
+constexpr size_t MAX_WAITING_CLIENTS = 1024;
+constexpr int MAX_ADMISSION_WAIT_SECONDS = 10;
+const std::string RESPONSE_BUSY = "503 SERVICE UNAVAILABLE: Server is busy. Please try again later.";
+const std::string RESPONSE_TOO_LARGE = "413 PAYLOAD TOO LARGE: File exceeds the server's size limit.";
+const std::string RESPONSE_NO_UPLOAD = "404 NOT FOUND: Upload does not exist.";
+
+
+// Runs a cleanup when the scope is left, unless dismissed first
+class ScopeExit {
+public:
+    explicit ScopeExit(std::function<void()> cleanup) : _cleanup(std::move(cleanup)) {
+    }
+
+    ~ScopeExit() {
+        if (_cleanup) {
+            _cleanup();
+        }
+    }
+
+    ScopeExit(const ScopeExit &) = delete;
+    ScopeExit &operator=(const ScopeExit &) = delete;
+
+    void dismiss() {
+        _cleanup = nullptr;
+    }
+
+private:
+    std::function<void()> _cleanup;
+};
+
+
+constexpr off_t Server::DEFAULT_MAX_FILE_SIZE;
+
+
+Server::Server(const std::string &directory, const size_t minWorkerThreads, const size_t maxWorkerThreads,
+               const size_t maxSimultaneousClients, const IoEngineType ioEngine, const size_t fileCacheBytes,
+               const size_t listenerShards, const bool pinShards, const off_t maxFileSize) :
+    _directory(directory), _pinShards(pinShards), _maxFileSize(maxFileSize), _ioEngine(IoEngine::create(ioEngine)),
+    _metadataCache(new MetadataCache(directory, &Server::isPartialFilename)), _chunkStore(new ChunkStore(directory)),
+    _fileCache(new FileCache(fileCacheBytes)), _commandStatistics(COMMANDS, QUEUES) {
+    const size_t shardCount = std::max<size_t>(listenerShards, 1);
+    for (size_t i = 0; i < shardCount; ++i) {
+        _shards.emplace_back(new ListenerShard(std::max<size_t>(minWorkerThreads / shardCount, 1),
+                                               (maxWorkerThreads + shardCount - 1) / shardCount));
+    }
+    _maxSimultaneousClients = (maxSimultaneousClients + shardCount - 1) / shardCount;
+}
+
+
+void Server::start(const int port) {
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        if (!openListener(*shard, port)) {
+            for (const std::unique_ptr<ListenerShard> &opened: _shards) {
+                opened->serverSocket.closeS();
+            }
+            return;
+        }
+    }
+    if (!_metadataCache->start(std::thread::hardware_concurrency())) {
+        logWarning("Metadata cache unavailable, LIST and INFO are served from disk.");
+    }
+    if (!_chunkStore->open()) {
+        logWarning("Chunk store unavailable, PUTs are not deduplicated.");
+    }
+    if (_pinShards) {
+        assignCpus();
+    }
+    logInfo("Server listening on port " + std::to_string(port) + " (" + _ioEngine->name() + " file I/O" +
+            (_shards.size() > 1 ? ", " + std::to_string(_shards.size()) + " listener shards" : "") + ")");
+
+    for (size_t i = 1; i < _shards.size(); ++i) {
+        ListenerShard &shard = *_shards[i];
+        shard.thread = std::thread([this, &shard] { run(shard); });
+    }
+    run(*_shards[0]);
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
+
+
+void Server::shutdown() {
+    _stopFlag = true;
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        shard->eventLoop.wakeup();
+        shard->serverSocket.shutdownS();
+        shard->serverSocket.closeS();
+    }
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        shard->threadPool.shutdown();
+        closeAllSessions(*shard);
+    }
+    _metadataCache->stop();
+    logInfo("Server stopped.");
+    Logger::instance().flush();
+    displayCommandStatistics();
+}
+
+
+void Server::handleList(const Socket &clientSocket, const std::string &username) const {
+    std::string listing;
+    if (_metadataCache->list(username, listing) != CacheLookup::HIT && !scanDirectory(username, listing)) {
+        clientSocket.sendData("500 SERVER ERROR: Failed to open directory.");
+        return;
+    }
+
+    if (listing.empty()) {
+        clientSocket.sendData("204 NO CONTENT: The directory is empty.");
+    } else {
+        clientSocket.sendData(listing.c_str());
+    }
+}
+
+
+ssize_t Server::handleGet(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                         const TransferOptions &options, const off_t offset, off_t length,
+                         const uint32_t *prefixCrc) const {
+    const std::string filePath = _directory + username + "/" + filename;
+    // compressed frames are produced from a file descriptor, so only uncompressed GETs use the cache
+    std::shared_ptr<const FileCache::Entry> cached = options.compress ? nullptr : _fileCache->find(filePath);
+    int fileFd = -1;
+    struct stat fileStat{};
+    if (cached) {
+        fileStat = cached->fileStat;
+    } else {
+        fileFd = open(filePath.c_str(), O_RDONLY);
+        if (fileFd == -1) {
+            perror("open");
+            clientSocket.sendData("404 NOT FOUND: File does not exist.");
+            return 0;
+        }
+
+        if (fstat(fileFd, &fileStat) == -1) {
+            perror("fstat");
+            clientSocket.sendData("500 SERVER ERROR: Unable to retrieve file info.");
+            close(fileFd);
+            return 0;
+        }
+        if (!options.compress) {
+            cached = cacheFile(filePath, fileFd, fileStat);
+        }
+        if (cached) {
+            close(fileFd);
+            fileFd = -1;
+        }
+    }
+
+    if (offset > fileStat.st_size) {
+        clientSocket.sendData("416 RANGE NOT SATISFIABLE: Offset is beyond the end of the file.");
+        if (fileFd != -1) {
+            close(fileFd);
+        }
+        return 0;
+    }
+    // a resumed download names the CRC-32C of the bytes the client already has, which must still be the file's start
+    bool prefixMatches = true;
+    if (prefixCrc) {
+        uint32_t currentCrc = 0;
+        if (cached) {
+            currentCrc = crc32c(0, cached->data.data(), offset);
+        }
+        prefixMatches = (cached || crc32cFile(fileFd, 0, offset, currentCrc)) && currentCrc == *prefixCrc;
+    }
+    if (!prefixMatches) {
+        clientSocket.sendData("412 PRECONDITION FAILED: The file has changed since the partial download.");
+        if (fileFd != -1) {
+            close(fileFd);
+        }
+        return 0;
+    }
+    if (length < 0 || length > fileStat.st_size - offset) {
+        length = fileStat.st_size - offset;
+    }
+    if (options.inlineLimit != 0 && length <= static_cast<off_t>(options.inlineLimit)) {
+        return sendInlineFile(clientSocket, options, cached.get(), fileFd, fileStat, offset, length, filename,
+                              username);
+    }
+
+    if (options.streamGet) {
+        clientSocket.sendData((RESPONSE_OK + " " + std::to_string(length)).c_str());
+    } else {
+        clientSocket.sendData(RESPONSE_OK.c_str());
+    }
+
+    if (!options.pipelined) {
+        char ackBuffer[4] = {};
+        const ReceiveResult result = receiveMessage(clientSocket, ackBuffer, sizeof(ackBuffer), username.c_str());
+        if (result.status != ReceiveStatus::SUCCESS || std::string(ackBuffer) != RESPONSE_ACK) {
+            if (fileFd != -1) {
+                close(fileFd);
+            }
+            if (result.status != ReceiveStatus::SUCCESS) {
+                logWarning(result.message);
+                return -1;
+            }
+            if (std::string(ackBuffer) != RESPONSE_NAK) {
+                logWarning("Client did not acknowledge 200 OK.");
+            }
+            return 0;
+        }
+    }
+
+    if (cached) {
+        return sendCachedFile(clientSocket, options, *cached, offset, length, filename, username);
+    }
+
+    clientSocket.setCork(true);
+
+    uint32_t crc = 0;
+    if (options.streamGet) {
+        // sendfile() keeps the data out of user space, so the checksum is the stored one or read back afterwards
+        const bool sent = clientSocket.sendFile(fileFd, offset, length) == length &&
+                          (!options.checksum || (rangeChecksum(fileFd, fileStat, offset, length, crc) &&
+                                                 sendChecksumTrailer(clientSocket, crc)));
+        clientSocket.setCork(false);
+        close(fileFd);
+        if (!sent) {
+            logError("Failed to stream " + filename + " to client " + username + ".");
+            return -1; // the stream has no terminator, so the client can only notice a short transfer via close
+        }
+        return length;
+    }
+
+    const bool sent = sendFileFrames(clientSocket, options, fileFd, offset, length, filename,
+                                     options.checksum ? &crc : nullptr);
+    if (!sent) {
+        close(fileFd);
+        clientSocket.setCork(false);
+        logError("Failed to send " + filename + " to client " + username + ".");
+        return -1; // the client is mid-transfer and cannot tell a truncated file from a complete one
+    }
+    clientSocket.sendData("", 0);
+    if (options.checksum) {
+        // a whole file is vouched for by the checksum taken at upload, so damage on disk shows up at the client
+        uint32_t storedCrc;
+        if (offset == 0 && length == fileStat.st_size && loadChecksum(fileFd, fileStat, storedCrc)) {
+            if (storedCrc != crc) {
+                logError("Stored checksum of " + filename + " for " + username + " no longer matches its content.");
+            }
+            crc = storedCrc;
+        } else if (offset == 0 && length == fileStat.st_size) {
+            storeChecksum(fileFd, fileStat, crc);
+        }
+        sendChecksumTrailer(clientSocket, crc);
+    }
+    close(fileFd);
+    clientSocket.setCork(false);
+    return length;
+}
+
+
+ssize_t Server::handlePut(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                         const TransferOptions &options, const bool resume, const off_t clientFileSize) const {
+    const std::string filePath = _directory + username + "/" + filename;
+    const std::string partialPath = _directory + username + "/" + partialFilename(filename);
+
+    // data goes to a hidden file that is renamed over the target once complete, so readers never see half a file;
+    // resumable uploads use one that survives interruptions, others a fresh one per upload
+    std::string targetPath = partialPath;
+    int fileFd;
+    if (resume) {
+        // the bytes already there are read back to check them and for the resumed upload's checksum
+        fileFd = open(targetPath.c_str(), O_RDWR | O_CREAT, 0666);
+    } else {
+        do {
+            targetPath = _directory + username + "/" + uploadFilename(filename, _nextUpload++);
+            fileFd = open(targetPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        } while (fileFd == -1 && errno == EEXIST);
+    }
+    if (fileFd == -1) {
+        perror("open");
+        clientSocket.sendData("500 SERVER ERROR: Unable to create file.");
+        return 0;
+    }
+
+    off_t resumeOffset = 0;
+    uint32_t prefixCrc = 0;
+    if (resume) {
+        struct stat partialStat{};
+        resumeOffset = fstat(fileFd, &partialStat) == 0 ? partialStat.st_size : 0;
+        if (resumeOffset > clientFileSize && ftruncate(fileFd, 0) == 0) {
+            resumeOffset = 0; // leftover from a different, longer file
+        }
+    }
+    if (resumeOffset > 0) {
+        // the bytes already here may be from another version of the file, so the client checks their CRC-32C
+        // against its own and answers ACK to keep them or NAK to start over
+        std::string reply;
+        if (crc32cFile(fileFd, 0, resumeOffset, prefixCrc)) {
+            clientSocket.sendData((RESPONSE_OK + " " + std::to_string(resumeOffset) + " " +
+                                   formatChecksum(prefixCrc)).c_str());
+            char replyBuffer[4] = {};
+            const ReceiveResult result = receiveMessage(clientSocket, replyBuffer, sizeof(replyBuffer),
+                                                        username.c_str());
+            if (result.status != ReceiveStatus::SUCCESS) {
+                close(fileFd);
+                logWarning(result.message);
+                return -1;
+            }
+            reply = replyBuffer;
+        }
+        if (reply != RESPONSE_ACK) {
+            if (ftruncate(fileFd, 0) == -1) {
+                perror("ftruncate");
+                close(fileFd);
+                clientSocket.sendData("500 SERVER ERROR: Unable to create file.");
+                return 0;
+            }
+            logInfo("Discarded the partial upload of " + filename + " for " + username +
+                    ", it does not match the file sent now.");
+            resumeOffset = 0;
+        }
+    }
+    if (!reserveSpace(fileFd, resumeOffset, clientFileSize - resumeOffset)) {
+        close(fileFd);
+        if (!resume) {
+            unlink(targetPath.c_str());
+        }
+        clientSocket.sendData("507 INSUFFICIENT STORAGE: Unable to preallocate file.");
+        return 0;
+    }
+    if (resume) {
+        clientSocket.sendData((RESPONSE_OK + " " + std::to_string(resumeOffset)).c_str());
+    } else {
+        unlink(partialPath.c_str()); // a full upload supersedes any interrupted one
+        clientSocket.sendData(RESPONSE_OK.c_str());
+    }
+
+    uint32_t crc = 0;
+    const off_t received = receiveFileFrames(clientSocket, options, fileFd, resumeOffset,
+                                             std::numeric_limits<off_t>::max() - resumeOffset, filename,
+                                             options.checksum ? &crc : nullptr);
+    if (received == -1) {
+        close(fileFd);
+        if (!resume) {
+            unlink(targetPath.c_str());
+        }
+        logWarning(classifyReceive(-1, username.c_str()).message);
+        return -1;
+    }
+
+    if (options.checksum) {
+        uint32_t clientCrc;
+        if (!receiveUploadChecksum(clientSocket, username, clientCrc)) {
+            close(fileFd);
+            if (!resume) {
+                unlink(targetPath.c_str());
+            }
+            return -1;
+        }
+        if (clientCrc != crc) {
+            close(fileFd);
+            unlink(targetPath.c_str());
+            logWarning("Checksum mismatch in " + filename + " from client " + username + ", upload discarded.");
+            clientSocket.sendData("400 BAD REQUEST: Checksum mismatch, upload discarded.");
+            return 0;
+        }
+    }
+    if (resumeOffset + received < clientFileSize) {
+        // shorter than announced: give back the space reserved past the end
+        if (ftruncate(fileFd, resumeOffset + received) == -1) {
+            perror("ftruncate");
+        }
+    }
+    if (options.checksum) {
+        storeChecksum(fileFd, resumeOffset == 0 ? crc : crc32cCombine(prefixCrc, crc, received));
+    }
+    close(fileFd);
+
+    // the file may be a link into the chunk store, which the rename unlinks
+    _chunkStore->release(filePath);
+    if (rename(targetPath.c_str(), filePath.c_str()) == -1) {
+        perror("rename");
+        if (!resume) {
+            unlink(targetPath.c_str());
+        }
+        clientSocket.sendData("500 SERVER ERROR: Unable to store file.");
+        return 0;
+    }
+    _metadataCache->refresh(username, filename); // inotify lags behind, but the client may LIST right away
+    _fileCache->invalidate(filePath);
+    clientSocket.sendData(RESPONSE_OK.c_str());
+    return received;
+}
+
+
+// The first step of a deduplicated PUT: the client sends the hashes of the file's chunks and learns which of them
+// the server still needs. The upload then waits for those chunks (handlePutChunks, over any number of sessions) and
+// for its commit (handlePutCommit). An interrupted upload keeps the chunks that arrived, and announcing the same
+// file again resumes it.
+ssize_t Server::handlePutDedup(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                               const TransferOptions &options, const off_t fileSize) {
+    const off_t chunkCount = (fileSize + DEDUP_CHUNK_SIZE - 1) / DEDUP_CHUNK_SIZE;
+    if (!options.dedup || chunkCount == 0) {
+        clientSocket.sendData("400 BAD REQUEST: Invalid deduplicated PUT.");
+        return 0;
+    }
+    clientSocket.sendData(RESPONSE_OK.c_str());
+
+    // the client answers with the SHA-256 of every chunk, in file order and DEDUP_HASH_BATCH to a frame
+    std::vector<std::string> chunkHashes;
+    chunkHashes.reserve(chunkCount);
+    while (static_cast<off_t>(chunkHashes.size()) < chunkCount) {
+        const char *hashes;
+        const size_t batchSize = std::min<off_t>(DEDUP_HASH_BATCH, chunkCount - chunkHashes.size());
+        const ssize_t bytesReceived = clientSocket.receiveView(hashes, batchSize * SHA256_DIGEST_SIZE);
+        if (bytesReceived != static_cast<ssize_t>(batchSize * SHA256_DIGEST_SIZE)) {
+            logWarning(bytesReceived >= 0 ? "Chunk list does not match the announced size."
+                                          : classifyReceive(-1, username.c_str()).message);
+            return -1;
+        }
+        for (size_t i = 0; i < batchSize; ++i) {
+            chunkHashes.emplace_back(hashes + i * SHA256_DIGEST_SIZE, SHA256_DIGEST_SIZE);
+        }
+    }
+
+    const std::string filePath = _directory + username + "/" + filename;
+    const std::string objectId = ChunkStore::objectId(chunkHashes, fileSize);
+    std::string error;
+    bool resumed = false;
+    {
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        resumed = findDedupUpload(filePath, objectId, error);
+    }
+    if (!error.empty()) {
+        clientSocket.sendData(error.c_str());
+        return 0;
+    }
+
+    DedupUpload upload;
+    if (!resumed) {
+        upload.objectId = objectId;
+        upload.fileSize = fileSize;
+        upload.chunkHashes = std::move(chunkHashes);
+        upload.missing.assign(chunkCount, false);
+        upload.received.assign(chunkCount, false);
+        upload.stored.assign(chunkCount, false);
+        upload.chunkCrcs.assign(chunkCount, 0);
+        upload.receivedBytes = 0;
+        if (!prepareDedupUpload(upload)) {
+            clientSocket.sendData("500 SERVER ERROR: Unable to create file.");
+            return 0;
+        }
+    }
+
+    std::string nonce(CHUNK_PROOF_NONCE_SIZE, '\0');
+    std::random_device random;
+    for (char &byte : nonce) {
+        byte = static_cast<char>(random());
+    }
+    std::string bitmap((chunkCount + 7) / 8, '\0'), proofBitmap((chunkCount + 7) / 8, '\0');
+    uint64_t uploadId;
+    {
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        // another session may have announced, committed or replaced the upload since the first look
+        const bool found = findDedupUpload(filePath, objectId, error);
+        if (!resumed && (found || !error.empty()) && !upload.temporaryPath.empty()) {
+            unlink(upload.temporaryPath.c_str());
+        }
+        if (!error.empty() || (resumed && !found)) {
+            clientSocket.sendData(error.empty() ? "409 CONFLICT: Upload ended meanwhile, please try again."
+                                                : error.c_str());
+            return 0;
+        }
+        if (!found) {
+            upload.id = _nextDedupUploadId++;
+            _dedupUploads[filePath] = std::move(upload);
+        }
+        DedupUpload &current = _dedupUploads[filePath];
+        for (off_t i = 0; i < chunkCount; ++i) {
+            if (current.missing[i] && !current.received[i]) {
+                bitmap[i / 8] = static_cast<char>(bitmap[i / 8] | 1 << (i % 8));
+            }
+            if (current.stored[i]) {
+                proofBitmap[i / 8] = static_cast<char>(proofBitmap[i / 8] | 1 << (i % 8));
+            }
+        }
+        current.nonce = nonce;
+        current.lastActivity = std::chrono::steady_clock::now();
+        uploadId = current.id;
+    }
+
+    clientSocket.sendData((RESPONSE_OK + " " + std::to_string(uploadId)).c_str());
+    clientSocket.sendData(bitmap.data(), bitmap.size());
+    clientSocket.sendData(proofBitmap.data(), proofBitmap.size());
+    clientSocket.sendData(nonce.data(), nonce.size());
+    return 0;
+}
+
+
+// Receives the chunks [firstChunk, firstChunk + chunkCount) of a deduplicated upload that the server asked for.
+// Ranges in flight at the same time never overlap, so each chunk has at most one writer.
+ssize_t Server::handlePutChunks(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                                const TransferOptions &options, const uint64_t uploadId, const off_t firstChunk,
+                                const off_t chunkCount) {
+    const std::string filePath = _directory + username + "/" + filename;
+    std::vector<std::pair<off_t, std::string>> pending; // chunk -> hash
+    off_t fileSize;
+    int fileFd = -1;
+    {
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        const auto it = _dedupUploads.find(filePath);
+        if (it == _dedupUploads.end() || it->second.id != uploadId) {
+            clientSocket.sendData(RESPONSE_NO_UPLOAD.c_str());
+            return 0;
+        }
+        DedupUpload &upload = it->second;
+        if (chunkCount <= 0 || firstChunk + chunkCount > static_cast<off_t>(upload.chunkHashes.size())) {
+            clientSocket.sendData("416 RANGE NOT SATISFIABLE: Chunks do not fit the upload.");
+            return 0;
+        }
+        // only the last range starting before this one ends can reach into it
+        auto previous = upload.activeRanges.lower_bound(firstChunk + chunkCount);
+        if (previous != upload.activeRanges.begin() && (--previous)->first + previous->second > firstChunk) {
+            clientSocket.sendData("409 CONFLICT: Chunks are already being received.");
+            return 0;
+        }
+
+        for (off_t i = firstChunk; i < firstChunk + chunkCount; ++i) {
+            if (upload.missing[i] && !upload.received[i]) {
+                pending.push_back(std::make_pair(i, upload.chunkHashes[i]));
+            }
+        }
+        if (!pending.empty()) {
+            fileFd = open(upload.temporaryPath.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fileFd == -1) {
+                perror("open");
+                clientSocket.sendData("500 SERVER ERROR: Unable to open file.");
+                return 0;
+            }
+        }
+        upload.activeRanges[firstChunk] = chunkCount;
+        upload.lastActivity = std::chrono::steady_clock::now();
+        fileSize = upload.fileSize;
+    }
+    clientSocket.sendData(RESPONSE_OK.c_str());
+
+    std::vector<std::pair<off_t, uint32_t>> arrived;
+    const off_t received = receiveMissingChunks(clientSocket, options, fileFd, fileSize, pending, arrived);
+    const int receiveError = errno;
+    if (fileFd != -1) {
+        close(fileFd);
+    }
+
+    // the chunks that arrived intact stay, even when the session broke off, so the client can resume. The range
+    // was in flight, so nothing dropped or replaced the upload meanwhile.
+    {
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        DedupUpload &upload = _dedupUploads.at(filePath);
+        for (const std::pair<off_t, uint32_t> &chunk: arrived) {
+            upload.received[chunk.first] = true;
+            upload.chunkCrcs[chunk.first] = chunk.second;
+            upload.receivedBytes += std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - chunk.first * DEDUP_CHUNK_SIZE);
+        }
+        upload.activeRanges.erase(firstChunk);
+        upload.lastActivity = std::chrono::steady_clock::now();
+    }
+
+    if (received == -1) {
+        errno = receiveError;
+        logWarning(errno == EMSGSIZE ? "Chunk data overflow." : classifyReceive(-1, username.c_str()).message);
+        return -1;
+    }
+    if (arrived.size() != pending.size()) {
+        clientSocket.sendData("400 BAD REQUEST: Chunks do not match their hashes.");
+        return 0;
+    }
+    clientSocket.sendData(RESPONSE_OK.c_str());
+    return received;
+}
+
+
+// The last step of a deduplicated PUT: once every requested chunk has arrived, the client proves that it holds the
+// ones taken from the store, and the file is linked into the user's folder.
+ssize_t Server::handlePutCommit(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                                const TransferOptions &options, const uint64_t uploadId) {
+    const std::string filePath = _directory + username + "/" + filename;
+    DedupUpload upload;
+    {
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        const auto it = _dedupUploads.find(filePath);
+        if (it == _dedupUploads.end() || it->second.id != uploadId) {
+            clientSocket.sendData(RESPONSE_NO_UPLOAD.c_str());
+            return 0;
+        }
+        if (!it->second.activeRanges.empty()) {
+            clientSocket.sendData("409 CONFLICT: Chunks are still being received.");
+            return 0;
+        }
+        size_t outstanding = 0;
+        for (size_t i = 0; i < it->second.missing.size(); ++i) {
+            outstanding += it->second.missing[i] && !it->second.received[i];
+        }
+        if (outstanding != 0) {
+            clientSocket.sendData(("409 CONFLICT: " + std::to_string(outstanding) + " chunks are still missing.").c_str());
+            return 0;
+        }
+        upload = std::move(it->second);
+        _dedupUploads.erase(it);
+    }
+    clientSocket.sendData(RESPONSE_OK.c_str());
+
+    // a session lost before the proof leaves the upload to be committed again
+    const char *proofData;
+    uint32_t clientCrc = 0;
+    const bool proofReceived = clientSocket.receiveView(proofData, SHA256_DIGEST_SIZE) == SHA256_DIGEST_SIZE;
+    const std::string proof = proofReceived ? std::string(proofData, SHA256_DIGEST_SIZE) : "";
+    if (!proofReceived || (options.checksum && !receiveUploadChecksum(clientSocket, username, clientCrc))) {
+        if (!proofReceived) {
+            logWarning("Client " + username + " sent no chunk proof for " + filename + ".");
+        }
+        std::lock_guard<std::mutex> lock(_dedupUploadsMutex);
+        if (_dedupUploads.count(filePath) == 0) {
+            upload.lastActivity = std::chrono::steady_clock::now();
+            _dedupUploads[filePath] = std::move(upload);
+        } else if (!upload.temporaryPath.empty()) {
+            unlink(upload.temporaryPath.c_str());
+        }
+        return -1;
+    }
+
+    // a file the store held at the handshake is read from the store, anything else from the assembled copy
+    const off_t chunkCount = upload.chunkHashes.size();
+    int fileFd = -1;
+    if (upload.temporaryPath.empty()) {
+        fileFd = _chunkStore->openObject(upload.objectId);
+        if (fileFd == -1) {
+            clientSocket.sendData("409 CONFLICT: Stored chunks are gone, upload the file again.");
+            return 0;
+        }
+    } else {
+        fileFd = open(upload.temporaryPath.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    const auto discard = [&]() {
+        if (fileFd != -1) {
+            close(fileFd);
+        }
+        if (!upload.temporaryPath.empty()) {
+            unlink(upload.temporaryPath.c_str());
+        }
+    };
+    bool intact = fileFd != -1;
+    for (size_t i = 0; intact && i < upload.repeatedChunks.size(); ++i) {
+        intact = ChunkStore::copyRange(fileFd, upload.repeatedChunks[i].second * DEDUP_CHUNK_SIZE, fileFd,
+                                       upload.repeatedChunks[i].first * DEDUP_CHUNK_SIZE, DEDUP_CHUNK_SIZE);
+    }
+    if (!intact) {
+        discard();
+        clientSocket.sendData("500 SERVER ERROR: Unable to assemble file.");
+        return 0;
+    }
+    if (chunkProof(fileFd, upload.fileSize, upload.stored, upload.nonce, &upload.chunkCrcs) != proof) {
+        discard();
+        logWarning("Client " + username + " failed to prove it holds the chunks of " + filename + ".");
+        clientSocket.sendData("403 FORBIDDEN: Chunk proof does not match.");
+        return 0;
+    }
+
+    // the object may be shared with other users, so its checksum comes from the server's own bytes: the chunks
+    // received before and the ones read back for the proof. The client's CRC only has to agree with it.
+    for (const std::pair<off_t, off_t> &repeated: upload.repeatedChunks) {
+        upload.chunkCrcs[repeated.first] = upload.chunkCrcs[repeated.second];
+    }
+    const Crc32cAppender chunkAppender(DEDUP_CHUNK_SIZE);
+    uint32_t crc = 0;
+    for (off_t i = 0; i < chunkCount; ++i) {
+        const off_t length = std::min<off_t>(DEDUP_CHUNK_SIZE, upload.fileSize - i * DEDUP_CHUNK_SIZE);
+        crc = length == DEDUP_CHUNK_SIZE ? chunkAppender.append(crc, upload.chunkCrcs[i])
+                                         : crc32cCombine(crc, upload.chunkCrcs[i], length);
+    }
+    if (options.checksum && clientCrc != crc) {
+        discard();
+        logWarning("Checksum mismatch in " + filename + " from client " + username + ", upload discarded.");
+        clientSocket.sendData("400 BAD REQUEST: Checksum mismatch, upload discarded.");
+        return 0;
+    }
+
+    // the object may have lost its last link since it was opened, and is then stored again from the open copy
+    bool stored = false;
+    if (upload.temporaryPath.empty()) {
+        stored = _chunkStore->linkObject(upload.objectId, filePath);
+        const int objectFd = fileFd;
+        fileFd = stored ? -1 : _chunkStore->createTemporary(upload.temporaryPath);
+        if (fileFd != -1 && !ChunkStore::copyRange(objectFd, 0, fileFd, 0, upload.fileSize)) {
+            close(fileFd);
+            unlink(upload.temporaryPath.c_str());
+            fileFd = -1;
+        }
+        close(objectFd);
+    }
+    if (fileFd != -1) {
+        close(fileFd);
+        stored = _chunkStore->addObject(upload.temporaryPath, upload.objectId, upload.chunkHashes, filePath);
+    }
+    if (!stored) {
+        clientSocket.sendData("500 SERVER ERROR: Unable to store file.");
+        return 0;
+    }
+    storeChecksum(filePath, crc);
+    _chunkStore->recordUpload(upload.fileSize, upload.receivedBytes);
+    _metadataCache->refresh(username, filename);
+    _fileCache->invalidate(filePath);
+    logInfo("Stored " + filename + " for " + username + ", " +
+            std::to_string(std::count(upload.missing.begin(), upload.missing.end(), true)) + " of " +
+            std::to_string(chunkCount) + " chunks received.");
+    clientSocket.sendData(RESPONSE_OK.c_str());
+    return 0;
+}
+
+
+ssize_t Server::handlePutDelta(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                               const TransferOptions &options, const off_t fileSize) const {
+    const std::string filePath = _directory + username + "/" + filename;
+    const std::string deltaPath = _directory + username + "/" + deltaFilename(filename);
+    if (!options.delta) {
+        clientSocket.sendData("400 BAD REQUEST: Delta PUT was not negotiated.");
+        return 0;
+    }
+
+    // the current copy is the basis the client's changes are expressed against
+    const int basisFd = open(filePath.c_str(), O_RDONLY);
+    struct stat basisStat{};
+    if (basisFd == -1 || fstat(basisFd, &basisStat) == -1 || basisStat.st_size == 0) {
+        if (basisFd != -1) {
+            close(basisFd);
+        }
+        clientSocket.sendData("404 NOT FOUND: No previous version to update.");
+        return 0;
+    }
+    const int fileFd = open(deltaPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fileFd == -1) {
+        perror("open");
+        close(basisFd);
+        clientSocket.sendData("500 SERVER ERROR: Unable to create file.");
+        return 0;
+    }
+
+    const size_t blockSize = deltaBlockSize(basisStat.st_size);
+    clientSocket.sendData((RESPONSE_OK + " " + std::to_string(blockSize)).c_str());
+    off_t literalBytes = 0;
+    std::vector<uint32_t> blockChecksums;
+    uint32_t crc = 0;
+    const off_t written = sendSignatures(clientSocket, basisFd, basisStat.st_size, blockSize,
+                                         options.checksum ? &blockChecksums : nullptr)
+                              ? receiveDelta(clientSocket, options, basisFd, basisStat.st_size, blockSize, fileFd,
+                                             fileSize, literalBytes, blockChecksums, options.checksum ? &crc : nullptr)
+                              : -1;
+    close(basisFd);
+    close(fileFd);
+
+    if (written == -1) {
+        unlink(deltaPath.c_str());
+        logWarning(errno == EPROTO ? "Invalid delta from client " + username + "."
+                                   : errno == EMSGSIZE ? "Delta overflow."
+                                                       : classifyReceive(-1, username.c_str()).message);
+        return -1;
+    }
+    uint32_t clientCrc = crc;
+    if (options.checksum && !receiveUploadChecksum(clientSocket, username, clientCrc)) {
+        unlink(deltaPath.c_str());
+        return -1;
+    }
+    if (written != fileSize) {
+        unlink(deltaPath.c_str());
+        clientSocket.sendData("400 BAD REQUEST: Delta does not rebuild the announced size.");
+        return 0;
+    }
+    if (clientCrc != crc) {
+        unlink(deltaPath.c_str());
+        logWarning("Checksum mismatch in " + filename + " from client " + username + ", update discarded.");
+        clientSocket.sendData("400 BAD REQUEST: Checksum mismatch, update discarded.");
+        return 0;
+    }
+    if (options.checksum) {
+        storeChecksum(deltaPath, crc);
+    }
+
+    _chunkStore->release(filePath);
+    if (rename(deltaPath.c_str(), filePath.c_str()) == -1) {
+        perror("rename");
+        unlink(deltaPath.c_str());
+        clientSocket.sendData("500 SERVER ERROR: Unable to store file.");
+        return 0;
+    }
+    _metadataCache->refresh(username, filename);
+    _fileCache->invalidate(filePath);
+    logInfo("Updated " + filename + " for " + username + ", " + std::to_string(literalBytes) + " of " +
+            std::to_string(fileSize) + " bytes received.");
+    clientSocket.sendData(RESPONSE_OK.c_str());
+    return literalBytes;
+}
+
+
+ssize_t Server::handlePutStripe(const Socket &clientSocket, const std::string &username, const std::string &filename,
+                               const TransferOptions &options, const off_t offset, const off_t length,
+                               const off_t totalSize) {
+    const std::string filePath = _directory + username + "/" + filename;
+    const std::string stripedPath = _directory + username + "/" + stripedFilename(filename);
+
+    if (length <= 0 || offset + length > totalSize) {
+        clientSocket.sendData("416 RANGE NOT SATISFIABLE: Stripe does not fit the announced size.");
+        return 0;
+    }
+
+    uint64_t uploadId;
+    int fileFd;
+    const std::string reserveError = reserveStripe(stripedPath, offset, length, totalSize, uploadId, fileFd);
+    if (!reserveError.empty()) {
+        clientSocket.sendData(reserveError.c_str());
+        return 0;
+    }
+    // a stripe that ends without being credited gives its range back, or the upload could never expire
+    ScopeExit reservation([&]() { releaseStripe(stripedPath, uploadId, offset); });
+    clientSocket.sendData(RESPONSE_OK.c_str());
+
+    uint32_t crc = 0;
+    const off_t received = receiveFileFrames(clientSocket, options, fileFd, offset, length, filename,
+                                             options.checksum ? &crc : nullptr);
+    close(fileFd);
+    if (received == -1) {
+        logWarning(errno == EMSGSIZE ? "Stripe overflow." : classifyReceive(-1, username.c_str()).message);
+        abortStripedUpload(stripedPath, uploadId);
+        return -1;
+    }
+    uint32_t clientCrc = crc;
+    if (options.checksum && !receiveUploadChecksum(clientSocket, username, clientCrc)) {
+        abortStripedUpload(stripedPath, uploadId);
+        return -1;
+    }
+
+    if (received != length) {
+        clientSocket.sendData("400 BAD REQUEST: Stripe is shorter than announced.");
+        abortStripedUpload(stripedPath, uploadId);
+        return 0;
+    }
+    if (clientCrc != crc) {
+        logWarning("Checksum mismatch in " + filename + " from client " + username + ", upload discarded.");
+        clientSocket.sendData("400 BAD REQUEST: Checksum mismatch, upload discarded.");
+        abortStripedUpload(stripedPath, uploadId);
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(_stripedUploadsMutex);
+    reservation.dismiss();
+    const auto it = _stripedUploads.find(stripedPath);
+    if (it == _stripedUploads.end() || it->second.id != uploadId) {
+        // another stripe aborted the upload, and these bytes went to the file it unlinked
+        clientSocket.sendData("500 SERVER ERROR: Upload was aborted.");
+        return 0;
+    }
+
+    // reserved ranges never overlap, so once the bytes add up every byte of the file has been written
+    --it->second.activeStripes;
+    it->second.lastActivity = std::chrono::steady_clock::now();
+    it->second.receivedOffsets.insert(offset);
+    it->second.receivedBytes += length;
+    if (options.checksum) {
+        it->second.stripeChecksums[offset] = std::make_pair(length, crc);
+    }
+    if (it->second.receivedBytes == it->second.totalSize) {
+        // the whole file's checksum follows from the stripes' in offset order, if every session sent one
+        const StripedUpload &upload = it->second;
+        if (upload.stripeChecksums.size() == upload.receivedOffsets.size()) {
+            uint32_t fileCrc = 0;
+            for (const auto &stripe: upload.stripeChecksums) {
+                fileCrc = crc32cCombine(fileCrc, stripe.second.second, stripe.second.first);
+            }
+            storeChecksum(stripedPath, fileCrc);
+        }
+        _stripedUploads.erase(it);
+        _chunkStore->release(filePath);
+        if (rename(stripedPath.c_str(), filePath.c_str()) == -1) {
+            perror("rename");
+            unlink(stripedPath.c_str());
+            clientSocket.sendData("500 SERVER ERROR: Unable to store file.");
+            return 0;
+        }
+        _metadataCache->refresh(username, filename);
+        _fileCache->invalidate(filePath);
+    }
+    clientSocket.sendData(RESPONSE_OK.c_str());
+    return received;
+}
+
+
+void Server::handleDelete(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
+    const std::string filePath = _directory + username + "/" + filename;
+    unlink((_directory + username + "/" + partialFilename(filename)).c_str());
+
+    if (access(filePath.c_str(), F_OK) == 0) {
+        _chunkStore->release(filePath);
+        if (unlink(filePath.c_str()) == 0) {
+            _metadataCache->remove(username, filename);
+            _fileCache->invalidate(filePath);
+            clientSocket.sendData(RESPONSE_OK.c_str());
+        } else {
+            perror("unlink");
+            clientSocket.sendData("500 SERVER ERROR: Unable to delete file.");
+        }
+    } else {
+        perror("access");
+        clientSocket.sendData("404 NOT FOUND: File does not exist.");
+    }
+}
+
+
+void Server::handleInfo(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
+    std::string info;
+    const CacheLookup lookup = _metadataCache->info(username, filename, info);
+    if (lookup == CacheLookup::HIT) {
+        clientSocket.sendData(info.c_str());
+        return;
+    }
+
+    if (lookup == CacheLookup::MISSING) {
+        clientSocket.sendData("404 NOT FOUND: File does not exist.");
+        return;
+    }
+
+    const std::string filePath = _directory + username + "/" + filename;
+    struct stat fileStat{};
+
+    if (access(filePath.c_str(), F_OK) == 0) {
+        if (stat(filePath.c_str(), &fileStat) == 0) {
+            clientSocket.sendData(formatFileInfo(filePath, fileStat).c_str());
+        } else {
+            perror("stat");
+            clientSocket.sendData("500 SERVER ERROR: Unable to retrieve file info.");
+        }
+    } else {
+        perror("access");
+        clientSocket.sendData("404 NOT FOUND: File does not exist.");
+    }
+}
+
+
+void Server::handleSize(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
+    off_t fileSize = 0;
+    const CacheLookup lookup = _metadataCache->size(username, filename, fileSize);
+
+    struct stat fileStat{};
+    if (lookup == CacheLookup::UNAVAILABLE && stat((_directory + username + "/" + filename).c_str(), &fileStat) == 0) {
+        fileSize = fileStat.st_size;
+    } else if (lookup != CacheLookup::HIT) {
+        clientSocket.sendData("404 NOT FOUND: File does not exist.");
+        return;
+    }
+    clientSocket.sendData((RESPONSE_OK + " " + std::to_string(fileSize)).c_str());
+}
+
+
+Server::~Server() {
+    if (!_stopFlag) {
+        shutdown();
+    }
+}
+
+
+bool Server::openListener(ListenerShard &shard, const int port) const {
+    Socket &serverSocket = shard.serverSocket;
+    if (!serverSocket.createS()) {
+        return false;
+    }
+    if (!serverSocket.setReuseAddress(true) || (_shards.size() > 1 && !serverSocket.setReusePort(true)) ||
+        !serverSocket.bindS(port) || !serverSocket.listenS(SOMAXCONN) || !serverSocket.setNonBlocking(true) ||
+        !shard.eventLoop.add(serverSocket.getS(), false)) {
+        serverSocket.closeS();
+        return false;
+    }
+    return true;
+}
+
+
+// Deals the CPUs the process may use out to the shards round-robin; with more shards than CPUs, shards share one.
+void Server::assignCpus() {
+    const std::vector<int> cpus = allowedCpus();
+    if (cpus.empty()) {
+        logWarning("CPU affinity unavailable, listener shards are not pinned.");
+        return;
+    }
+    for (size_t i = 0; i < std::max(cpus.size(), _shards.size()); ++i) {
+        ListenerShard &shard = *_shards[i % _shards.size()];
+        const int cpu = cpus[i % cpus.size()];
+        if (std::find(shard.cpus.begin(), shard.cpus.end(), cpu) == shard.cpus.end()) {
+            shard.cpus.push_back(cpu);
+        }
+    }
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        shard->threadPool.setCpuAffinity(shard->cpus);
+    }
+}
+
+
+void Server::run(ListenerShard &shard) {
+    if (!shard.cpus.empty()) {
+        pinThread(pthread_self(), shard.cpus);
+    }
+
+    std::vector<int> readyFds;
+    std::chrono::steady_clock::time_point lastIdleCheck = std::chrono::steady_clock::now();
+
+    while (!_stopFlag) {
+        if (shard.eventLoop.wait(readyFds, EVENT_LOOP_TICK_MS) == -1) {
+            perror("Event loop wait failed");
+            break;
+        }
+
+        for (const int fd: readyFds) {
+            if (_stopFlag) {
+                break;
+            }
+            if (fd == shard.serverSocket.getS()) {
+                while (acceptClient(shard)) {
+                }
+            } else {
+                dispatchSession(shard, fd);
+            }
+        }
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastIdleCheck >= std::chrono::milliseconds(EVENT_LOOP_TICK_MS)) {
+            closeIdleSessions(shard);
+            expireWaitingClients(shard);
+            if (shard.acceptPaused) {
+                shard.acceptPaused = !shard.eventLoop.add(shard.serverSocket.getS(), false);
+            }
+            lastIdleCheck = now;
+        }
+    }
+}
+
+
+bool Server::acceptClient(ListenerShard &shard) {
+    sockaddr_in clientAddr{};
+    socklen_t clientAddrLen = sizeof(clientAddr);
+
+    const int clientFd = shard.serverSocket.acceptS(&clientAddr, &clientAddrLen);
+    if (clientFd == -1) {
+        // the pending connection keeps the level-triggered listener ready, so it would wake the loop right away
+        if ((errno == EMFILE || errno == ENFILE) && !shard.acceptPaused) {
+            shard.eventLoop.remove(shard.serverSocket.getS());
+            shard.acceptPaused = true;
+            if (!shard.descriptorsExhausted) {
+                logError("Out of file descriptors, accepting no clients until some are closed.");
+                shard.descriptorsExhausted = true;
+            }
+        }
+        return false;
+    }
+    ++shard.acceptedClients;
+    shard.descriptorsExhausted = false;
+
+    Socket clientSocket(clientFd);
+    clientSocket.setNonBlocking(false); // BSD sockets inherit O_NONBLOCK from the listener
+    clientSocket.setNoDelay(true);
+    clientSocket.setTimeoutSeconds(CLIENT_TIMEOUT_SECONDS);
+
+    std::vector<std::shared_ptr<Session>> admitted;
+    bool rejected = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        if (shard.sessions.size() < _maxSimultaneousClients && shard.waitingClients.empty()) {
+            _commandStatistics.recordWait("ADMIT", std::chrono::steady_clock::duration::zero());
+            admitClient(shard, clientSocket, admitted);
+        } else if (shard.waitingClients.size() < MAX_WAITING_CLIENTS) {
+            // sessions usually finish within milliseconds, so a burst over the limit waits instead of failing
+            shard.waitingClients.push_back(WaitingClient{clientSocket, std::chrono::steady_clock::now()});
+        } else {
+            rejected = true;
+        }
+    }
+
+    if (rejected) {
+        clientSocket.sendData(RESPONSE_BUSY.c_str());
+        clientSocket.closeS();
+    }
+    greetClients(shard, admitted);
+    return true;
+}
+
+
+// Called with the shard's sessionsMutex held. The session takes its slot now; greetClients() answers the client
+// once the lock is released, since a client that does not read could block the send.
+void Server::admitClient(ListenerShard &shard, const Socket &clientSocket,
+                         std::vector<std::shared_ptr<Session>> &admitted) {
+    const std::shared_ptr<Session> session = std::make_shared<Session>(clientSocket);
+    shard.sessions[clientSocket.getS()] = session;
+    admitted.push_back(session);
+}
+
+
+// called with the shard's sessionsMutex held, whenever a session has been removed
+void Server::admitWaitingClients(ListenerShard &shard, std::vector<std::shared_ptr<Session>> &admitted) {
+    while (!_stopFlag && !shard.waitingClients.empty() && shard.sessions.size() < _maxSimultaneousClients) {
+        WaitingClient client = shard.waitingClients.front();
+        shard.waitingClients.pop_front();
+        _commandStatistics.recordWait("ADMIT", std::chrono::steady_clock::now() - client.acceptedAt);
+        admitClient(shard, client.socket, admitted);
+    }
+}
+
+
+// sends "200 OK" to newly admitted clients and starts watching their sockets; called without the lock
+void Server::greetClients(ListenerShard &shard, const std::vector<std::shared_ptr<Session>> &admitted) {
+    for (const std::shared_ptr<Session> &session: admitted) {
+        if (_stopFlag) {
+            return; // closeAllSessions() closes them
+        }
+        session->socket.sendData(RESPONSE_OK.c_str());
+        logInfo("Client connected.");
+        if (!shard.eventLoop.add(session->socket.getS(), true)) {
+            closeSession(shard, session);
+        }
+    }
+}
+
+
+void Server::expireWaitingClients(ListenerShard &shard) {
+    const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() - std::chrono::seconds(MAX_ADMISSION_WAIT_SECONDS);
+
+    std::vector<WaitingClient> expired;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        while (!shard.waitingClients.empty() && shard.waitingClients.front().acceptedAt <= deadline) {
+            expired.push_back(shard.waitingClients.front());
+            shard.waitingClients.pop_front();
+        }
+    }
+
+    for (WaitingClient &client: expired) {
+        client.socket.sendData(RESPONSE_BUSY.c_str());
+        client.socket.closeS();
+        logWarning("Client waited too long for admission.");
+    }
+}
+
+
+void Server::dispatchSession(ListenerShard &shard, const int clientFd) {
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        const auto it = shard.sessions.find(clientFd);
+        if (it == shard.sessions.end()) {
+            return;
+        }
+        session = it->second;
+    }
+
+    // the request is gathered here, so a client trickling it in holds no worker; a worker gets the session once the
+    // frame is complete, or to report the closed connection
+    if (session->socket.receiveAvailable() && !session->socket.hasBufferedFrame()) {
+        rearmSession(shard, session, false);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        session->busy = true;
+    }
+    submitSession(shard, session);
+}
+
+
+void Server::submitSession(ListenerShard &shard, const std::shared_ptr<Session> &session) {
+    const std::chrono::steady_clock::time_point queuedAt = std::chrono::steady_clock::now();
+    ListenerShard *owner = &shard;
+    shard.threadPool.submit([this, owner, session, queuedAt] {
+        _commandStatistics.recordWait("WORKER", std::chrono::steady_clock::now() - queuedAt);
+        serveSession(*owner, session);
+    });
+}
+
+
+void Server::serveSession(ListenerShard &shard, const std::shared_ptr<Session> &session) {
+    bool keepOpen = false;
+    switch (session->state) {
+        case SessionState::AWAITING_VERSION:
+            keepOpen = defineVersionAndHandleClient(*session);
+            break;
+        case SessionState::AWAITING_USERNAME:
+            keepOpen = handleClient2dot0(*session);
+            break;
+        case SessionState::PROCESSING_COMMANDS:
+            keepOpen = processCommands(*session);
+            break;
+    }
+
+    if (!keepOpen || _stopFlag) {
+        closeSession(shard, session);
+        return;
+    }
+
+    if (session->socket.hasBufferedFrame()) {
+        // the next request already sits in the receive buffer, where the event loop cannot see it
+        submitSession(shard, session);
+        return;
+    }
+    rearmSession(shard, session, true);
+}
+
+
+// Hands the session back to the event loop until more of its next request arrives. Only a served request counts as
+// activity, so a client has CLIENT_TIMEOUT_SECONDS for each request however slowly its bytes come in.
+void Server::rearmSession(ListenerShard &shard, const std::shared_ptr<Session> &session, const bool served) {
+    std::vector<std::shared_ptr<Session>> admitted;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        session->busy = false;
+        if (served) {
+            session->lastActivity = std::chrono::steady_clock::now();
+        }
+        if (!shard.eventLoop.rearm(session->socket.getS())) {
+            shard.sessions.erase(session->socket.getS());
+            cleanupClient(session->socket, session->username.c_str());
+            admitWaitingClients(shard, admitted);
+        }
+    }
+    greetClients(shard, admitted);
+}
+
+
+void Server::closeSession(ListenerShard &shard, const std::shared_ptr<Session> &session) {
+    std::vector<std::shared_ptr<Session>> admitted;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        shard.eventLoop.remove(session->socket.getS());
+        shard.sessions.erase(session->socket.getS());
+        cleanupClient(session->socket,
+                      session->state == SessionState::PROCESSING_COMMANDS ? session->username.c_str() : nullptr);
+        admitWaitingClients(shard, admitted);
+    }
+    greetClients(shard, admitted);
+}
+
+
+void Server::closeIdleSessions(ListenerShard &shard) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    std::vector<std::shared_ptr<Session>> admitted;
+    {
+        std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+        for (auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+            Session &session = *it->second;
+            if (session.busy || now - session.lastActivity < std::chrono::seconds(CLIENT_TIMEOUT_SECONDS)) {
+                ++it;
+                continue;
+            }
+
+            const bool authenticated = session.state == SessionState::PROCESSING_COMMANDS;
+            logWarning("Receive timeout from client " +
+                       (authenticated ? session.username : std::string("not authenticated yet")) + ".");
+            shard.eventLoop.remove(it->first);
+            cleanupClient(session.socket, authenticated ? session.username.c_str() : nullptr);
+            it = shard.sessions.erase(it);
+        }
+        admitWaitingClients(shard, admitted);
+    }
+    greetClients(shard, admitted);
+}
+
+
+void Server::closeAllSessions(ListenerShard &shard) {
+    std::lock_guard<std::mutex> lock(shard.sessionsMutex);
+    for (const std::pair<const int, std::shared_ptr<Session>> &entry: shard.sessions) {
+        shard.eventLoop.remove(entry.first);
+        entry.second->socket.closeS();
+    }
+    shard.sessions.clear();
+    for (WaitingClient &client: shard.waitingClients) {
+        client.socket.closeS();
+    }
+    shard.waitingClients.clear();
+}
+
+
+bool Server::defineVersionAndHandleClient(Session &session) {
+    char buffer[MESSAGE_SIZE] = {};
+    const ReceiveResult result = receiveMessage(session.socket, buffer, sizeof(buffer));
+    if (result.status != ReceiveStatus::SUCCESS) {
+        logWarning(result.message);
+        return false;
+    }
+
+    std::istringstream stream(buffer);
+    std::string version, requestedOptions;
+    stream >> version;
+    std::getline(stream, requestedOptions);
+
+    session.options = negotiateOptions(requestedOptions);
+    const std::string versionResponse = session.options.empty()
+                                            ? RESPONSE_OK
+                                            : RESPONSE_OK + " " + session.options.toString();
+
+    if (version == "2.0" || version == "3.0") {
+        session.options.pipelined = version == "3.0";
+        session.socket.sendData(versionResponse.c_str());
+        session.state = SessionState::AWAITING_USERNAME;
+        return true;
+    }
+    if (version == "1.0") {
+        session.socket.sendData(versionResponse.c_str());
+        return handleClient1dot0(session);
+    }
+
+    session.socket.sendData("400 BAD REQUEST: Invalid version.");
+    logWarning("Invalid version.");
+    return false;
+}
+
+
+bool Server::handleClient1dot0(Session &session) {
+    session.username = "v1dot0";
+    session.state = SessionState::PROCESSING_COMMANDS;
+    return true;
+}
+
+
+bool Server::handleClient2dot0(Session &session) const {
+    if (!authenticateClient(session.socket, session.username)) {
+        return false;
+    }
+
+    if (!createClientFolderIfNotExists(session.username)) {
+        session.socket.sendData("500 SERVER ERROR: Unable to create client folder.");
+        return false;
+    }
+    session.socket.sendData(RESPONSE_OK.c_str());
+    session.state = SessionState::PROCESSING_COMMANDS;
+    return true;
+}
+
+
+bool Server::authenticateClient(const Socket &clientSocket, std::string &username) {
+    char buffer[MESSAGE_SIZE] = {};
+    const ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer));
+    if (result.status != ReceiveStatus::SUCCESS) {
+        logWarning(result.message);
+        return false;
+    }
+
+    username = buffer;
+    if (!isValidUsername(username)) {
+        clientSocket.sendData("400 BAD REQUEST: Invalid username.");
+        logWarning("Invalid username.");
+        return false;
+    }
+
+    logInfo("Client's name: " + username);
+    return true;
+}
+
+
+bool Server::processCommands(const Session &session) {
+    if (!session.options.pipelined) {
+        return processCommand(session);
+    }
+
+    // answer everything a 3.0 client has already pipelined, letting the responses share segments
+    session.socket.setCork(true);
+    bool keepOpen;
+    do {
+        keepOpen = processCommand(session);
+    } while (keepOpen && !_stopFlag && session.socket.hasBufferedFrame());
+    session.socket.setCork(false);
+    return keepOpen;
+}
+
+
+bool Server::processCommand(const Session &session) {
+    const Socket &clientSocket = session.socket;
+    const std::string &username = session.username;
+
+    char buffer[MESSAGE_SIZE] = {};
+    const ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer) - 1, username.c_str());
+    if (result.status != ReceiveStatus::SUCCESS) {
+        logWarning(result.message);
+        return false;
+    }
+
+    buffer[result.bytesReceived] = '\0';
+    std::string command(buffer);
+    logInfo("Received command from " + username + ": " + command);
+
+    std::istringstream stream(command);
+    std::string action;
+
+    if (session.options.pipelined) {
+        // 3.0 requests start with an ID, echoed in a frame of its own ahead of the response
+        std::string requestId;
+        stream >> requestId;
+        if (!isValidRequestId(requestId)) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid request ID.");
+            return false;
+        }
+        clientSocket.sendData(requestId.c_str());
+    }
+    stream >> action;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ssize_t transferredBytes = 0;
+    const bool keepOpen = executeCommand(session, action, stream, transferredBytes);
+    _commandStatistics.record(action, std::chrono::steady_clock::now() - start,
+                              transferredBytes > 0 ? transferredBytes : 0);
+    return keepOpen;
+}
+
+
+bool Server::executeCommand(const Session &session, const std::string &action, std::istringstream &stream,
+                            ssize_t &transferredBytes) {
+    const Socket &clientSocket = session.socket;
+    const std::string &username = session.username;
+    std::string filename, firstArgument, secondArgument;
+
+    if (action == "INFO" || action == "GET" || action == "PUT" || action == "DELETE" || action == "SIZE") {
+        stream >> filename;
+        if (!isValidFilename(filename)) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid filename.");
+            return false;
+        }
+        stream >> firstArgument >> secondArgument;
+    }
+
+    if (action == "GET") {
+        // "GET <file> <offset> [<length> | MATCH <crc of the first offset bytes>]"
+        off_t offset = 0, length = -1;
+        uint32_t prefixCrc = 0;
+        std::string prefixCrcToken;
+        const bool match = secondArgument == "MATCH";
+        if (match) {
+            stream >> prefixCrcToken;
+        }
+        if ((!firstArgument.empty() && !parseOffset(firstArgument, offset)) ||
+            (match ? !parseChecksum(prefixCrcToken, prefixCrc)
+                   : !secondArgument.empty() && !parseOffset(secondArgument, length))) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid range.");
+            return true;
+        }
+        transferredBytes = handleGet(clientSocket, username, filename, session.options, offset, length,
+                                     match ? &prefixCrc : nullptr);
+        if (transferredBytes == -1) return false;
+    } else if (action == "LIST") {
+        handleList(clientSocket, username);
+    } else if (action == "PUT" && firstArgument == "STRIPE") {
+        std::string lengthToken, totalSizeToken;
+        stream >> lengthToken >> totalSizeToken;
+        off_t offset = 0, length = 0, totalSize = 0;
+        if (!parseOffset(secondArgument, offset) || !parseOffset(lengthToken, length) ||
+            !parseOffset(totalSizeToken, totalSize)) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid PUT arguments.");
+            return true;
+        }
+        if (totalSize > _maxFileSize) {
+            clientSocket.sendData(RESPONSE_TOO_LARGE.c_str());
+            return true;
+        }
+        transferredBytes = handlePutStripe(clientSocket, username, filename, session.options, offset, length,
+                                           totalSize);
+        if (transferredBytes == -1) return false;
+    } else if (action == "PUT" && firstArgument == "DELTA") {
+        off_t fileSize = 0;
+        if (!parseOffset(secondArgument, fileSize)) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid PUT arguments.");
+            return true;
+        }
+        if (fileSize > _maxFileSize) {
+            clientSocket.sendData(RESPONSE_TOO_LARGE.c_str());
+            return true;
+        }
+        transferredBytes = handlePutDelta(clientSocket, username, filename, session.options, fileSize);
+        if (transferredBytes == -1) return false;
+    } else if (action == "PUT" && firstArgument == "DEDUP") {
+        off_t fileSize = 0;
+        if (!parseOffset(secondArgument, fileSize)) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid PUT arguments.");
+            return true;
+        }
+        if (fileSize > _maxFileSize) {
+            clientSocket.sendData(RESPONSE_TOO_LARGE.c_str());
+            return true;
+        }
+        transferredBytes = handlePutDedup(clientSocket, username, filename, session.options, fileSize);
+        if (transferredBytes == -1) return false;
+    } else if (action == "PUT" && (firstArgument == "CHUNKS" || firstArgument == "COMMIT")) {
+        // "PUT <file> CHUNKS <upload> <first chunk> <chunk count>" and "PUT <file> COMMIT <upload>"
+        const bool chunks = firstArgument == "CHUNKS";
+        std::string firstChunkToken, chunkCountToken;
+        stream >> firstChunkToken >> chunkCountToken;
+        off_t uploadId = 0, firstChunk = 0, chunkCount = 0;
+        if (!parseOffset(secondArgument, uploadId) ||
+            (chunks && (!parseOffset(firstChunkToken, firstChunk) || !parseOffset(chunkCountToken, chunkCount)))) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid PUT arguments.");
+            return true;
+        }
+        transferredBytes = chunks
+                               ? handlePutChunks(clientSocket, username, filename, session.options, uploadId,
+                                                 firstChunk, chunkCount)
+                               : handlePutCommit(clientSocket, username, filename, session.options, uploadId);
+        if (transferredBytes == -1) return false;
+    } else if (action == "PUT") {
+        // RESUME and SIZE both announce the file size, which is preallocated
+        const bool resume = firstArgument == "RESUME";
+        off_t clientFileSize = 0;
+        if ((!firstArgument.empty() && !resume && firstArgument != "SIZE") ||
+            (!firstArgument.empty() && !parseOffset(secondArgument, clientFileSize))) {
+            clientSocket.sendData("400 BAD REQUEST: Invalid PUT arguments.");
+            return true;
+        }
+        if (clientFileSize > _maxFileSize) {
+            clientSocket.sendData(RESPONSE_TOO_LARGE.c_str());
+            return true;
+        }
+        transferredBytes = handlePut(clientSocket, username, filename, session.options, resume, clientFileSize);
+        if (transferredBytes == -1) return false;
+    } else if (action == "DELETE") {
+        handleDelete(clientSocket, username, filename);
+    } else if (action == "INFO") {
+        handleInfo(clientSocket, username, filename);
+    } else if (action == "SIZE") {
+        handleSize(clientSocket, username, filename);
+    } else if (action == "STATS") {
+        clientSocket.sendData(statisticsReport().c_str());
+    } else if (action == "EXIT") {
+        return false;
+    } else {
+        clientSocket.sendData("400 BAD REQUEST: Invalid command.");
     }
+    return true;
 }
 
 
-void Server::start(const int port) {
-    if (!_serverSocket.createS()) {
-        return;
+bool Server::sendFileFrames(const Socket &clientSocket, const TransferOptions &options, const int fileFd,
+                            const off_t offset, const off_t length, const std::string &filename,
+                            uint32_t *crc) const {
+    if (!options.compress) {
+        return _ioEngine->sendFileFrames(clientSocket, fileFd, offset, length, options.dataFrameSize(), crc);
     }
 
-    if (!_serverSocket.bindS(port) || !_serverSocket.listenS(SOMAXCONN)) {
-        _serverSocket.closeS();
-        return;
+    FrameCompressor compressor(options.dataFrameSize());
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool sent = IoEngine::sendCompressedFrames(clientSocket, fileFd, offset, length, options.dataFrameSize(),
+                                                     compressor, crc);
+    if (sent) {
+        logInfo("Sent " + filename + ", " + compressionSummary(compressor.rawBytes(), compressor.wireBytes(),
+                                                                 std::chrono::steady_clock::now() - start) + ".");
     }
-    std::cout << "Server listening on port " << port << std::endl;
-    run();
+    return sent;
 }
 
 
-void Server::shutdown() {
-    _stopFlag = true;
-    _serverSocket.shutdownS();
-    _serverSocket.closeS();
-    _threadPool.shutdown();
-    std::cout << "Server stopped." << std::endl;
-    displayCommandStatistics();
+// Reads a small file into the file cache. A file whose stored checksum no longer matches its content is left out,
+// so GET keeps reporting the damage to the client; one without a stored checksum gets it here.
+std::shared_ptr<const FileCache::Entry> Server::cacheFile(const std::string &filePath, const int fileFd,
+                                                          const struct stat &fileStat) const {
+    const std::shared_ptr<const FileCache::Entry> cached = _fileCache->load(filePath, fileFd, fileStat);
+    if (!cached) {
+        return nullptr;
+    }
+    uint32_t storedCrc;
+    if (!loadChecksum(fileFd, fileStat, storedCrc)) {
+        storeChecksum(fileFd, fileStat, cached->crc);
+    } else if (storedCrc != cached->crc) {
+        _fileCache->invalidate(filePath);
+        return nullptr;
+    }
+    return cached;
 }
 
 
-void Server::handleList(const Socket &clientSocket, const std::string &username) const {
-    DIR *dir = opendir((_directory + username).c_str());
-    if (!dir) {
-        perror("opendir");
-        clientSocket.sendData("500 SERVER ERROR: Failed to open directory.");
-        return;
+// Answers a small GET with one frame holding both the status line and the data, which spares the client the ACK
+// round trip. Closes fileFd, which is -1 when the file is cached.
+ssize_t Server::sendInlineFile(const Socket &clientSocket, const TransferOptions &options,
+                               const FileCache::Entry *cached, const int fileFd, const struct stat &fileStat,
+                               const off_t offset, const off_t length, const std::string &filename,
+                               const std::string &username) {
+    std::string data;
+    if (cached) {
+        data.assign(cached->data, offset, length);
+    } else {
+        data.resize(length);
+        off_t position = 0;
+        ssize_t bytesRead = 1;
+        while (position < length && (bytesRead = pread(fileFd, &data[position], length - position,
+                                                       offset + position)) > 0) {
+            position += bytesRead;
+        }
+        if (position < length) {
+            perror("pread");
+            close(fileFd);
+            clientSocket.sendData("500 SERVER ERROR: Unable to read file.");
+            return 0;
+        }
     }
 
-    dirent *entry;
-    std::ostringstream fileListStream;
-    bool firstEntry = true;
-    bool filesFound = false;
-
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_type == DT_REG) {
-            if (!firstEntry) {
-                fileListStream << "\n";
+    std::string header = RESPONSE_INLINE + std::to_string(length);
+    if (options.checksum) {
+        const bool wholeFile = offset == 0 && length == fileStat.st_size;
+        uint32_t crc = cached && wholeFile ? cached->crc : crc32c(0, data.data(), data.size());
+        uint32_t storedCrc;
+        if (!cached && wholeFile && loadChecksum(fileFd, fileStat, storedCrc)) {
+            if (storedCrc != crc) {
+                logError("Stored checksum of " + filename + " for " + username + " no longer matches its content.");
             }
-            fileListStream << entry->d_name;
-            firstEntry = false;
-            filesFound = true;
+            crc = storedCrc;
+        } else if (!cached && wholeFile) {
+            storeChecksum(fileFd, fileStat, crc);
         }
+        header += " " + formatChecksum(crc);
+    }
+    if (fileFd != -1) {
+        close(fileFd);
     }
 
-    closedir(dir);
-
-    if (!filesFound) {
-        clientSocket.sendData("204 NO CONTENT: The directory is empty.");
-    } else {
-        clientSocket.sendData(fileListStream.str().c_str());
+    const std::string frame = header + "\n" + data;
+    if (clientSocket.sendData(frame.data(), frame.size()) == -1) {
+        logError("Failed to send " + filename + " to client " + username + ".");
+        return -1;
     }
+    return length;
 }
 
 
-size_t Server::handleGet(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
-    const std::string filePath = _directory + username + "/" + filename;
-    const int fileFd = open(filePath.c_str(), O_RDONLY);
-    if (fileFd == -1) {
-        perror("open");
-        clientSocket.sendData("404 NOT FOUND: File does not exist.");
-        return 0;
-    }
+// Answers a GET from memory with the same stream or frames and checksum trailer the file would get from disk.
+ssize_t Server::sendCachedFile(const Socket &clientSocket, const TransferOptions &options,
+                               const FileCache::Entry &cached, const off_t offset, const off_t length,
+                               const std::string &filename, const std::string &username) {
+    const char *data = cached.data.data() + offset;
+    clientSocket.setCork(true);
 
-    clientSocket.sendData(RESPONSE_OK.c_str());
+    bool sent;
+    if (options.streamGet) {
+        sent = clientSocket.sendRaw(data, length) == length;
+    } else {
+        sent = true;
+        const off_t frameSize = options.dataFrameSize();
+        for (off_t position = 0; position < length && sent; position += frameSize) {
+            sent = clientSocket.sendData(data + position, std::min(frameSize, length - position)) != -1;
+        }
+        sent = sent && clientSocket.sendData("", 0) != -1;
+    }
+    if (sent && options.checksum) {
+        sent = sendChecksumTrailer(clientSocket, offset == 0 && length == cached.fileStat.st_size
+                                                     ? cached.crc
+                                                     : crc32c(0, data, length));
+    }
+    clientSocket.setCork(false);
 
-    char ackBuffer[4] = {};
-    const ReceiveResult result = receiveMessage(clientSocket, ackBuffer, sizeof(ackBuffer), username.c_str());
-    if (result.status != ReceiveStatus::SUCCESS) {
-        std::cout << "\033[31m" << result.message << "\033[0m" << std::endl;
-        close(fileFd);
+    if (!sent) {
+        logError("Failed to send " + filename + " to client " + username + ".");
         return -1;
     }
+    return length;
+}
 
-    if (std::string(ackBuffer) != RESPONSE_ACK) {
-        std::cout << "\033[31m" << "Client did not acknowledge 200 OK." << "\033[0m" << std::endl;
-        return 0;
+
+off_t Server::receiveFileFrames(const Socket &clientSocket, const TransferOptions &options, const int fileFd,
+                                const off_t offset, const off_t limit, const std::string &filename,
+                                uint32_t *crc) const {
+    if (!options.compress) {
+        return _ioEngine->receiveFileFrames(clientSocket, fileFd, offset, options.dataFrameSize(), limit, crc);
     }
 
-    char buffer[FILE_BUFFER_SIZE];
-    ssize_t bytesRead;
-    while ((bytesRead = read(fileFd, buffer, sizeof(buffer))) > 0) {
-        clientSocket.sendData(buffer, bytesRead);
+    FrameDecompressor decompressor(options.dataFrameSize());
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const off_t received = IoEngine::receiveCompressedFrames(clientSocket, fileFd, offset, limit, decompressor, crc);
+    if (received != -1) {
+        logInfo("Received " + filename + ", " +
+                compressionSummary(decompressor.rawBytes(), decompressor.wireBytes(),
+                                   std::chrono::steady_clock::now() - start) + ".");
     }
-    clientSocket.sendData("", 0);
-    close(fileFd);
-    return 0;
+    return received;
 }
 
 
-size_t Server::handlePut(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
-    const int fileFd = open((_directory + username + "/" + filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fileFd == -1) {
-        perror("open");
-        clientSocket.sendData("500 SERVER ERROR: Unable to create file.");
-        return 0;
+// Reads the CRC-32C trailer a client sends after the data of a PUT; false, with the reason logged, if it is missing.
+bool Server::receiveUploadChecksum(const Socket &clientSocket, const std::string &username, uint32_t &crc) {
+    if (receiveChecksumTrailer(clientSocket, crc)) {
+        return true;
     }
+    logWarning(errno == EPROTO ? "Client " + username + " sent no checksum after its data."
+                               : classifyReceive(-1, username.c_str()).message);
+    return false;
+}
 
-    clientSocket.sendData(RESPONSE_OK.c_str());
 
-    while (true) {
-        char buffer[FILE_BUFFER_SIZE];
-        const ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer), username.c_str());
-        if (result.status == ReceiveStatus::ERROR || result.status == ReceiveStatus::TIMEOUT) {
-            std::cout << "\033[31m" << result.message << "\033[0m" << std::endl;
-            close(fileFd);
-            return -1;
-        }
-        if (result.bytesReceived == 0) {
-            break;
-        }
-        write(fileFd, buffer, result.bytesReceived);
+// The CRC-32C of a range GET sent with sendfile(): the stored checksum for a whole file, otherwise read back from
+// the page cache, and stored if it covers the whole file.
+bool Server::rangeChecksum(const int fileFd, const struct stat &fileStat, const off_t offset, const off_t length,
+                           uint32_t &crc) {
+    const bool wholeFile = offset == 0 && length == fileStat.st_size;
+    if (wholeFile && loadChecksum(fileFd, fileStat, crc)) {
+        return true;
     }
-
-    close(fileFd);
-    clientSocket.sendData(RESPONSE_OK.c_str());
-    return 0;
+    if (!crc32cFile(fileFd, offset, length, crc)) {
+        return false;
+    }
+    if (wholeFile) {
+        storeChecksum(fileFd, fileStat, crc);
+    }
+    return true;
 }
 
 
-void Server::handleDelete(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
-    const std::string filePath = _directory + username + "/" + filename;
+// Reads the pending chunks (index and hash), sent back to back in file order as data frames, into their places in
+// the file. Each chunk is checked against its hash as it completes; arrived lists the ones that match, with their
+// CRC-32C.
+off_t Server::receiveMissingChunks(const Socket &clientSocket, const TransferOptions &options, const int fileFd,
+                                   const off_t fileSize, const std::vector<std::pair<off_t, std::string>> &pending,
+                                   std::vector<std::pair<off_t, uint32_t>> &arrived) const {
+    std::unique_ptr<FrameDecompressor> decompressor(
+        options.compress ? new FrameDecompressor(options.dataFrameSize()) : nullptr);
+
+    size_t current = 0;
+    off_t chunkReceived = 0, received = 0;
+    Sha256 hash;
+    uint32_t crc = 0;
+
+    const char *frame;
+    ssize_t bytesReceived;
+    while ((bytesReceived = decompressor ? decompressor->receiveFrame(clientSocket, frame)
+                                         : clientSocket.receiveView(frame, options.dataFrameSize())) > 0) {
+        while (bytesReceived > 0) {
+            if (current == pending.size()) {
+                errno = EMSGSIZE;
+                return -1;
+            }
 
-    if (access(filePath.c_str(), F_OK) == 0) {
-        if (unlink(filePath.c_str()) == 0) {
-            clientSocket.sendData(RESPONSE_OK.c_str());
-        } else {
-            perror("unlink");
-            clientSocket.sendData("500 SERVER ERROR: Unable to delete file.");
+            const off_t chunkOffset = pending[current].first * DEDUP_CHUNK_SIZE;
+            const off_t chunkLength = std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - chunkOffset);
+            const size_t taken = std::min<off_t>(bytesReceived, chunkLength - chunkReceived);
+            if (pwrite(fileFd, frame, taken, chunkOffset + chunkReceived) != static_cast<ssize_t>(taken)) {
+                return -1;
+            }
+            hash.update(frame, taken);
+            crc = crc32c(crc, frame, taken);
+            frame += taken;
+            bytesReceived -= taken;
+            chunkReceived += taken;
+            received += taken;
+
+            if (chunkReceived == chunkLength) {
+                unsigned char digest[SHA256_DIGEST_SIZE];
+                hash.finish(digest);
+                if (pending[current].second.compare(0, SHA256_DIGEST_SIZE, reinterpret_cast<const char *>(digest),
+                                                    SHA256_DIGEST_SIZE) == 0) {
+                    arrived.push_back(std::make_pair(pending[current].first, crc));
+                }
+                hash = Sha256();
+                crc = 0;
+                chunkReceived = 0;
+                ++current;
+            }
         }
-    } else {
-        perror("access");
-        clientSocket.sendData("404 NOT FOUND: File does not exist.");
     }
+    return bytesReceived == 0 ? received : -1;
 }
 
 
-void Server::handleInfo(const Socket &clientSocket, const std::string &username, const std::string &filename) const {
-    const std::string filePath = _directory + username + "/" + filename;
-    struct stat fileStat{};
+// Rebuilds the file from the client's instructions: COPY takes whole blocks of the previous version, LITERAL carries
+// new bytes. Returns the rebuilt size, or -1 with errno set (EPROTO for a malformed instruction).
+off_t Server::receiveDelta(const Socket &clientSocket, const TransferOptions &options, const int basisFd,
+                           const off_t basisSize, const size_t blockSize, const int fileFd, const off_t fileSize,
+                           off_t &literalBytes, const std::vector<uint32_t> &blockChecksums,
+                           uint32_t *crc) const {
+    const off_t blockCount = basisSize / blockSize;
+    const Crc32cAppender blockAppender(blockSize); // copied blocks are checksummed from the signature pass
+    std::unique_ptr<FrameDecompressor> decompressor(
+        options.compress ? new FrameDecompressor(options.dataFrameSize()) : nullptr);
+    off_t written = 0;
+    literalBytes = 0;
+
+    const char *frame;
+    ssize_t frameSize;
+    while ((frameSize = decompressor ? decompressor->receiveFrame(clientSocket, frame)
+                                     : clientSocket.receiveView(frame, options.dataFrameSize())) > 0) {
+        for (size_t position = 0; position < static_cast<size_t>(frameSize);) {
+            DeltaInstruction instruction;
+            const size_t instructionSize = parseDeltaInstruction(frame + position, frameSize - position, instruction);
+            const bool copy = instruction.type == DELTA_COPY;
+            if (instructionSize == 0 || (copy && static_cast<off_t>(instruction.firstBlock) +
+                                                 instruction.blockCount > blockCount)) {
+                errno = EPROTO;
+                return -1;
+            }
 
-    if (access(filePath.c_str(), F_OK) == 0) {
-        if (stat(filePath.c_str(), &fileStat) == 0) {
-            std::ostringstream metadataStream;
-            metadataStream << "Size: " << fileStat.st_size << " bytes\n";
-            metadataStream << "Last Modified: " << ctime(&fileStat.st_mtime);
-            metadataStream << "Last Accessed: " << ctime(&fileStat.st_atime);
-            metadataStream << "Creation Time: " << ctime(&fileStat.st_birthtime);
-            metadataStream << "Permissions: " << getFilePermissions(fileStat.st_mode);
-            clientSocket.sendData(metadataStream.str().c_str());
-        } else {
-            perror("stat");
-            clientSocket.sendData("500 SERVER ERROR: Unable to retrieve file info.");
+            const off_t length = copy ? static_cast<off_t>(instruction.blockCount) * blockSize
+                                      : instruction.literalSize;
+            if (written + length > fileSize) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            // unchanged blocks never leave the kernel, and share extents on reflink filesystems
+            if (copy ? !ChunkStore::copyRange(basisFd, static_cast<off_t>(instruction.firstBlock) * blockSize, fileFd,
+                                              written, length)
+                     : pwrite(fileFd, instruction.literal, length, written) != length) {
+                return -1;
+            }
+            if (!copy) {
+                literalBytes += length;
+            }
+            if (crc != nullptr && copy) {
+                for (uint32_t block = 0; block < instruction.blockCount; ++block) {
+                    *crc = blockAppender.append(*crc, blockChecksums[instruction.firstBlock + block]);
+                }
+            } else if (crc != nullptr) {
+                *crc = crc32c(*crc, instruction.literal, length);
+            }
+            written += length;
+            position += instructionSize;
         }
-    } else {
-        perror("access");
-        clientSocket.sendData("404 NOT FOUND: File does not exist.");
     }
+    return frameSize == 0 ? written : -1;
 }
 
 
-Server::~Server() {
-    if (!_stopFlag) {
-        shutdown();
+bool Server::reserveSpace(const int fileFd, const off_t offset, const off_t length) {
+#ifdef __linux__
+    // allocated in one go the file gets few, contiguous extents; the size is left alone so a partial file still
+    // tells how far an interrupted upload got
+    if (length > 0 && fallocate(fileFd, FALLOC_FL_KEEP_SIZE, offset, length) == -1 && errno != EOPNOTSUPP) {
+        perror("fallocate");
+        return false;
     }
+#endif
+    return true;
 }
 
 
-void Server::run() {
-    while (!_stopFlag) {
-        Socket clientSocket = acceptClient();
-        if (clientSocket.getS() != -1) {
-            std::cout << "Client connected." << std::endl;
-            _threadPool.submit([this, clientSocket] { defineVersionAndHandleClient(clientSocket); });
+// Claims [offset, offset + length) of a striped upload for one stripe, creating and preallocating the shared target
+// file for the first. Returns the error response, or an empty string once the range is reserved and fileFd is open
+// for writing it.
+// A range that was already received may be sent again, as a client retrying its upload does. Any other overlap
+// is a conflict, unless no stripe of the upload is in flight: then the upload was abandoned and starts over, as it
+// does for a different size. Abandoned uploads are also dropped after CLIENT_TIMEOUT_SECONDS without a stripe.
+std::string Server::reserveStripe(const std::string &stripedPath, const off_t offset, const off_t length,
+                                  const off_t totalSize, uint64_t &uploadId, int &fileFd) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_stripedUploadsMutex);
+    for (auto it = _stripedUploads.begin(); it != _stripedUploads.end();) {
+        if (it->second.activeStripes == 0 &&
+            now - it->second.lastActivity >= std::chrono::seconds(CLIENT_TIMEOUT_SECONDS)) {
+            unlink(it->first.c_str());
+            it = _stripedUploads.erase(it);
+        } else {
+            ++it;
         }
     }
-}
 
+    auto it = _stripedUploads.find(stripedPath);
+    if (it != _stripedUploads.end()) {
+        StripedUpload &upload = it->second;
+        const auto exact = upload.reservedRanges.find(offset);
+        const bool resent = exact != upload.reservedRanges.end() && exact->second == length &&
+                            upload.receivedOffsets.count(offset) != 0;
+        bool overlaps = false;
+        if (!resent && upload.totalSize == totalSize) {
+            // only the last range starting before this stripe ends can reach into it
+            auto previous = upload.reservedRanges.lower_bound(offset + length);
+            if (previous != upload.reservedRanges.begin()) {
+                --previous;
+                overlaps = previous->first + previous->second > offset;
+            }
+        }
 
-Socket Server::acceptClient() const {
-    sockaddr_in clientAddr{};
-    socklen_t clientAddrLen = sizeof(clientAddr);
-
-    const int clientFd = _serverSocket.acceptS(&clientAddr, &clientAddrLen);
-    if (clientFd == -1) {
-        return Socket(-1);
+        if (resent && upload.totalSize == totalSize) {
+            upload.receivedOffsets.erase(offset);
+            upload.receivedBytes -= length;
+            upload.stripeChecksums.erase(offset);
+        } else if (upload.totalSize != totalSize || overlaps) {
+            if (upload.activeStripes != 0) {
+                return "409 CONFLICT: Stripe does not match the upload in progress.";
+            }
+            logWarning("Restarting abandoned striped upload " + stripedPath + ".");
+            _stripedUploads.erase(it);
+            it = _stripedUploads.end();
+        } else {
+            upload.reservedRanges[offset] = length;
+        }
     }
 
-    Socket clientSocket(clientFd);
-    clientSocket.setTimeoutSeconds(600);
-
-    if (_threadPool.activeThreads() >= _maxSimultaneousClients) {
-        clientSocket.sendData("503 SERVICE UNAVAILABLE: Server is busy. Please try again later.");
-        clientSocket.closeS();
-        return clientSocket;
+    if (it == _stripedUploads.end()) {
+        fileFd = open(stripedPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fileFd == -1) {
+            perror("open");
+            return "500 SERVER ERROR: Unable to create file.";
+        }
+#ifdef __linux__
+        const int allocationResult = posix_fallocate(fileFd, 0, totalSize);
+#else
+        const int allocationResult = ftruncate(fileFd, totalSize) == 0 ? 0 : errno;
+#endif
+        if (allocationResult != 0) {
+            close(fileFd);
+            unlink(stripedPath.c_str());
+            return "507 INSUFFICIENT STORAGE: Unable to preallocate file.";
+        }
+        StripedUpload upload;
+        upload.id = _nextStripedUploadId++;
+        upload.totalSize = totalSize;
+        upload.receivedBytes = 0;
+        upload.reservedRanges[offset] = length;
+        upload.activeStripes = 0;
+        it = _stripedUploads.insert(std::make_pair(stripedPath, upload)).first;
+    } else {
+        // opened under the lock, so the stripe writes to this upload's file even if it is aborted and restarted
+        fileFd = open(stripedPath.c_str(), O_WRONLY);
+        if (fileFd == -1) {
+            perror("open");
+            it->second.reservedRanges.erase(offset);
+            return "500 SERVER ERROR: Unable to open file.";
+        }
     }
-
-    clientSocket.sendData(RESPONSE_OK.c_str());
-
-    return clientSocket;
+    ++it->second.activeStripes;
+    it->second.lastActivity = now;
+    uploadId = it->second.id;
+    return "";
 }
 
-void Server::defineVersionAndHandleClient(Socket clientSocket) {
-    char buffer[MESSAGE_SIZE] = {};
-    const ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer));
-    if (result.status != ReceiveStatus::SUCCESS) {
-        std::cout << "\033[31m" << result.message << "\033[0m" << std::endl;
-        cleanupClient(clientSocket);
-        return;
-    }
-
-    const std::string initialMessage(buffer);
-    std::string username;
 
-    if (initialMessage == "2.0") {
-        clientSocket.sendData(RESPONSE_OK.c_str());
-        handleClient2dot0(clientSocket);
-    } else if (initialMessage == "1.0") {
-        clientSocket.sendData(RESPONSE_OK.c_str());
-        handleClient1dot0(clientSocket);
-    } else {
-        clientSocket.sendData("400 BAD REQUEST: Invalid version.");
-        std::cout << "\033[31m" << "Invalid version." << "\033[0m" << std::endl;
-        cleanupClient(clientSocket);
+// Gives a stripe's range back without crediting it, when the stripe ends early
+void Server::releaseStripe(const std::string &stripedPath, const uint64_t uploadId, const off_t offset) {
+    std::lock_guard<std::mutex> lock(_stripedUploadsMutex);
+    const auto it = _stripedUploads.find(stripedPath);
+    if (it != _stripedUploads.end() && it->second.id == uploadId) {
+        --it->second.activeStripes;
+        it->second.reservedRanges.erase(offset);
+        it->second.lastActivity = std::chrono::steady_clock::now();
     }
 }
 
 
-void Server::handleClient1dot0(Socket &clientSocket) {
-    std::string username = "v1dot0";
-    processCommands(clientSocket, username);
-    cleanupClient(clientSocket, username.c_str());
+// Drops the upload after a failed stripe. Stripes still writing keep their descriptors to the unlinked file, and
+// the id stops them from crediting their bytes to an upload restarted under the same name.
+void Server::abortStripedUpload(const std::string &stripedPath, const uint64_t uploadId) {
+    std::lock_guard<std::mutex> lock(_stripedUploadsMutex);
+    const auto it = _stripedUploads.find(stripedPath);
+    if (it != _stripedUploads.end() && it->second.id == uploadId) {
+        _stripedUploads.erase(it);
+        unlink(stripedPath.c_str());
+    }
 }
 
 
-void Server::handleClient2dot0(Socket &clientSocket) {
-    std::string username;
-    if (!authenticateClient(clientSocket, username)) {
-        cleanupClient(clientSocket);
-        return;
-    }
-
-    if (!createClientFolderIfNotExists(username)) {
-        clientSocket.sendData("500 SERVER ERROR: Unable to create client folder.");
-        cleanupClient(clientSocket, username.c_str());
-        return;
+// Looks up the deduplicated upload of filePath, with _dedupUploadsMutex held, after dropping uploads abandoned for
+// CLIENT_TIMEOUT_SECONDS. True if it uploads the same content, which then resumes. An upload of other content is
+// dropped, or sets error while chunks of it are in flight.
+bool Server::findDedupUpload(const std::string &filePath, const std::string &objectId, std::string &error) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (auto it = _dedupUploads.begin(); it != _dedupUploads.end();) {
+        if (it->second.activeRanges.empty() &&
+            now - it->second.lastActivity >= std::chrono::seconds(CLIENT_TIMEOUT_SECONDS)) {
+            if (!it->second.temporaryPath.empty()) {
+                unlink(it->second.temporaryPath.c_str());
+            }
+            it = _dedupUploads.erase(it);
+        } else {
+            ++it;
+        }
     }
-    clientSocket.sendData(RESPONSE_OK.c_str());
-
-    processCommands(clientSocket, username);
-    cleanupClient(clientSocket, username.c_str());
-}
 
-
-bool Server::authenticateClient(const Socket &clientSocket, std::string &username) {
-    char buffer[MESSAGE_SIZE] = {};
-    const ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer));
-    if (result.status != ReceiveStatus::SUCCESS) {
-        std::cout << "\033[31m" << result.message << "\033[0m" << std::endl;
+    const auto it = _dedupUploads.find(filePath);
+    if (it == _dedupUploads.end()) {
         return false;
     }
-
-    username = buffer;
-    if (!isValidUsername(username)) {
-        clientSocket.sendData("400 BAD REQUEST: Invalid username.");
-        std::cout << "\033[31m" << "Invalid username." << "\033[0m" << std::endl;
+    if (it->second.objectId == objectId) {
+        return true;
+    }
+    if (!it->second.activeRanges.empty()) {
+        error = "409 CONFLICT: Another upload of the file is in progress.";
         return false;
     }
-
-    std::cout << "Client's name: " << username << std::endl;
-    return true;
+    if (!it->second.temporaryPath.empty()) {
+        unlink(it->second.temporaryPath.c_str());
+    }
+    _dedupUploads.erase(it);
+    return false;
 }
 
 
-void Server::processCommands(const Socket &clientSocket, std::string &username) {
-    char buffer[MESSAGE_SIZE] = {};
-    while (true) {
-        ReceiveResult result = receiveMessage(clientSocket, buffer, sizeof(buffer), username.c_str());
-        if (result.status != ReceiveStatus::SUCCESS) {
-            std::cout << "\033[31m" << result.message << "\033[0m" << std::endl;
-            break;
-        }
-
-        buffer[result.bytesReceived] = '\0';
-        std::string command(buffer);
-        std::cout << "Received command from " << username << ": " << command << std::endl;
-
-        std::istringstream stream(command);
-        std::string action, filename;
-        stream >> action;
-
-        updateCommandStatistics(action);
+// A file the store already holds needs no chunks. Otherwise the chunks the store knows are copied from other objects
+// into a new temporary file, and the others are marked missing. Nothing taken from the store reaches the user's
+// folder before the client has proven that it holds those chunks too.
+bool Server::prepareDedupUpload(DedupUpload &upload) const {
+    const int objectFd = _chunkStore->openObject(upload.objectId);
+    if (objectFd != -1) {
+        close(objectFd);
+        upload.stored.assign(upload.chunkHashes.size(), true);
+        return true;
+    }
 
-        if (action == "INFO" || action == "GET" || action == "PUT" || action == "DELETE") {
-            stream >> filename;
-            if (!isValidFilename(filename)) {
-                clientSocket.sendData("400 BAD REQUEST: Invalid filename.");
-                return;
-            }
+    const int fileFd = _chunkStore->createTemporary(upload.temporaryPath);
+    if (fileFd == -1 || ftruncate(fileFd, upload.fileSize) == -1) {
+        if (fileFd != -1) {
+            close(fileFd);
+            unlink(upload.temporaryPath.c_str());
         }
-
-        if (action == "GET") {
-            if (handleGet(clientSocket, username, filename) == -1) break;
-        } else if (action == "LIST") {
-            handleList(clientSocket, username);
-        } else if (action == "PUT") {
-            if (handlePut(clientSocket, username, filename) == -1) break;
-        } else if (action == "DELETE") {
-            handleDelete(clientSocket, username, filename);
-        } else if (action == "INFO") {
-            handleInfo(clientSocket, username, filename);
-        } else if (action == "EXIT") {
-            break;
+        return false;
+    }
+    std::unordered_map<std::string, off_t> requested;
+    for (size_t i = 0; i < upload.chunkHashes.size(); ++i) {
+        const off_t offset = static_cast<off_t>(i) * DEDUP_CHUNK_SIZE;
+        const off_t length = std::min<off_t>(DEDUP_CHUNK_SIZE, upload.fileSize - offset);
+        if (_chunkStore->copyChunk(upload.chunkHashes[i], length, fileFd, offset)) {
+            upload.stored[i] = true;
+            continue;
+        }
+        // content repeated within the file is requested once and copied locally at the commit
+        const std::pair<std::unordered_map<std::string, off_t>::iterator, bool> first =
+                requested.insert(std::make_pair(upload.chunkHashes[i], i));
+        if (first.second || length != DEDUP_CHUNK_SIZE) {
+            upload.missing[i] = true;
         } else {
-            clientSocket.sendData("400 BAD REQUEST: Invalid command.");
+            upload.repeatedChunks.push_back(std::make_pair(i, first.first->second));
         }
     }
+    close(fileFd);
+    return true;
 }
 
 
 void Server::cleanupClient(Socket &clientSocket, const char *username) {
     if (username == nullptr) {
-        std::cout << "Closing socket of not authenticated client." << std::endl;
+        logInfo("Closing socket of not authenticated client.");
     } else {
-        std::cout << "Closing socket of client " << username << "." << std::endl;
+        logInfo(std::string("Closing socket of client ") + username + ".");
     }
     clientSocket.closeS();
 }
@@ -356,8 +2068,13 @@ void Server::cleanupClient(Socket &clientSocket, const char *username) {
 
 ReceiveResult Server::receiveMessage(const Socket &clientSocket, char *buffer, const size_t bufferSize,
                                      const char *username) {
+    return classifyReceive(clientSocket.receiveData(buffer, bufferSize), username);
+}
+
+
+ReceiveResult Server::classifyReceive(const ssize_t bytesReceived, const char *username) {
     ReceiveResult result;
-    result.bytesReceived = clientSocket.receiveData(buffer, bufferSize);
+    result.bytesReceived = bytesReceived;
 
     if (username == nullptr) {
         username = "not authenticated yet";
@@ -391,6 +2108,21 @@ ReceiveResult Server::receiveMessage(const Socket &clientSocket, char *buffer, c
 }
 
 
+TransferOptions Server::negotiateOptions(const std::string &requestedOptions) const {
+    TransferOptions options = TransferOptions::parse(requestedOptions);
+    if (options.frameSize != 0) {
+        options.frameSize = std::max(MIN_FRAME_SIZE, std::min(options.frameSize, MAX_FRAME_SIZE));
+    }
+    options.compress = options.compress && compressionSupported();
+    if (options.compress) {
+        options.streamGet = false; // sendfile() cannot compress, so GETs stay framed
+    }
+    options.dedup = options.dedup && _chunkStore->isOpen();
+    options.inlineLimit = std::min(options.inlineLimit, MAX_INLINE_SIZE);
+    return options;
+}
+
+
 bool Server::isValidUsername(const std::string &username) {
     for (const char c: username) {
         if (!isalnum(c) || isspace(c)) {
@@ -403,13 +2135,69 @@ bool Server::isValidUsername(const std::string &username) {
 
 bool Server::isValidFilename(const std::string &filename) {
     if (filename.empty() || filename == "." || filename.find('/') != std::string::npos || filename.find('\\') !=
-        std::string::npos) {
+        std::string::npos || isPartialFilename(filename)) {
+        return false;
+    }
+    return true;
+}
+
+
+bool Server::parseOffset(const std::string &token, off_t &value) {
+    if (token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+
+    errno = 0;
+    const unsigned long long parsed = std::strtoull(token.c_str(), nullptr, 10);
+    if (errno == ERANGE || parsed > static_cast<unsigned long long>(std::numeric_limits<off_t>::max())) {
         return false;
     }
+    value = static_cast<off_t>(parsed);
     return true;
 }
 
 
+bool Server::isValidRequestId(const std::string &requestId) {
+    return !requestId.empty() && requestId.size() <= MAX_REQUEST_ID_LENGTH &&
+           requestId.find_first_not_of("0123456789") == std::string::npos;
+}
+
+
+std::string Server::partialFilename(const std::string &filename) {
+    return "." + filename + PARTIAL_SUFFIX;
+}
+
+
+std::string Server::stripedFilename(const std::string &filename) {
+    return "." + filename + STRIPED_SUFFIX;
+}
+
+
+std::string Server::deltaFilename(const std::string &filename) {
+    return "." + filename + DELTA_SUFFIX;
+}
+
+
+std::string Server::uploadFilename(const std::string &filename, const uint64_t number) {
+    return "." + filename + "." + std::to_string(number) + UPLOAD_SUFFIX;
+}
+
+
+bool Server::isPartialFilename(const std::string &filename) {
+    if (filename.empty() || filename[0] != '.') {
+        return false;
+    }
+
+    for (const std::string &suffix: {PARTIAL_SUFFIX, STRIPED_SUFFIX, DELTA_SUFFIX, UPLOAD_SUFFIX}) {
+        if (filename.size() > suffix.size() + 1 &&
+            filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
 bool Server::createClientFolderIfNotExists(const std::string &clientName) const {
     const std::string clientFolder = _directory + clientName;
 
@@ -421,39 +2209,55 @@ bool Server::createClientFolderIfNotExists(const std::string &clientName) const
             return false;
         }
     }
+    _metadataCache->addUser(clientName);
     return true;
 }
 
 
-std::string Server::getFilePermissions(const mode_t mode) {
-    std::ostringstream permissions;
-
-    permissions << ((mode & S_IRUSR) ? "r" : "-");
-    permissions << ((mode & S_IWUSR) ? "w" : "-");
-    permissions << ((mode & S_IXUSR) ? "x" : "-");
+bool Server::scanDirectory(const std::string &username, std::string &listing) const {
+    DIR *dir = opendir((_directory + username).c_str());
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
 
-    permissions << ((mode & S_IRGRP) ? "r" : "-");
-    permissions << ((mode & S_IWGRP) ? "w" : "-");
-    permissions << ((mode & S_IXGRP) ? "x" : "-");
+    dirent *entry;
+    std::ostringstream fileListStream;
+    bool firstEntry = true;
 
-    permissions << ((mode & S_IROTH) ? "r" : "-");
-    permissions << ((mode & S_IWOTH) ? "w" : "-");
-    permissions << ((mode & S_IXOTH) ? "x" : "-");
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_type == DT_REG && !isPartialFilename(entry->d_name)) {
+            if (!firstEntry) {
+                fileListStream << "\n";
+            }
+            fileListStream << entry->d_name;
+            firstEntry = false;
+        }
+    }
 
-    return permissions.str();
+    closedir(dir);
+    listing = fileListStream.str();
+    return true;
 }
 
 
-void Server::updateCommandStatistics(const std::string &command) {
-    std::lock_guard<std::mutex> lock(_statisticsMutex);
-    _commandStatistics[command]++;
+void Server::displayCommandStatistics() const {
+    std::cout << "\nCommand Statistics:\n" << statisticsReport() << std::endl;
 }
 
 
-void Server::displayCommandStatistics() {
-    std::lock_guard<std::mutex> lock(_statisticsMutex);
-    std::cout << "\nCommand Statistics:" << std::endl;
-    for (const std::pair<const std::string, int> &entry: _commandStatistics) {
-        std::cout << entry.first << ": " << entry.second << " time(s)" << std::endl;
+std::string Server::statisticsReport() const {
+    size_t running = 0, busy = 0, queued = 0;
+    std::string accepted;
+    for (const std::unique_ptr<ListenerShard> &shard: _shards) {
+        running += shard->threadPool.threadCount();
+        busy += shard->threadPool.activeThreads();
+        queued += shard->threadPool.queuedTasks();
+        accepted += " " + std::to_string(shard->acceptedClients);
     }
+    return _commandStatistics.snapshot() + "\n\nWorkers: " + std::to_string(running) + " running, " +
+           std::to_string(busy) + " busy, " + std::to_string(queued) + " tasks queued" +
+           (_shards.size() > 1 ? "\nClients accepted per listener shard:" + accepted : "") +
+           (_chunkStore->isOpen() ? "\n" + _chunkStore->report() : "") +
+           (_fileCache->isEnabled() ? "\n" + _fileCache->report() : "");
 }
@@ -1,24 +1,134 @@
-#include <iostream>
-
 #include "ThreadPool.h"
+#include "CpuAffinity.h"
+
+#include <algorithm>
+
+
+namespace {
+    // lets submit() from a worker push to that worker's own deque
+    thread_local const ThreadPool *currentPool = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+
+constexpr int ThreadPool::DEFAULT_IDLE_TIMEOUT_MS;
+
+
+Task::Task(Task &&other) noexcept : _operations(other._operations) {
+    if (_operations) {
+        _operations->move(&other._storage, &_storage);
+        other._operations = nullptr;
+    }
+}
+
+
+Task &Task::operator=(Task &&other) noexcept {
+    if (this != &other) {
+        if (_operations) {
+            _operations->destroy(&_storage);
+        }
+        _operations = other._operations;
+        if (_operations) {
+            _operations->move(&other._storage, &_storage);
+            other._operations = nullptr;
+        }
+    }
+    return *this;
+}
+
+
+Task::operator bool() const {
+    return _operations != nullptr;
+}
+
+
+void Task::operator()() {
+    _operations->invoke(&_storage);
+}
+
+
+Task::~Task() {
+    if (_operations) {
+        _operations->destroy(&_storage);
+    }
+}
+
+
+void ThreadPool::WorkerQueue::pushBack(Task &&task) {
+    if (size == slots.size()) {
+        std::vector<Task> grown(slots.size() * 2);
+        for (size_t i = 0; i < size; ++i) {
+            grown[i] = std::move(slots[(front + i) % slots.size()]);
+        }
+        slots.swap(grown);
+        front = 0;
+    }
+    slots[(front + size) % slots.size()] = std::move(task);
+    ++size;
+}
+
+
+void ThreadPool::WorkerQueue::popFront(Task &task) {
+    task = std::move(slots[front]);
+    front = (front + 1) % slots.size();
+    --size;
+}
+
+
+void ThreadPool::WorkerQueue::popBack(Task &task) {
+    --size;
+    task = std::move(slots[(front + size) % slots.size()]);
+}
+
+
+ThreadPool::ThreadPool(const size_t numThreads) : ThreadPool(numThreads, numThreads) {
+}
 
 
-ThreadPool::ThreadPool(const size_t numThreads) {
-    for (size_t i = 0; i < numThreads; ++i) {
-        _workers.emplace_back(&ThreadPool::executionCycle, this);
+ThreadPool::ThreadPool(const size_t minThreads, const size_t maxThreads, const std::chrono::milliseconds idleTimeout) :
+    _minThreads(std::max<size_t>(minThreads, 1)), _maxThreads(std::max(maxThreads, _minThreads)),
+    _idleTimeout(idleTimeout), _workers(_maxThreads) {
+    for (size_t i = 0; i < _maxThreads; ++i) {
+        _queues.emplace_back(new WorkerQueue());
+    }
+
+    std::lock_guard<std::mutex> lock(_idleMutex);
+    while (_threadCount < _minThreads) {
+        startWorker();
     }
 }
 
 
-void ThreadPool::submit(const std::function<void()> &task) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _taskQueue.push(task);
-    _cv.notify_one();
+void ThreadPool::submit(Task task) {
+    const size_t index = currentPool == this ? currentWorker : _nextQueue++ % _threadCount;
+
+    {
+        WorkerQueue &queue = *_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.pushBack(std::move(task));
+    }
+    // counted once it can be taken, so idle workers never spin on a task they cannot see yet
+    const long queued = ++_queuedTasks;
+
+    if (_idleWorkers > 0) {
+        std::lock_guard<std::mutex> lock(_idleMutex);
+        _cv.notify_one();
+    }
+    // a woken worker stays counted as idle until it runs, so a burst grows the pool past it
+    if (queued > 0 && _idleWorkers < static_cast<size_t>(queued) && _threadCount < _maxThreads) {
+        std::lock_guard<std::mutex> lock(_idleMutex);
+        if (!_stopFlag && _idleWorkers < static_cast<size_t>(queued) && _threadCount < _maxThreads) {
+            startWorker();
+        }
+    }
 }
 
 
 void ThreadPool::shutdown() {
-    _stopFlag = true;
+    {
+        std::lock_guard<std::mutex> lock(_idleMutex);
+        _stopFlag = true;
+    }
     _cv.notify_all();
 
     for (std::thread &worker: _workers) {
@@ -29,11 +139,31 @@ void ThreadPool::shutdown() {
 }
 
 
+void ThreadPool::setCpuAffinity(const std::vector<int> &cpus) {
+    std::lock_guard<std::mutex> lock(_idleMutex);
+    _cpus = cpus;
+    for (size_t index = 0; index < _threadCount && !_cpus.empty(); ++index) {
+        pinThread(_workers[index].native_handle(), _cpus);
+    }
+}
+
+
+size_t ThreadPool::threadCount() const {
+    return _threadCount;
+}
+
+
 size_t ThreadPool::activeThreads() const {
     return _activeThreads;
 }
 
 
+size_t ThreadPool::queuedTasks() const {
+    const long queued = _queuedTasks;
+    return queued > 0 ? queued : 0; // briefly negative while a taken task has not been counted yet
+}
+
+
 ThreadPool::~ThreadPool() {
     if (!_stopFlag) {
         shutdown();
@@ -41,20 +171,73 @@ ThreadPool::~ThreadPool() {
 }
 
 
-void ThreadPool::executionCycle() {
+// called with _idleMutex held
+void ThreadPool::startWorker() {
+    const size_t index = _threadCount;
+    if (_workers[index].joinable()) {
+        _workers[index].join(); // a worker that retired from this slot; it has already released the mutex
+    }
+    _workers[index] = std::thread(&ThreadPool::executionCycle, this, index);
+    if (!_cpus.empty()) {
+        pinThread(_workers[index].native_handle(), _cpus);
+    }
+    ++_threadCount;
+}
+
+
+void ThreadPool::executionCycle(const size_t index) {
+    currentPool = this;
+    currentWorker = index;
+
+    Task task;
     while (true) {
-        std::unique_lock<std::mutex> lock(_mutex);
-        _cv.wait(lock, [this] { return _stopFlag || !_taskQueue.empty(); });
+        if (takeTask(index, task)) {
+            --_queuedTasks;
+            ++_activeThreads;
+            task();
+            task = Task();
+            --_activeThreads;
+            continue;
+        }
 
-        if (_stopFlag && _taskQueue.empty()) {
+        std::unique_lock<std::mutex> lock(_idleMutex);
+        ++_idleWorkers;
+        const bool woken = _cv.wait_for(lock, _idleTimeout, [this] { return _stopFlag || _queuedTasks > 0; });
+        --_idleWorkers;
+
+        if (_stopFlag && _queuedTasks <= 0) {
             return;
         }
+        // only the newest worker retires, which keeps the running workers in the lowest slots
+        if (!woken && index + 1 == _threadCount && _threadCount > _minThreads) {
+            --_threadCount;
+            return;
+        }
+    }
+}
 
-        ++_activeThreads;
-        auto task = std::move(_taskQueue.front());
-        _taskQueue.pop();
-        lock.unlock();
-        task();
-        --_activeThreads;
+
+bool ThreadPool::takeTask(const size_t index, Task &task) {
+    {
+        WorkerQueue &own = *_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.size != 0) {
+            own.popFront(task);
+            return true;
+        }
+    }
+
+    // every slot is scanned: a task can land in the queue of a worker that retired just before it was pushed
+    for (size_t offset = 1; offset < _queues.size(); ++offset) {
+        WorkerQueue &victim = *_queues[(index + offset) % _queues.size()];
+        if (victim.size.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.size != 0) {
+            victim.popBack(task);
+            return true;
+        }
     }
+    return false;
 }
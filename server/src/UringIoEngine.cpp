@@ -0,0 +1,456 @@
+#include "UringIoEngine.h"
+
+#ifdef HAVE_IO_URING
+
+#include "Crc32c.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+constexpr unsigned RING_ENTRIES = 8;
+
+
+// Minimal io_uring wrapper on the raw system calls, so the engine does not depend on liburing.
+class UringIoEngine::Ring {
+public:
+    Ring() {
+        // completions are only processed inside io_uring_enter, so they never interrupt the blocking recv() that
+        // runs while a disk write is in flight (requires Linux 6.1)
+        io_uring_params params{};
+        params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        _ringFd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        if (_ringFd == -1) {
+            return;
+        }
+
+        _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+        }
+
+        _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd,
+                       IORING_OFF_SQ_RING);
+        _cqRing = singleMmap
+                      ? _sqRing
+                      : mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd,
+                             IORING_OFF_CQ_RING);
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd,
+                          IORING_OFF_SQES);
+        if (_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, _sqesSize);
+            }
+            release();
+            return;
+        }
+
+        char *sq = static_cast<char *>(_sqRing);
+        _sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        _sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        _sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        _sqes = static_cast<io_uring_sqe *>(sqes);
+
+        char *cq = static_cast<char *>(_cqRing);
+        _cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        _cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    ~Ring() {
+        if (_sqes != nullptr) {
+            munmap(_sqes, _sqesSize);
+        }
+        release();
+    }
+
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    bool ready() const {
+        return _sqes != nullptr;
+    }
+
+    // Each transfer keeps at most two entries in flight, far below RING_ENTRIES.
+    io_uring_sqe *nextSqe() {
+        const unsigned tail = *_sqTail + _queued;
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) > _sqMask) {
+            return nullptr;
+        }
+        io_uring_sqe *sqe = &_sqes[tail & _sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        _sqArray[tail & _sqMask] = tail & _sqMask;
+        ++_queued;
+        return sqe;
+    }
+
+    // Hands the queued entries to the kernel and optionally blocks until minComplete completions are available.
+    bool submit(const unsigned minComplete) {
+        __atomic_store_n(_sqTail, *_sqTail + _queued, __ATOMIC_RELEASE);
+        unsigned toSubmit = _queued;
+        _queued = 0;
+
+        while (toSubmit > 0 || minComplete > 0) {
+            const long submitted = syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete,
+                                           minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(submitted));
+            if (toSubmit == 0) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // Pops one completion, waiting for it if none is available yet.
+    bool reap(io_uring_cqe &completion) {
+        while (true) {
+            const unsigned head = *_cqHead;
+            if (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+                completion = _cqes[head & _cqMask];
+                __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (!submit(1)) {
+                return false;
+            }
+        }
+    }
+
+private:
+    void release() {
+        if (_cqRing != nullptr && _cqRing != MAP_FAILED && _cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+        if (_sqRing != nullptr && _sqRing != MAP_FAILED) {
+            munmap(_sqRing, _sqRingSize);
+        }
+        if (_ringFd != -1) {
+            close(_ringFd);
+        }
+        _sqRing = _cqRing = nullptr;
+        _sqes = nullptr;
+        _ringFd = -1;
+    }
+
+    int _ringFd{-1};
+    void *_sqRing{nullptr};
+    void *_cqRing{nullptr};
+    size_t _sqRingSize{0};
+    size_t _cqRingSize{0};
+    size_t _sqesSize{0};
+
+    unsigned *_sqHead{nullptr};
+    unsigned *_sqTail{nullptr};
+    unsigned _sqMask{0};
+    unsigned *_sqArray{nullptr};
+    io_uring_sqe *_sqes{nullptr};
+    unsigned _queued{0};
+
+    unsigned *_cqHead{nullptr};
+    unsigned *_cqTail{nullptr};
+    unsigned _cqMask{0};
+    io_uring_cqe *_cqes{nullptr};
+};
+
+
+namespace {
+    enum : uint64_t {
+        OP_READ,
+        OP_SEND,
+        OP_WRITE_SLOT // write of slot N uses OP_WRITE_SLOT + N
+    };
+
+    // A data frame in flight: length prefix and payload go out with one SENDMSG.
+    struct OutgoingFrame {
+        uint32_t netDataLen{0};
+        iovec parts[2]{};
+        msghdr message{};
+        size_t total{0};
+
+        void prepare(char *payload, const size_t length) {
+            netDataLen = htonl(static_cast<uint32_t>(length));
+            parts[0].iov_base = &netDataLen;
+            parts[0].iov_len = sizeof(netDataLen);
+            parts[1].iov_base = payload;
+            parts[1].iov_len = length;
+            message = msghdr{};
+            message.msg_iov = parts;
+            message.msg_iovlen = 2;
+            total = sizeof(netDataLen) + length;
+        }
+
+        // Finishes a short asynchronous send with blocking sendmsg calls.
+        bool complete(const int socketFd, size_t sentBytes) {
+            while (sentBytes < total) {
+                size_t skip = sentBytes;
+                iovec remaining[2];
+                int count = 0;
+                for (const iovec &part: parts) {
+                    if (skip >= part.iov_len) {
+                        skip -= part.iov_len;
+                        continue;
+                    }
+                    remaining[count].iov_base = static_cast<char *>(part.iov_base) + skip;
+                    remaining[count].iov_len = part.iov_len - skip;
+                    skip = 0;
+                    ++count;
+                }
+                msghdr rest{};
+                rest.msg_iov = remaining;
+                rest.msg_iovlen = count;
+                const ssize_t result = sendmsg(socketFd, &rest, MSG_NOSIGNAL);
+                if (result == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (result <= 0) {
+                    return false;
+                }
+                sentBytes += result;
+            }
+            return true;
+        }
+    };
+
+    void prepareRead(io_uring_sqe *sqe, const int fileFd, char *buffer, const size_t length, const off_t offset) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fileFd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = static_cast<uint32_t>(length);
+        sqe->off = static_cast<uint64_t>(offset);
+        sqe->user_data = OP_READ;
+    }
+}
+
+
+bool UringIoEngine::isSupported() {
+    Ring *ring = threadRing();
+    if (ring == nullptr) {
+        return false;
+    }
+
+    // the deferred task running in the ring setup already implies 6.1; probe the opcodes in case they are filtered
+    std::vector<char> probeStorage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probeStorage.data());
+    io_uring_params probeParams{};
+    const int probeFd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &probeParams));
+    if (probeFd == -1) {
+        return false;
+    }
+    const long probed = syscall(__NR_io_uring_register, probeFd, IORING_REGISTER_PROBE, probe, 256);
+    close(probeFd);
+    if (probed == -1) {
+        return false;
+    }
+
+    for (const unsigned opcode: {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_SENDMSG}) {
+        if (opcode > probe->last_op || (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+UringIoEngine::Ring *UringIoEngine::threadRing() {
+    static thread_local Ring ring;
+    return ring.ready() ? &ring : nullptr;
+}
+
+
+const char *UringIoEngine::name() const {
+    return "io_uring";
+}
+
+
+bool UringIoEngine::sendFileFrames(const Socket &socket, const int fileFd, const off_t offset, const off_t length,
+                                   const size_t frameSize, uint32_t *crc) {
+    Ring *ring = threadRing();
+    if (ring == nullptr) {
+        return _fallback.sendFileFrames(socket, fileFd, offset, length, frameSize, crc);
+    }
+
+    std::vector<char> buffers[2] = {std::vector<char>(frameSize), std::vector<char>(frameSize)};
+    OutgoingFrame frame;
+    const off_t end = offset + length;
+    off_t readPosition = offset;
+    int current = 0;
+    ssize_t currentBytes = 0;
+
+    if (readPosition < end) {
+        currentBytes = pread(fileFd, buffers[current].data(), std::min<off_t>(frameSize, end - readPosition),
+                             readPosition);
+        if (currentBytes <= 0) {
+            return false;
+        }
+        readPosition += currentBytes;
+    }
+
+    while (currentBytes > 0) {
+        // the send of this frame and the read of the next one go to the kernel in a single io_uring_enter
+        const bool readAhead = readPosition < end;
+        if (readAhead) {
+            prepareRead(ring->nextSqe(), fileFd, buffers[1 - current].data(),
+                        std::min<off_t>(frameSize, end - readPosition), readPosition);
+        }
+
+        frame.prepare(buffers[current].data(), currentBytes);
+        io_uring_sqe *sendSqe = ring->nextSqe();
+        sendSqe->opcode = IORING_OP_SENDMSG;
+        sendSqe->fd = socket.getS();
+        sendSqe->addr = reinterpret_cast<uint64_t>(&frame.message);
+        sendSqe->msg_flags = MSG_NOSIGNAL;
+        sendSqe->user_data = OP_SEND;
+
+        if (!ring->submit(0)) {
+            return false;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, buffers[current].data(), currentBytes); // overlaps the send, which only reads it
+        }
+
+        ssize_t nextBytes = 0;
+        bool sent = false;
+        for (int pending = readAhead ? 2 : 1; pending > 0; --pending) {
+            io_uring_cqe completion{};
+            if (!ring->reap(completion)) {
+                return false;
+            }
+            if (completion.user_data == OP_READ) {
+                nextBytes = completion.res;
+            } else {
+                sent = completion.res > 0 &&
+                       frame.complete(socket.getS(), static_cast<size_t>(completion.res));
+            }
+        }
+        if (!sent || (readAhead && nextBytes <= 0)) {
+            return false;
+        }
+
+        current = 1 - current;
+        currentBytes = readAhead ? nextBytes : 0;
+        readPosition += currentBytes;
+    }
+    return true;
+}
+
+
+off_t UringIoEngine::receiveFileFrames(const Socket &socket, const int fileFd, const off_t offset,
+                                       const size_t frameSize, const off_t limit, uint32_t *crc) {
+    Ring *ring = threadRing();
+    if (ring == nullptr) {
+        return _fallback.receiveFileFrames(socket, fileFd, offset, frameSize, limit, crc);
+    }
+
+    std::vector<char> buffers[2] = {std::vector<char>(frameSize), std::vector<char>(frameSize)};
+    ssize_t pendingBytes[2] = {0, 0};
+    off_t written = 0;
+    int failure = 0;
+
+    // waits for the disk write that still owns a slot, so the buffer can be reused or released
+    const auto settle = [&](const int slot) {
+        while (pendingBytes[slot] != 0) {
+            io_uring_cqe completion{};
+            if (!ring->reap(completion)) {
+                failure = errno;
+                pendingBytes[0] = pendingBytes[1] = 0;
+                return;
+            }
+            const int completedSlot = static_cast<int>(completion.user_data - OP_WRITE_SLOT);
+            if (completion.res != pendingBytes[completedSlot] && failure == 0) {
+                failure = completion.res < 0 ? -completion.res : EIO;
+            }
+            pendingBytes[completedSlot] = 0;
+        }
+    };
+
+    for (int slot = 0; failure == 0; slot = 1 - slot) {
+        settle(slot);
+        if (failure != 0) {
+            break;
+        }
+
+        const ssize_t bytesReceived = socket.receiveData(buffers[slot].data(), buffers[slot].size());
+        if (bytesReceived == 0) {
+            break; // end-of-transfer frame
+        }
+        if (bytesReceived < 0) {
+            failure = errno;
+            break;
+        }
+        if (written + bytesReceived > limit) {
+            failure = EMSGSIZE;
+            break;
+        }
+
+        io_uring_sqe *sqe = ring->nextSqe();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fileFd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffers[slot].data());
+        sqe->len = static_cast<uint32_t>(bytesReceived);
+        sqe->off = static_cast<uint64_t>(offset + written);
+        sqe->user_data = OP_WRITE_SLOT + slot;
+        if (!ring->submit(0)) {
+            failure = errno;
+            break;
+        }
+        pendingBytes[slot] = bytesReceived;
+        written += bytesReceived;
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, buffers[slot].data(), bytesReceived); // overlaps the disk write
+        }
+    }
+
+    settle(0);
+    settle(1);
+    if (failure != 0) {
+        errno = failure;
+        return -1;
+    }
+    return written;
+}
+
+#else
+
+bool UringIoEngine::isSupported() {
+    return false;
+}
+
+
+const char *UringIoEngine::name() const {
+    return "io_uring";
+}
+
+
+bool UringIoEngine::sendFileFrames(const Socket &socket, const int fileFd, const off_t offset, const off_t length,
+                                   const size_t frameSize, uint32_t *crc) {
+    return _fallback.sendFileFrames(socket, fileFd, offset, length, frameSize, crc);
+}
+
+
+off_t UringIoEngine::receiveFileFrames(const Socket &socket, const int fileFd, const off_t offset,
+                                       const size_t frameSize, const off_t limit, uint32_t *crc) {
+    return _fallback.receiveFileFrames(socket, fileFd, offset, frameSize, limit, crc);
+}
+
+#endif
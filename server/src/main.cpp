@@ -1,10 +1,62 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
+#include "Logger.h"
 #include "Server.h"
 
 
-int main() {
-    Server server("files/", 8);
+bool parseLogLevel(const char *name, LogLevel &level) {
+    const char *names[] = {"debug", "info", "warning", "error", "off"};
+    for (int i = 0; i < 5; ++i) {
+        if (std::strcmp(name, names[i]) == 0) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int main(const int argc, char **argv) {
+    IoEngineType ioEngine = IoEngineType::BLOCKING;
+    size_t minWorkers = 8, maxWorkers = 64;
+    size_t fileCacheBytes = FileCache::DEFAULT_BUDGET;
+    size_t listenerShards = 1;
+    bool pinShards = false;
+    off_t maxFileSize = Server::DEFAULT_MAX_FILE_SIZE;
+    for (int i = 1; i < argc; ++i) {
+        LogLevel logLevel;
+        if (std::strcmp(argv[i], "--io-uring") == 0) {
+            ioEngine = IoEngineType::URING;
+        } else if (std::strncmp(argv[i], "--log-level=", 12) == 0 && parseLogLevel(argv[i] + 12, logLevel)) {
+            Logger::instance().setLevel(logLevel);
+        } else if (std::strncmp(argv[i], "--min-workers=", 14) == 0 && std::atoi(argv[i] + 14) > 0) {
+            minWorkers = std::atoi(argv[i] + 14);
+        } else if (std::strncmp(argv[i], "--max-workers=", 14) == 0 && std::atoi(argv[i] + 14) > 0) {
+            maxWorkers = std::atoi(argv[i] + 14);
+        } else if (std::strncmp(argv[i], "--file-cache=", 13) == 0 && std::isdigit(argv[i][13])) {
+            fileCacheBytes = std::strtoull(argv[i] + 13, nullptr, 10) * 1024 * 1024;
+        } else if (std::strncmp(argv[i], "--log-sample=", 13) == 0 && std::atoi(argv[i] + 13) > 0) {
+            Logger::instance().setSampling(std::atoi(argv[i] + 13));
+        } else if (std::strncmp(argv[i], "--shards=", 9) == 0 && std::atoi(argv[i] + 9) > 0) {
+            listenerShards = std::atoi(argv[i] + 9);
+        } else if (std::strcmp(argv[i], "--pin-shards") == 0) {
+            pinShards = true;
+        } else if (std::strncmp(argv[i], "--max-file-size=", 16) == 0 && std::atoi(argv[i] + 16) > 0) {
+            maxFileSize = static_cast<off_t>(std::strtoull(argv[i] + 16, nullptr, 10)) * 1024 * 1024 * 1024;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--io-uring] [--min-workers=N] [--max-workers=N]"
+                    << " [--log-level=debug|info|warning|error|off] [--log-sample=N]" << " [--file-cache=MiB]"
+                    << " [--shards=N] [--pin-shards] [--max-file-size=GiB]" << std::endl;
+            return 1;
+        }
+    }
+
+    Server server("files/", minWorkers, std::max(minWorkers, maxWorkers), 4096, ioEngine, fileCacheBytes,
+                  listenerShards, pinShards, maxFileSize);
     std::thread serverThread([&server] { server.start(9080); });
 
     while (true) {
@@ -16,4 +68,4 @@ int main() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+
+// A deduplicated PUT may skip chunks the server's store already holds, so the chunk hashes alone would hand out
+// other users' files. After the chunks it did send, the client proves that it holds the ones taken from the store:
+// it sends the SHA-256 of a nonce the server picked for this upload followed by those chunks, in file order. The
+// server recomputes the digest from its copy and links the stored data only when both agree.
+constexpr size_t CHUNK_PROOF_NONCE_SIZE = 16;
+
+// SHA-256 of nonce and the DEDUP_CHUNK_SIZE chunks of the file marked in proven; empty if the file cannot be read.
+// chunkCrcs, if given, receives the CRC-32C of every chunk hashed at its index.
+std::string chunkProof(int fileFd, off_t fileSize, const std::vector<bool> &proven, const std::string &nonce,
+                       std::vector<uint32_t> *chunkCrcs = nullptr);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#include "Socket.h"
+
+
+// CRC-32C (Castagnoli), the checksum iSCSI and ext4 use. Same calling convention as zlib's crc32(): start from 0
+// and pass the previous result back in to checksum data that arrives in pieces. Picks the fastest the CPU offers:
+// folding with 512-bit carry-less multiplication (VPCLMULQDQ), the SSE4.2 crc32 instruction, or lookup tables.
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+// CRC of A followed by B, given both CRCs and the length of B, for pieces checksummed separately or out of order
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t sizeB);
+
+// CRC of [offset, offset + length) of a file; false if it cannot be read that far
+bool crc32cFile(int fileFd, off_t offset, off_t length, uint32_t &crc);
+
+// "vpclmulqdq", "sse4.2" or "portable"
+const char *crc32cImplementation();
+
+
+// crc32cCombine() for many pieces of one size: the shift over the piece length is tabulated once
+class Crc32cAppender {
+public:
+    explicit Crc32cAppender(uint64_t pieceSize);
+
+    uint32_t append(uint32_t crc, uint32_t pieceCrc) const {
+        return _shift[0][crc & 0xff] ^ _shift[1][crc >> 8 & 0xff] ^ _shift[2][crc >> 16 & 0xff] ^
+               _shift[3][crc >> 24] ^ pieceCrc;
+    }
+
+private:
+    uint32_t _shift[4][256];
+};
+
+
+// With "crc=1" every GET/PUT transfer ends with a "CRC32C 1a2b3c4d" message after its data, carrying the CRC-32C of
+// the file bytes it moved. Receiving fails with errno EPROTO when the next message is something else.
+bool sendChecksumTrailer(const Socket &socket, uint32_t crc);
+bool receiveChecksumTrailer(const Socket &socket, uint32_t &crc);
+std::string formatChecksum(uint32_t crc);
+// the inverse of formatChecksum(): exactly eight lowercase hex digits
+bool parseChecksum(const std::string &text, uint32_t &crc);
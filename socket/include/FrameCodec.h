@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "Socket.h"
+
+
+struct z_stream_s;
+
+
+// Per-frame zlib compression for negotiated "compress=zlib" transfers. Every data frame starts with a marker byte
+// saying whether the rest is raw or a self-contained raw-deflate stream, so frames decode independently and
+// incompressible data can be sent as is. A frame never expands to more than frameSize bytes when decoded.
+class FrameCompressor {
+public:
+    explicit FrameCompressor(size_t frameSize);
+
+    // the caller fills up to frameSize bytes here, then passes the byte count to sendFrame()
+    char *input();
+    ssize_t sendFrame(const Socket &socket, size_t size);
+
+    uint64_t rawBytes() const;
+    uint64_t wireBytes() const;
+
+    ~FrameCompressor();
+
+    FrameCompressor(const FrameCompressor &) = delete;
+    FrameCompressor &operator=(const FrameCompressor &) = delete;
+
+private:
+    std::vector<char> _input;  // marker byte followed by the raw frame
+    std::vector<char> _output; // marker byte followed by the deflated frame
+    z_stream_s *_stream{nullptr};
+
+    unsigned _skipFrames{0};   // frames left to send raw after an incompressible one
+    unsigned _skipBackoff{1};
+    uint64_t _rawBytes{0};
+    uint64_t _wireBytes{0};
+};
+
+
+class FrameDecompressor {
+public:
+    explicit FrameDecompressor(size_t frameSize);
+
+    // Returns the decoded size of the next frame, 0 for the end-of-transfer frame, or -1 with errno set
+    // (EPROTO for a corrupt frame). data stays valid until the next call.
+    ssize_t receiveFrame(const Socket &socket, const char *&data);
+
+    uint64_t rawBytes() const;
+    uint64_t wireBytes() const;
+
+    ~FrameDecompressor();
+
+    FrameDecompressor(const FrameDecompressor &) = delete;
+    FrameDecompressor &operator=(const FrameDecompressor &) = delete;
+
+private:
+    const size_t _frameSize;
+    std::vector<char> _output;
+    z_stream_s *_stream{nullptr};
+
+    uint64_t _rawBytes{0};
+    uint64_t _wireBytes{0};
+};
+
+
+bool compressionSupported();
+
+// "compressed 6.2x (48.0 MiB as 7.7 MiB, 310.5 MiB/s)", with the throughput measured on the uncompressed bytes
+std::string compressionSummary(uint64_t rawBytes, uint64_t wireBytes, std::chrono::steady_clock::duration elapsed);
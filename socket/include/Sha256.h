@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+
+
+// Incremental SHA-256, used to address deduplicated chunks on both sides of a PUT.
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void *data, size_t size);
+    // writes SHA256_DIGEST_SIZE bytes; the object must not be updated afterwards
+    void finish(unsigned char *digest);
+
+    static std::string digest(const void *data, size_t size);
+    static std::string toHex(const std::string &digest);
+
+private:
+    uint32_t _state[8];
+    unsigned char _block[64];
+    size_t _blockSize{0};
+    uint64_t _totalSize{0};
+
+    void transform(const unsigned char *block);
+};
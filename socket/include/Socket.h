@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <netinet/in.h>
 
@@ -7,10 +8,16 @@
 // Constants for response messages
 const std::string RESPONSE_OK = "200 OK";
 const std::string RESPONSE_ACK = "ACK";
+const std::string RESPONSE_NAK = "NAK"; // declines a GET after its "200 OK" (e.g. to fetch it in stripes) or a resumed PUT
 
 // Constants for buffer sizes
 constexpr int FILE_BUFFER_SIZE = 1024;
 constexpr int MESSAGE_SIZE = 512;
+constexpr int STREAM_BUFFER_SIZE = 64 * 1024;
+constexpr int RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+
+struct ReceiveBuffer;
 
 
 class Socket {
@@ -30,16 +37,33 @@ public:
 
     ssize_t sendData(const char *data, size_t dataLen = std::string::npos) const;
     ssize_t receiveData(char *buffer, size_t bufferSize) const;
+    ssize_t receiveView(const char *&data, size_t maxSize) const;
+    bool receiveAvailable() const;
+    bool hasBufferedFrame() const;
+
+    ssize_t sendFile(int fileFd, off_t offset, size_t count) const;
+    ssize_t sendRaw(const char *data, size_t count) const;
+    ssize_t receiveFile(int fileFd, size_t count) const;
 
     bool setRecvTimeout() const;
+    bool setNonBlocking(bool nonBlocking) const;
+    bool setNoDelay(bool enabled) const;
+    bool setCork(bool enabled) const;
+    bool setReuseAddress(bool enabled) const;
+    bool setReusePort(bool enabled) const; // lets several listeners bind one port, the kernel spreading connections
 
     int getS() const;
     void setS(int s);
 
-    void setTimeoutSeconds(int timeoutSeconds);
+    bool setTimeoutSeconds(int timeoutSeconds);
 
 private:
     int _socketFd;
     int _timeoutSeconds{-1};
     bool _shutdownFlag{false};
+
+    // shared by copies of the socket, since they all read from the same connection
+    std::shared_ptr<ReceiveBuffer> _receiveBuffer;
+
+    bool fillReceiveBuffer(size_t needed) const;
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// Frame sizes a client may negotiate with "frame=<bytes>"; sessions without it keep FILE_BUFFER_SIZE frames
+constexpr uint32_t MIN_FRAME_SIZE = 64 * 1024;
+constexpr uint32_t MAX_FRAME_SIZE = 4 * 1024 * 1024;
+
+// GETs of at most "inline=<bytes>" are answered with a single frame holding the status line and the data,
+// "200 OK INLINE <size>[ <crc>]\n<data>", with no ACK, terminator or trailer; the CRC-32C is there with "crc=1"
+constexpr uint32_t MAX_INLINE_SIZE = 64 * 1024;
+const std::string RESPONSE_INLINE = "200 OK INLINE ";
+
+// Deduplicated PUTs ("dedup=1") describe the file as SHA-256 hashes of chunks this large; the last one may be shorter
+constexpr uint32_t DEDUP_CHUNK_SIZE = 1024 * 1024;
+// and announce those hashes in frames of at most this many
+constexpr uint32_t DEDUP_HASH_BATCH = 4096;
+
+// Optional protocol features, requested by the client after the version string ("2.0 stream=1")
+// and echoed back by the server with the subset it accepted ("200 OK stream=1").
+struct TransferOptions {
+    bool streamGet{false}; // GET answers "200 OK <size>" and sends the file as one unframed byte stream
+    uint32_t frameSize{0}; // payload size of GET/PUT data frames, 0 when not negotiated
+    bool pipelined{false}; // protocol 3.0 session: tagged requests and GET data without the ACK round trip
+    bool compress{false}; // GET/PUT data frames are zlib-compressed one by one (see FrameCodec); GETs stay framed
+    bool dedup{false}; // PUT may send chunk hashes first and only the chunks the server's store lacks
+    bool delta{false}; // PUT of a file the server already has may send only the changes (see DeltaSync)
+    bool checksum{false}; // GET/PUT data is followed by its CRC-32C, checked by the receiver (see Crc32c)
+    uint32_t inlineLimit{0}; // GETs of at most this many bytes come back inline, 0 when not negotiated
+
+    bool empty() const;
+    size_t dataFrameSize() const;
+    std::string toString() const;
+
+    static TransferOptions parse(const std::string &text);
+};
@@ -0,0 +1,34 @@
+#include "ChunkProof.h"
+#include "Crc32c.h"
+#include "Sha256.h"
+#include "TransferOptions.h"
+
+#include <algorithm>
+#include <unistd.h>
+
+
+std::string chunkProof(const int fileFd, const off_t fileSize, const std::vector<bool> &proven,
+                       const std::string &nonce, std::vector<uint32_t> *chunkCrcs) {
+    Sha256 hash;
+    hash.update(nonce.data(), nonce.size());
+
+    std::vector<char> buffer(DEDUP_CHUNK_SIZE);
+    for (size_t i = 0; i < proven.size(); ++i) {
+        if (!proven[i]) {
+            continue;
+        }
+        const off_t offset = static_cast<off_t>(i) * DEDUP_CHUNK_SIZE;
+        const off_t length = std::min<off_t>(DEDUP_CHUNK_SIZE, fileSize - offset);
+        if (length <= 0 || pread(fileFd, buffer.data(), length, offset) != length) {
+            return "";
+        }
+        hash.update(buffer.data(), length);
+        if (chunkCrcs) {
+            (*chunkCrcs)[i] = crc32c(0, buffer.data(), length);
+        }
+    }
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    hash.finish(digest);
+    return std::string(reinterpret_cast<const char *>(digest), sizeof(digest));
+}
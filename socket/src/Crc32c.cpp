@@ -0,0 +1,370 @@
+#include "Crc32c.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HARDWARE
+#include <immintrin.h>
+#if (defined(__clang__) && __clang_major__ >= 6) || (!defined(__clang__) && __GNUC__ >= 8)
+#define CRC32C_VPCLMULQDQ
+#endif
+#endif
+
+
+namespace {
+    constexpr uint32_t POLYNOMIAL = 0x82f63b78; // reversed Castagnoli polynomial
+    constexpr size_t FILE_CHUNK_SIZE = 256 * 1024; // stays in L2 between pread() and checksumming
+    const char TRAILER_PREFIX[] = "CRC32C ";
+
+    // GF(2) 32x32 matrices as columns: operator[n] is the image of bit n
+    uint32_t applyOperator(const uint32_t *matrix, uint32_t vector) {
+        uint32_t sum = 0;
+        for (; vector != 0; vector >>= 1, ++matrix) {
+            if (vector & 1) {
+                sum ^= *matrix;
+            }
+        }
+        return sum;
+    }
+
+    void multiplyOperators(uint32_t *result, const uint32_t *a, const uint32_t *b) {
+        for (int n = 0; n < 32; ++n) {
+            result[n] = applyOperator(a, b[n]);
+        }
+    }
+
+    // the operator that feeds size zero bytes through the CRC register
+    void zeroBytesOperator(uint64_t size, uint32_t *result) {
+        uint32_t power[32], scratch[32];
+        power[0] = POLYNOMIAL; // one zero bit
+        for (int n = 1; n < 32; ++n) {
+            power[n] = 1u << (n - 1);
+        }
+        for (int i = 0; i < 3; ++i) {
+            multiplyOperators(scratch, power, power);
+            memcpy(power, scratch, sizeof(power));
+        }
+
+        for (int n = 0; n < 32; ++n) {
+            result[n] = 1u << n;
+        }
+        for (; size != 0; size >>= 1) {
+            if (size & 1) {
+                multiplyOperators(scratch, power, result);
+                memcpy(result, scratch, sizeof(scratch));
+            }
+            multiplyOperators(scratch, power, power);
+            memcpy(power, scratch, sizeof(power));
+        }
+    }
+
+    // slicing-by-8: table[k][b] is the CRC of byte b followed by k zero bytes
+    struct SlicingTables {
+        uint32_t table[8][256];
+
+        SlicingTables() {
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t crc = n;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = crc & 1 ? crc >> 1 ^ POLYNOMIAL : crc >> 1;
+                }
+                table[0][n] = crc;
+            }
+            for (uint32_t n = 0; n < 256; ++n) {
+                for (int k = 1; k < 8; ++k) {
+                    table[k][n] = table[k - 1][n] >> 8 ^ table[0][table[k - 1][n] & 0xff];
+                }
+            }
+        }
+    };
+
+    uint32_t crc32cPortable(uint32_t crc, const unsigned char *data, size_t size) {
+        static const SlicingTables tables;
+        const uint32_t (&table)[8][256] = tables.table;
+
+        crc = ~crc;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            word ^= crc;
+            crc = table[7][word & 0xff] ^ table[6][word >> 8 & 0xff] ^ table[5][word >> 16 & 0xff] ^
+                  table[4][word >> 24 & 0xff] ^ table[3][word >> 32 & 0xff] ^ table[2][word >> 40 & 0xff] ^
+                  table[1][word >> 48 & 0xff] ^ table[0][word >> 56];
+        }
+#endif
+        for (; size > 0; ++data, --size) {
+            crc = crc >> 8 ^ table[0][(crc ^ *data) & 0xff];
+        }
+        return ~crc;
+    }
+
+#ifdef CRC32C_HARDWARE
+    // One crc32 instruction has a latency of three cycles but a throughput of one per cycle, so the data is cut
+    // into three lanes checksummed side by side and joined with a tabulated shift (Mark Adler's layout).
+    constexpr size_t LONG_LANE = 8192;
+    constexpr size_t SHORT_LANE = 256;
+
+    inline uint64_t load64(const unsigned char *data) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t crc32cHardware(const uint32_t crc, const unsigned char *data, size_t size) {
+        static const Crc32cAppender longShift(LONG_LANE);
+        static const Crc32cAppender shortShift(SHORT_LANE);
+
+        uint64_t crc0 = ~crc;
+        for (; size > 0 && reinterpret_cast<uintptr_t>(data) & 7; ++data, --size) {
+            crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data);
+        }
+
+        for (; size >= 3 * LONG_LANE; data += 3 * LONG_LANE, size -= 3 * LONG_LANE) {
+            uint64_t crc1 = 0, crc2 = 0;
+            for (const unsigned char *word = data; word < data + LONG_LANE; word += 8) {
+                crc0 = _mm_crc32_u64(crc0, load64(word));
+                crc1 = _mm_crc32_u64(crc1, load64(word + LONG_LANE));
+                crc2 = _mm_crc32_u64(crc2, load64(word + 2 * LONG_LANE));
+            }
+            crc0 = longShift.append(static_cast<uint32_t>(crc0), static_cast<uint32_t>(crc1));
+            crc0 = longShift.append(static_cast<uint32_t>(crc0), static_cast<uint32_t>(crc2));
+        }
+
+        for (; size >= 3 * SHORT_LANE; data += 3 * SHORT_LANE, size -= 3 * SHORT_LANE) {
+            uint64_t crc1 = 0, crc2 = 0;
+            for (const unsigned char *word = data; word < data + SHORT_LANE; word += 8) {
+                crc0 = _mm_crc32_u64(crc0, load64(word));
+                crc1 = _mm_crc32_u64(crc1, load64(word + SHORT_LANE));
+                crc2 = _mm_crc32_u64(crc2, load64(word + 2 * SHORT_LANE));
+            }
+            crc0 = shortShift.append(static_cast<uint32_t>(crc0), static_cast<uint32_t>(crc1));
+            crc0 = shortShift.append(static_cast<uint32_t>(crc0), static_cast<uint32_t>(crc2));
+        }
+
+        for (; size >= 8; data += 8, size -= 8) {
+            crc0 = _mm_crc32_u64(crc0, load64(data));
+        }
+        for (; size > 0; ++data, --size) {
+            crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data);
+        }
+        return ~static_cast<uint32_t>(crc0);
+    }
+#endif
+
+#ifdef CRC32C_VPCLMULQDQ
+    // Folding: 16 bytes followed by N more add to the CRC what (those bytes * x^8N mod P) adds in place of the 16
+    // bytes N later, and two carry-less multiplications by powers of x give such a value in 96 bits. Four 512-bit
+    // accumulators fold 256 bytes per round; the last 16 bytes are reduced with the crc32 instruction.
+    constexpr size_t FOLD_BLOCK = 256;
+
+    // x^exponent mod P, bit-reflected like the CRC register
+    uint32_t xPower(unsigned exponent) {
+        uint32_t value = 0x80000000;
+        for (; exponent > 0; --exponent) {
+            value = value & 1 ? value >> 1 ^ POLYNOMIAL : value >> 1;
+        }
+        return value;
+    }
+
+    // the low 64 bits of a lane are the earlier bytes, so they travel 64 bits further
+    __attribute__((target("sse4.2")))
+    __m128i foldConstant(const unsigned distance) {
+        return _mm_set_epi64x(xPower(8 * distance - 33), xPower(8 * distance + 31));
+    }
+
+    __attribute__((target("avx512f")))
+    __m512i wideFoldConstant(const unsigned distance) {
+        const long long low = xPower(8 * distance + 31), high = xPower(8 * distance - 33);
+        return _mm512_set_epi64(high, low, high, low, high, low, high, low);
+    }
+
+    __attribute__((target("pclmul,sse4.2")))
+    inline __m128i fold(const __m128i value, const __m128i constant) {
+        return _mm_xor_si128(_mm_clmulepi64_si128(value, constant, 0x00), _mm_clmulepi64_si128(value, constant, 0x11));
+    }
+
+    __attribute__((target("avx512f,vpclmulqdq")))
+    inline __m512i fold(const __m512i value, const __m512i constant) {
+        return _mm512_xor_si512(_mm512_clmulepi64_epi128(value, constant, 0x00),
+                                _mm512_clmulepi64_epi128(value, constant, 0x11));
+    }
+
+    __attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.2")))
+    uint32_t crc32cFolding(const uint32_t crc, const unsigned char *data, size_t size) {
+        if (size < FOLD_BLOCK) {
+            return crc32cHardware(crc, data, size);
+        }
+        static const __m512i fold256 = wideFoldConstant(256);
+        static const __m512i fold192 = wideFoldConstant(192);
+        static const __m512i fold128 = wideFoldConstant(128);
+        static const __m512i fold64 = wideFoldConstant(64);
+        static const __m128i fold48 = foldConstant(48);
+        static const __m128i fold32 = foldConstant(32);
+        static const __m128i fold16 = foldConstant(16);
+
+        // the initial register is the same as XORing it into the first four bytes
+        __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512(data), _mm512_castsi128_si512(_mm_cvtsi32_si128(~crc)));
+        __m512i x1 = _mm512_loadu_si512(data + 64);
+        __m512i x2 = _mm512_loadu_si512(data + 128);
+        __m512i x3 = _mm512_loadu_si512(data + 192);
+        for (data += FOLD_BLOCK, size -= FOLD_BLOCK; size >= FOLD_BLOCK; data += FOLD_BLOCK, size -= FOLD_BLOCK) {
+            x0 = _mm512_xor_si512(fold(x0, fold256), _mm512_loadu_si512(data));
+            x1 = _mm512_xor_si512(fold(x1, fold256), _mm512_loadu_si512(data + 64));
+            x2 = _mm512_xor_si512(fold(x2, fold256), _mm512_loadu_si512(data + 128));
+            x3 = _mm512_xor_si512(fold(x3, fold256), _mm512_loadu_si512(data + 192));
+        }
+
+        __m512i wide = _mm512_xor_si512(_mm512_xor_si512(fold(x0, fold192), fold(x1, fold128)),
+                                        _mm512_xor_si512(fold(x2, fold64), x3));
+        for (; size >= 64; data += 64, size -= 64) {
+            wide = _mm512_xor_si512(fold(wide, fold64), _mm512_loadu_si512(data));
+        }
+        __m128i lanes[4];
+        _mm512_storeu_si512(lanes, wide);
+        __m128i narrow = _mm_xor_si128(_mm_xor_si128(fold(lanes[0], fold48), fold(lanes[1], fold32)),
+                                       _mm_xor_si128(fold(lanes[2], fold16), lanes[3]));
+        for (; size >= 16; data += 16, size -= 16) {
+            narrow = _mm_xor_si128(fold(narrow, fold16), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+        }
+
+        uint64_t register64 = _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(narrow)));
+        register64 = _mm_crc32_u64(register64, static_cast<uint64_t>(_mm_extract_epi64(narrow, 1)));
+        return crc32cHardware(~static_cast<uint32_t>(register64), data, size);
+    }
+#endif
+
+    using Crc32cFunction = uint32_t (*)(uint32_t, const unsigned char *, size_t);
+
+    Crc32cFunction selectImplementation() {
+#ifdef CRC32C_HARDWARE
+        __builtin_cpu_init(); // may run before libgcc's own initialisation
+#ifdef CRC32C_VPCLMULQDQ
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq") &&
+            __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.2")) {
+            return crc32cFolding;
+        }
+#endif
+        if (__builtin_cpu_supports("sse4.2")) {
+            return crc32cHardware;
+        }
+#endif
+        return crc32cPortable;
+    }
+
+    Crc32cFunction implementation() {
+        static const Crc32cFunction selected = selectImplementation();
+        return selected;
+    }
+}
+
+
+uint32_t crc32c(const uint32_t crc, const void *data, const size_t size) {
+    return implementation()(crc, static_cast<const unsigned char *>(data), size);
+}
+
+
+uint32_t crc32cCombine(const uint32_t crcA, const uint32_t crcB, const uint64_t sizeB) {
+    uint32_t shift[32];
+    zeroBytesOperator(sizeB, shift);
+    return applyOperator(shift, crcA) ^ crcB;
+}
+
+
+bool crc32cFile(const int fileFd, off_t offset, off_t length, uint32_t &crc) {
+    std::vector<char> buffer(FILE_CHUNK_SIZE);
+    crc = 0;
+    while (length > 0) {
+        const ssize_t bytesRead = pread(fileFd, buffer.data(), std::min<off_t>(length, buffer.size()), offset);
+        if (bytesRead <= 0) {
+            return false;
+        }
+        crc = crc32c(crc, buffer.data(), bytesRead);
+        offset += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+
+const char *crc32cImplementation() {
+#ifdef CRC32C_VPCLMULQDQ
+    if (implementation() == crc32cFolding) {
+        return "vpclmulqdq";
+    }
+#endif
+#ifdef CRC32C_HARDWARE
+    if (implementation() == crc32cHardware) {
+        return "sse4.2";
+    }
+#endif
+    return "portable";
+}
+
+
+Crc32cAppender::Crc32cAppender(const uint64_t pieceSize) {
+    uint32_t shift[32];
+    zeroBytesOperator(pieceSize, shift);
+    for (uint32_t n = 0; n < 256; ++n) {
+        _shift[0][n] = applyOperator(shift, n);
+        _shift[1][n] = applyOperator(shift, n << 8);
+        _shift[2][n] = applyOperator(shift, n << 16);
+        _shift[3][n] = applyOperator(shift, n << 24);
+    }
+}
+
+
+std::string formatChecksum(const uint32_t crc) {
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08x", crc);
+    return hex;
+}
+
+
+bool parseChecksum(const std::string &text, uint32_t &crc) {
+    if (text.size() != 8) {
+        return false;
+    }
+    crc = 0;
+    for (const char c: text) {
+        if (c >= '0' && c <= '9') {
+            crc = crc << 4 | static_cast<uint32_t>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            crc = crc << 4 | static_cast<uint32_t>(c - 'a' + 10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool sendChecksumTrailer(const Socket &socket, const uint32_t crc) {
+    return socket.sendData((TRAILER_PREFIX + formatChecksum(crc)).c_str()) != -1;
+}
+
+
+bool receiveChecksumTrailer(const Socket &socket, uint32_t &crc) {
+    const size_t prefixSize = sizeof(TRAILER_PREFIX) - 1;
+    const char *data;
+    const ssize_t size = socket.receiveView(data, MESSAGE_SIZE);
+    if (size < 0) {
+        return false;
+    }
+    if (static_cast<size_t>(size) != prefixSize + 8 || memcmp(data, TRAILER_PREFIX, prefixSize) != 0) {
+        errno = EPROTO;
+        return false;
+    }
+
+    if (!parseChecksum(std::string(data + prefixSize, size - prefixSize), crc)) {
+        errno = EPROTO;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,468 @@
+#include "DeltaSync.h"
+#include "Crc32c.h"
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+
+constexpr size_t MIN_BLOCK_SIZE = 2 * 1024;
+constexpr size_t MAX_BLOCK_SIZE = 128 * 1024;
+constexpr size_t SIGNATURES_PER_FRAME = 4096;
+constexpr size_t READ_BUFFER_SIZE = 4 * 1024 * 1024;
+
+
+static void writeWord(char *data, const uint32_t value) {
+    data[0] = static_cast<char>(value >> 24);
+    data[1] = static_cast<char>(value >> 16);
+    data[2] = static_cast<char>(value >> 8);
+    data[3] = static_cast<char>(value);
+}
+
+
+static uint32_t readWord(const char *data) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+    return static_cast<uint32_t>(bytes[0]) << 24 | static_cast<uint32_t>(bytes[1]) << 16 |
+           static_cast<uint32_t>(bytes[2]) << 8 | bytes[3];
+}
+
+
+static inline uint64_t readLittleEndian64(const unsigned char *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+
+static inline uint64_t rotateLeft(const uint64_t value, const unsigned bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+static inline uint64_t finalMix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+
+static std::string formatSize(const uint64_t bytes) {
+    std::ostringstream size;
+    size << std::fixed << std::setprecision(1);
+    if (bytes < 1024 * 1024) {
+        size << bytes / 1024.0 << " KiB";
+    } else {
+        size << bytes / (1024.0 * 1024.0) << " MiB";
+    }
+    return size.str();
+}
+
+
+static inline uint32_t weakTag(const uint32_t weak) {
+    return (weak ^ (weak >> 16)) & 0xffff;
+}
+
+
+void RollingChecksum::reset(const char *data, const size_t size) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+    uint32_t sum = 0, weightedSum = 0;
+    _size = static_cast<uint32_t>(size);
+    // b = sum((size - i) * x[i]), written without the running dependency so the loop vectorizes
+    for (uint32_t i = 0; i < _size; ++i) {
+        sum += bytes[i];
+        weightedSum += i * bytes[i];
+    }
+    _a = sum;
+    _b = _size * sum - weightedSum;
+}
+
+
+void RollingChecksum::roll(const unsigned char out, const unsigned char in) {
+    _a += in - out;
+    _b += _a - _size * out;
+}
+
+
+uint32_t RollingChecksum::value() const {
+    return (_a & 0xffff) | (_b << 16);
+}
+
+
+size_t deltaBlockSize(const off_t fileSize) {
+    const size_t root = static_cast<size_t>(std::sqrt(static_cast<double>(fileSize)));
+    return std::max(MIN_BLOCK_SIZE, std::min(MAX_BLOCK_SIZE, (root + 1023) & ~static_cast<size_t>(1023)));
+}
+
+
+// MurmurHash3 x64/128: collisions only ever corrupt the uploader's own file, and SHA-256 would make
+// signing a multi-GB file CPU-bound on both sides
+void deltaStrongHash(const char *data, const size_t size, unsigned char *hash) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+    const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0, h2 = 0;
+
+    const size_t blocks = size / 16;
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t k1 = readLittleEndian64(bytes + 16 * i);
+        uint64_t k2 = readLittleEndian64(bytes + 16 * i + 8);
+
+        k1 *= c1;
+        k1 = rotateLeft(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotateLeft(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = rotateLeft(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+        h2 = rotateLeft(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char *tail = bytes + 16 * blocks;
+    const size_t tailSize = size & 15;
+    uint64_t k1 = 0, k2 = 0;
+    for (size_t i = 0; i < tailSize; ++i) {
+        if (i < 8) {
+            k1 |= static_cast<uint64_t>(tail[i]) << (8 * i);
+        } else {
+            k2 |= static_cast<uint64_t>(tail[i]) << (8 * (i - 8));
+        }
+    }
+    if (tailSize > 8) {
+        k2 *= c2;
+        k2 = rotateLeft(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+    }
+    if (tailSize > 0) {
+        k1 *= c1;
+        k1 = rotateLeft(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = finalMix(h1);
+    h2 = finalMix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    for (int i = 0; i < 8; ++i) {
+        hash[i] = static_cast<unsigned char>(h1 >> (56 - 8 * i));
+        hash[8 + i] = static_cast<unsigned char>(h2 >> (56 - 8 * i));
+    }
+}
+
+
+bool sendSignatures(const Socket &socket, const int fileFd, const off_t fileSize, const size_t blockSize,
+                    std::vector<uint32_t> *blockChecksums) {
+    const off_t blockCount = fileSize / blockSize; // a short last block is never matched, so it is not signed
+    const size_t blocksPerRead = std::max<size_t>(1, READ_BUFFER_SIZE / blockSize);
+    std::vector<char> buffer(blocksPerRead * blockSize);
+    std::string frame;
+    frame.reserve(SIGNATURES_PER_FRAME * DELTA_SIGNATURE_SIZE);
+
+    RollingChecksum checksum;
+    for (off_t block = 0; block < blockCount;) {
+        const size_t blocks = std::min<off_t>(blocksPerRead, blockCount - block);
+        const ssize_t bytes = static_cast<ssize_t>(blocks * blockSize);
+        if (pread(fileFd, buffer.data(), bytes, block * blockSize) != bytes) {
+            return false;
+        }
+
+        for (size_t i = 0; i < blocks; ++i) {
+            char signature[DELTA_SIGNATURE_SIZE];
+            checksum.reset(buffer.data() + i * blockSize, blockSize);
+            writeWord(signature, checksum.value());
+            deltaStrongHash(buffer.data() + i * blockSize, blockSize, reinterpret_cast<unsigned char *>(signature + 4));
+            frame.append(signature, sizeof(signature));
+            if (blockChecksums != nullptr) {
+                blockChecksums->push_back(crc32c(0, buffer.data() + i * blockSize, blockSize));
+            }
+
+            if (frame.size() == SIGNATURES_PER_FRAME * DELTA_SIGNATURE_SIZE) {
+                if (socket.sendData(frame.data(), frame.size()) == -1) {
+                    return false;
+                }
+                frame.clear();
+            }
+        }
+        block += blocks;
+    }
+
+    return (frame.empty() || socket.sendData(frame.data(), frame.size()) != -1) && socket.sendData("", 0) != -1;
+}
+
+
+bool receiveSignatures(const Socket &socket, std::vector<BlockSignature> &signatures) {
+    signatures.clear();
+    while (true) {
+        const char *frame;
+        const ssize_t frameSize = socket.receiveView(frame, SIGNATURES_PER_FRAME * DELTA_SIGNATURE_SIZE);
+        if (frameSize == 0) {
+            return true;
+        }
+        if (frameSize < 0) {
+            return false;
+        }
+        if (frameSize % DELTA_SIGNATURE_SIZE != 0) {
+            errno = EPROTO;
+            return false;
+        }
+
+        for (const char *signature = frame; signature < frame + frameSize; signature += DELTA_SIGNATURE_SIZE) {
+            BlockSignature block;
+            block.weak = readWord(signature);
+            memcpy(block.strong, signature + 4, DELTA_STRONG_HASH_SIZE);
+            signatures.push_back(block);
+        }
+    }
+}
+
+
+size_t parseDeltaInstruction(const char *data, const size_t size, DeltaInstruction &instruction) {
+    if (size == 0) {
+        return 0;
+    }
+
+    instruction.type = data[0];
+    if (instruction.type == DELTA_COPY && size >= DELTA_COPY_SIZE) {
+        instruction.firstBlock = readWord(data + 1);
+        instruction.blockCount = readWord(data + 5);
+        return DELTA_COPY_SIZE;
+    }
+    if (instruction.type == DELTA_LITERAL && size >= DELTA_LITERAL_HEADER_SIZE) {
+        instruction.literalSize = readWord(data + 1);
+        instruction.literal = data + DELTA_LITERAL_HEADER_SIZE;
+        if (instruction.literalSize <= size - DELTA_LITERAL_HEADER_SIZE) {
+            return DELTA_LITERAL_HEADER_SIZE + instruction.literalSize;
+        }
+    }
+    return 0;
+}
+
+
+DeltaEncoder::DeltaEncoder(const std::vector<BlockSignature> &signatures, const size_t blockSize) :
+    _signatures(signatures), _blockSize(blockSize), _weakTags(1 << 16, false) {
+    for (size_t i = 0; i < signatures.size(); ++i) {
+        _blocksByWeak[signatures[i].weak].push_back(static_cast<uint32_t>(i));
+        _weakTags[weakTag(signatures[i].weak)] = true;
+    }
+}
+
+
+bool DeltaEncoder::send(const Socket &socket, const int fileFd, const off_t fileSize, const size_t frameSize,
+                        FrameCompressor *compressor) {
+    _socket = &socket;
+    _compressor = compressor;
+    _frameSize = frameSize;
+    if (compressor) {
+        _frameData = compressor->input();
+    } else {
+        _frame.resize(frameSize);
+        _frameData = _frame.data();
+    }
+
+    // the window slides through a buffer that is refilled once fewer than blockSize bytes are left in it
+    std::vector<char> buffer(std::max(READ_BUFFER_SIZE, 2 * _blockSize));
+    size_t available = 0, position = 0, literalStart = 0;
+    off_t fileOffset = 0;
+    RollingChecksum checksum;
+    bool rolling = false;
+    long expectedBlock = 0; // in-place edits leave the following blocks where they were
+
+    while (true) {
+        if (available - position < _blockSize && fileOffset < fileSize) {
+            emitLiteral(buffer.data() + literalStart, position - literalStart);
+            memmove(buffer.data(), buffer.data() + position, available - position);
+            available -= position;
+            position = 0;
+            literalStart = 0;
+
+            const ssize_t bytesRead = pread(fileFd, buffer.data() + available,
+                                            std::min<off_t>(buffer.size() - available, fileSize - fileOffset),
+                                            fileOffset);
+            if (bytesRead <= 0) {
+                return false;
+            }
+            _checksum = crc32c(_checksum, buffer.data() + available, bytesRead);
+            fileOffset += bytesRead;
+            available += bytesRead;
+            continue;
+        }
+        if (available - position < _blockSize) {
+            break;
+        }
+        if (_signatures.empty()) {
+            position = available; // nothing to match, the whole file is literal
+            continue;
+        }
+
+        if (!rolling) {
+            checksum.reset(buffer.data() + position, _blockSize);
+            rolling = true;
+        }
+        const long block = findBlock(checksum.value(), buffer.data() + position, expectedBlock);
+        if (block >= 0) {
+            emitLiteral(buffer.data() + literalStart, position - literalStart);
+            emitCopy(static_cast<uint32_t>(block));
+            position += _blockSize;
+            literalStart = position;
+            rolling = false;
+            expectedBlock = block + 1;
+            continue;
+        }
+
+        if (position + _blockSize < available) {
+            checksum.roll(buffer[position], buffer[position + _blockSize]);
+        } else {
+            rolling = false;
+        }
+        ++position;
+    }
+
+    emitLiteral(buffer.data() + literalStart, available - literalStart);
+    flushCopy();
+    flushFrame();
+    return !_sendFailed && socket.sendData("", 0) != -1;
+}
+
+
+uint64_t DeltaEncoder::literalBytes() const {
+    return _literalBytes;
+}
+
+
+uint64_t DeltaEncoder::copiedBytes() const {
+    return _copiedBytes;
+}
+
+
+uint32_t DeltaEncoder::checksum() const {
+    return _checksum;
+}
+
+
+std::string DeltaEncoder::summary() const {
+    const uint64_t totalBytes = _literalBytes + _copiedBytes;
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(1) << formatSize(_literalBytes) << " sent, "
+            << formatSize(_copiedBytes) << " matched (" << (totalBytes == 0 ? 0.0 : 100.0 * _copiedBytes / totalBytes)
+            << "% skipped)";
+    return summary.str();
+}
+
+
+long DeltaEncoder::findBlock(const uint32_t weak, const char *data, const long expectedBlock) const {
+    unsigned char strong[DELTA_STRONG_HASH_SIZE];
+    bool strongReady = false;
+
+    if (expectedBlock < static_cast<long>(_signatures.size()) && _signatures[expectedBlock].weak == weak) {
+        deltaStrongHash(data, _blockSize, strong);
+        strongReady = true;
+        if (memcmp(strong, _signatures[expectedBlock].strong, DELTA_STRONG_HASH_SIZE) == 0) {
+            return expectedBlock;
+        }
+    }
+
+    if (!_weakTags[weakTag(weak)]) {
+        return -1;
+    }
+    const auto candidates = _blocksByWeak.find(weak);
+    if (candidates == _blocksByWeak.end()) {
+        return -1;
+    }
+    for (const uint32_t block: candidates->second) {
+        if (!strongReady) {
+            deltaStrongHash(data, _blockSize, strong);
+            strongReady = true;
+        }
+        if (memcmp(strong, _signatures[block].strong, DELTA_STRONG_HASH_SIZE) == 0) {
+            return block;
+        }
+    }
+    return -1;
+}
+
+
+void DeltaEncoder::emitCopy(const uint32_t block) {
+    if (_copyCount > 0 && _copyFirst + _copyCount == block) {
+        ++_copyCount;
+    } else {
+        flushCopy();
+        _copyFirst = block;
+        _copyCount = 1;
+    }
+    _copiedBytes += _blockSize;
+}
+
+
+void DeltaEncoder::emitLiteral(const char *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    flushCopy();
+    _literalBytes += size;
+
+    // literals are split so that no instruction spans two frames
+    while (size > 0) {
+        if (_frameSize - _frameUsed <= DELTA_LITERAL_HEADER_SIZE) {
+            flushFrame();
+        }
+        const size_t piece = std::min(size, _frameSize - _frameUsed - DELTA_LITERAL_HEADER_SIZE);
+        _frameData[_frameUsed] = DELTA_LITERAL;
+        writeWord(_frameData + _frameUsed + 1, static_cast<uint32_t>(piece));
+        memcpy(_frameData + _frameUsed + DELTA_LITERAL_HEADER_SIZE, data, piece);
+        _frameUsed += DELTA_LITERAL_HEADER_SIZE + piece;
+        data += piece;
+        size -= piece;
+    }
+}
+
+
+void DeltaEncoder::flushCopy() {
+    if (_copyCount == 0) {
+        return;
+    }
+    if (_frameSize - _frameUsed < DELTA_COPY_SIZE) {
+        flushFrame();
+    }
+    _frameData[_frameUsed] = DELTA_COPY;
+    writeWord(_frameData + _frameUsed + 1, _copyFirst);
+    writeWord(_frameData + _frameUsed + 5, _copyCount);
+    _frameUsed += DELTA_COPY_SIZE;
+    _copyCount = 0;
+}
+
+
+void DeltaEncoder::flushFrame() {
+    if (_frameUsed == 0) {
+        return;
+    }
+    const ssize_t sent = _compressor ? _compressor->sendFrame(*_socket, _frameUsed)
+                                     : _socket->sendData(_frameData, _frameUsed);
+    if (sent == -1) {
+        _sendFailed = true;
+    }
+    _frameUsed = 0;
+}
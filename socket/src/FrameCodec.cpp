@@ -0,0 +1,184 @@
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iomanip>
+#include <sstream>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+
+constexpr char FRAME_RAW = 0;
+constexpr char FRAME_DEFLATE = 1;
+
+// level 1 keeps compression well ahead of a gigabit link; higher levels gain little on logs and CSV
+constexpr int COMPRESSION_LEVEL = 1;
+// frames that do not shrink below 90% go out raw, and the next ones are not even tried
+constexpr double MAX_COMPRESSED_RATIO = 0.9;
+constexpr unsigned MAX_SKIP_FRAMES = 64;
+
+
+FrameCompressor::FrameCompressor(const size_t frameSize) : _input(frameSize + 1), _output(frameSize + 1) {
+    _input[0] = FRAME_RAW;
+    _output[0] = FRAME_DEFLATE;
+#ifdef HAVE_ZLIB
+    _stream = new z_stream();
+    if (deflateInit2(_stream, COMPRESSION_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete _stream;
+        _stream = nullptr; // every frame goes out raw
+    }
+#endif
+}
+
+
+char *FrameCompressor::input() {
+    return _input.data() + 1;
+}
+
+
+ssize_t FrameCompressor::sendFrame(const Socket &socket, const size_t size) {
+    const char *frame = _input.data();
+    size_t frameBytes = size + 1;
+
+#ifdef HAVE_ZLIB
+    if (_stream != nullptr && _skipFrames == 0 && size > 0) {
+        deflateReset(_stream);
+        _stream->next_in = reinterpret_cast<Bytef *>(_input.data() + 1);
+        _stream->avail_in = static_cast<uInt>(size);
+        _stream->next_out = reinterpret_cast<Bytef *>(_output.data() + 1);
+        _stream->avail_out = static_cast<uInt>(size * MAX_COMPRESSED_RATIO);
+
+        // running out of room before the end means the frame is not worth compressing
+        if (deflate(_stream, Z_FINISH) == Z_STREAM_END) {
+            frame = _output.data();
+            frameBytes = _stream->total_out + 1;
+            _skipBackoff = 1;
+        } else {
+            _skipFrames = _skipBackoff;
+            _skipBackoff = std::min(_skipBackoff * 2, MAX_SKIP_FRAMES);
+        }
+    } else if (_skipFrames > 0) {
+        --_skipFrames;
+    }
+#endif
+
+    if (socket.sendData(frame, frameBytes) == -1) {
+        return -1;
+    }
+    _rawBytes += size;
+    _wireBytes += frameBytes;
+    return static_cast<ssize_t>(size);
+}
+
+
+uint64_t FrameCompressor::rawBytes() const {
+    return _rawBytes;
+}
+
+
+uint64_t FrameCompressor::wireBytes() const {
+    return _wireBytes;
+}
+
+
+FrameCompressor::~FrameCompressor() {
+#ifdef HAVE_ZLIB
+    if (_stream != nullptr) {
+        deflateEnd(_stream);
+        delete _stream;
+    }
+#endif
+}
+
+
+FrameDecompressor::FrameDecompressor(const size_t frameSize) : _frameSize(frameSize), _output(frameSize) {
+#ifdef HAVE_ZLIB
+    _stream = new z_stream();
+    if (inflateInit2(_stream, -MAX_WBITS) != Z_OK) {
+        delete _stream;
+        _stream = nullptr; // deflated frames are reported as corrupt
+    }
+#endif
+}
+
+
+ssize_t FrameDecompressor::receiveFrame(const Socket &socket, const char *&data) {
+    const char *frame;
+    // a compressed frame is always smaller than the raw one, so neither kind exceeds the marker plus frameSize
+    const ssize_t frameBytes = socket.receiveView(frame, _frameSize + 1);
+    if (frameBytes <= 0) {
+        return frameBytes;
+    }
+    _wireBytes += frameBytes;
+
+    if (frame[0] == FRAME_RAW) {
+        data = frame + 1;
+        _rawBytes += frameBytes - 1;
+        return frameBytes - 1;
+    }
+
+#ifdef HAVE_ZLIB
+    if (frame[0] == FRAME_DEFLATE && _stream != nullptr) {
+        inflateReset(_stream);
+        _stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(frame + 1));
+        _stream->avail_in = static_cast<uInt>(frameBytes - 1);
+        _stream->next_out = reinterpret_cast<Bytef *>(_output.data());
+        _stream->avail_out = static_cast<uInt>(_output.size());
+
+        // anything that does not end within frameSize bytes is corrupt or hostile
+        if (inflate(_stream, Z_FINISH) == Z_STREAM_END && _stream->avail_in == 0) {
+            data = _output.data();
+            _rawBytes += _stream->total_out;
+            return static_cast<ssize_t>(_stream->total_out);
+        }
+    }
+#endif
+
+    errno = EPROTO;
+    return -1;
+}
+
+
+uint64_t FrameDecompressor::rawBytes() const {
+    return _rawBytes;
+}
+
+
+uint64_t FrameDecompressor::wireBytes() const {
+    return _wireBytes;
+}
+
+
+FrameDecompressor::~FrameDecompressor() {
+#ifdef HAVE_ZLIB
+    if (_stream != nullptr) {
+        inflateEnd(_stream);
+        delete _stream;
+    }
+#endif
+}
+
+
+bool compressionSupported() {
+#ifdef HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+std::string compressionSummary(const uint64_t rawBytes, const uint64_t wireBytes,
+                               const std::chrono::steady_clock::duration elapsed) {
+    const double mebibyte = 1024.0 * 1024.0;
+    const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(1) << "compressed "
+            << (wireBytes == 0 ? 1.0 : static_cast<double>(rawBytes) / wireBytes) << "x ("
+            << rawBytes / mebibyte << " MiB as " << wireBytes / mebibyte << " MiB, "
+            << rawBytes / mebibyte / seconds << " MiB/s)";
+    return summary.str();
+}
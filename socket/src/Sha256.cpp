@@ -0,0 +1,139 @@
+#include "Sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+static const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static inline uint32_t rotateRight(const uint32_t value, const unsigned bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+
+Sha256::Sha256() : _state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+                          0x5be0cd19} {
+}
+
+
+void Sha256::update(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    _totalSize += size;
+
+    if (_blockSize > 0) {
+        const size_t taken = std::min(size, sizeof(_block) - _blockSize);
+        memcpy(_block + _blockSize, bytes, taken);
+        _blockSize += taken;
+        bytes += taken;
+        size -= taken;
+        if (_blockSize < sizeof(_block)) {
+            return;
+        }
+        transform(_block);
+        _blockSize = 0;
+    }
+
+    // whole blocks are hashed in place, only the tail is buffered
+    for (; size >= sizeof(_block); bytes += sizeof(_block), size -= sizeof(_block)) {
+        transform(bytes);
+    }
+    memcpy(_block, bytes, size);
+    _blockSize = size;
+}
+
+
+void Sha256::finish(unsigned char *digest) {
+    const uint64_t totalBits = _totalSize * 8;
+
+    _block[_blockSize++] = 0x80;
+    if (_blockSize > sizeof(_block) - 8) {
+        memset(_block + _blockSize, 0, sizeof(_block) - _blockSize);
+        transform(_block);
+        _blockSize = 0;
+    }
+    memset(_block + _blockSize, 0, sizeof(_block) - 8 - _blockSize);
+    for (int i = 0; i < 8; ++i) {
+        _block[63 - i] = static_cast<unsigned char>(totalBits >> (8 * i));
+    }
+    transform(_block);
+
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<unsigned char>(_state[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(_state[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(_state[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(_state[i]);
+    }
+}
+
+
+std::string Sha256::digest(const void *data, const size_t size) {
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    Sha256 hash;
+    hash.update(data, size);
+    hash.finish(digest);
+    return {reinterpret_cast<const char *>(digest), sizeof(digest)};
+}
+
+
+std::string Sha256::toHex(const std::string &digest) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (const char c: digest) {
+        hex += HEX_DIGITS[static_cast<unsigned char>(c) >> 4];
+        hex += HEX_DIGITS[static_cast<unsigned char>(c) & 0x0f];
+    }
+    return hex;
+}
+
+
+void Sha256::transform(const unsigned char *block) {
+    uint32_t schedule[64];
+    for (int i = 0; i < 16; ++i) {
+        schedule[i] = static_cast<uint32_t>(block[4 * i]) << 24 | static_cast<uint32_t>(block[4 * i + 1]) << 16 |
+                      static_cast<uint32_t>(block[4 * i + 2]) << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^
+                            (schedule[i - 15] >> 3);
+        const uint32_t s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^
+                            (schedule[i - 2] >> 10);
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+                            ROUND_CONSTANTS[i] + schedule[i];
+        const uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) +
+                            ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    _state[0] += a;
+    _state[1] += b;
+    _state[2] += c;
+    _state[3] += d;
+    _state[4] += e;
+    _state[5] += f;
+    _state[6] += g;
+    _state[7] += h;
+}
@@ -1,11 +1,39 @@
 #include "Socket.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <vector>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
-Socket::Socket(const int socketFd) : _socketFd(socketFd) {
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+
+// Bytes read from the connection but not consumed yet; frames are parsed out of [begin, end).
+struct ReceiveBuffer {
+    std::vector<char> data;
+    size_t begin{0};
+    size_t end{0};
+
+    void reset() {
+        begin = end = 0;
+    }
+};
+
+
+Socket::Socket(const int socketFd) : _socketFd(socketFd), _receiveBuffer(std::make_shared<ReceiveBuffer>()) {
 }
 
 
@@ -24,6 +52,7 @@ void Socket::closeS() {
         close(_socketFd);
     }
     _socketFd = -1;
+    _receiveBuffer->reset();
 }
 
 
@@ -55,7 +84,9 @@ int Socket::acceptS(sockaddr_in *clientAddr, socklen_t *clientLen) const {
                                     reinterpret_cast<struct sockaddr *>(clientAddr),
                                     clientLen);
     if (clientSocket == -1) {
-        if (_shutdownFlag && errno == ECONNABORTED) {
+        // running out of descriptors is left to the caller, which would otherwise report it on every retry
+        if ((_shutdownFlag && errno == ECONNABORTED) || errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE ||
+            errno == ENFILE) {
             return -1;
         }
         perror("Accept failed");
@@ -99,40 +130,277 @@ ssize_t Socket::sendData(const char *data, size_t dataLen) const {
         return -1; // data too large to send
     }
 
-    const uint32_t netDataLen = htonl(static_cast<uint32_t>(dataLen));
-    const ssize_t sentBytes = send(_socketFd, &netDataLen, sizeof(netDataLen), 0);
-    if (sentBytes != sizeof(netDataLen)) {
-        return -1; // failed to send complete length prefix
-    }
-    if (sentBytes == 0) {
-        return 0;
+    // length prefix and payload leave in a single sendmsg() so they share a TCP segment
+    uint32_t netDataLen = htonl(static_cast<uint32_t>(dataLen));
+    iovec parts[2];
+    parts[0].iov_base = &netDataLen;
+    parts[0].iov_len = sizeof(netDataLen);
+    parts[1].iov_base = const_cast<char *>(data);
+    parts[1].iov_len = dataLen;
+
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = dataLen == 0 ? 1 : 2;
+
+    size_t remaining = sizeof(netDataLen) + dataLen;
+    while (remaining > 0) {
+        ssize_t sentBytes = sendmsg(_socketFd, &message, SEND_FLAGS);
+        if (sentBytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sentBytes <= 0) {
+            return -1;
+        }
+        remaining -= sentBytes;
+
+        while (sentBytes > 0) {
+            if (static_cast<size_t>(sentBytes) >= message.msg_iov->iov_len) {
+                sentBytes -= message.msg_iov->iov_len;
+                ++message.msg_iov;
+                --message.msg_iovlen;
+            } else {
+                message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + sentBytes;
+                message.msg_iov->iov_len -= sentBytes;
+                sentBytes = 0;
+            }
+        }
     }
 
-    return send(_socketFd, data, dataLen, 0);
+    return static_cast<ssize_t>(dataLen);
 }
 
 
 ssize_t Socket::receiveData(char *buffer, const size_t bufferSize) const {
-    if (!setRecvTimeout()) {
-        return -1; // failed to set receive timeout
+    const char *data;
+    const ssize_t dataLen = receiveView(data, bufferSize);
+    if (dataLen > 0) {
+        memcpy(buffer, data, dataLen);
     }
+    return dataLen;
+}
 
+
+ssize_t Socket::receiveView(const char *&data, const size_t maxSize) const {
     uint32_t netDataLen;
-    const ssize_t receivedBytes = recv(_socketFd, &netDataLen, sizeof(netDataLen), MSG_WAITALL);
-    if (receivedBytes != sizeof(netDataLen) && receivedBytes != 0) {
-        return -1; // failed to receive complete length prefix
-    }
-    if (receivedBytes == 0) {
-        return 0;
+    if (!fillReceiveBuffer(sizeof(netDataLen))) {
+        return -1; // peer closed the connection (ECONNRESET) or receive failed
     }
 
+    ReceiveBuffer &buffer = *_receiveBuffer;
+    memcpy(&netDataLen, buffer.data.data() + buffer.begin, sizeof(netDataLen));
     const uint32_t dataLen = ntohl(netDataLen);
 
-    if (dataLen > bufferSize) {
-        return -1; // buffer is too small for incoming data
+    if (dataLen > maxSize) {
+        errno = EMSGSIZE;
+        return -1; // frame is larger than the caller accepts
+    }
+    if (!fillReceiveBuffer(sizeof(netDataLen) + dataLen)) {
+        return -1;
+    }
+
+    // the view stays valid until the next receive on this connection
+    data = buffer.data.data() + buffer.begin + sizeof(netDataLen);
+    buffer.begin += sizeof(netDataLen) + dataLen;
+    if (buffer.begin == buffer.end) {
+        buffer.reset();
+    }
+    return dataLen;
+}
+
+
+// Reads what has already arrived into the receive buffer, without blocking and without growing the buffer past
+// RECEIVE_BUFFER_SIZE. False once the peer has closed the connection or it failed; the next receive tells which.
+bool Socket::receiveAvailable() const {
+    ReceiveBuffer &buffer = *_receiveBuffer;
+    if (buffer.begin > 0) {
+        const size_t pending = buffer.end - buffer.begin;
+        memmove(buffer.data.data(), buffer.data.data() + buffer.begin, pending);
+        buffer.begin = 0;
+        buffer.end = pending;
+    }
+    if (buffer.data.size() < static_cast<size_t>(RECEIVE_BUFFER_SIZE)) {
+        buffer.data.resize(RECEIVE_BUFFER_SIZE);
+    }
+
+    while (buffer.end < buffer.data.size()) {
+        const ssize_t receivedBytes = recv(_socketFd, buffer.data.data() + buffer.end,
+                                           buffer.data.size() - buffer.end, MSG_DONTWAIT);
+        if (receivedBytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (receivedBytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (receivedBytes <= 0) {
+            return false;
+        }
+        buffer.end += receivedBytes;
+    }
+    return true;
+}
+
+
+// True when the next frame is buffered whole, or is too large to wait for without a receiver to grow the buffer
+bool Socket::hasBufferedFrame() const {
+    const ReceiveBuffer &buffer = *_receiveBuffer;
+    uint32_t netDataLen;
+    if (buffer.end - buffer.begin < sizeof(netDataLen)) {
+        return false;
+    }
+    memcpy(&netDataLen, buffer.data.data() + buffer.begin, sizeof(netDataLen));
+    const size_t frameSize = sizeof(netDataLen) + ntohl(netDataLen);
+    return buffer.end - buffer.begin >= frameSize || frameSize > buffer.data.size();
+}
+
+
+bool Socket::fillReceiveBuffer(const size_t needed) const {
+    ReceiveBuffer &buffer = *_receiveBuffer;
+    if (buffer.end - buffer.begin >= needed) {
+        return true;
+    }
+
+    if (buffer.begin + needed > buffer.data.size()) {
+        // move the unread bytes to the front, growing the buffer for frames larger than it
+        const size_t pending = buffer.end - buffer.begin;
+        if (pending > 0) {
+            memmove(buffer.data.data(), buffer.data.data() + buffer.begin, pending);
+        }
+        buffer.begin = 0;
+        buffer.end = pending;
+        if (needed > buffer.data.size()) {
+            buffer.data.resize(std::max(needed, static_cast<size_t>(RECEIVE_BUFFER_SIZE)));
+        }
+    }
+
+    while (buffer.end - buffer.begin < needed) {
+        const ssize_t receivedBytes = recv(_socketFd, buffer.data.data() + buffer.end,
+                                           buffer.data.size() - buffer.end, 0);
+        if (receivedBytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (receivedBytes == 0) {
+            errno = ECONNRESET;
+            return false; // 0 from receiveData is reserved for the zero-length end-of-transfer frame
+        }
+        if (receivedBytes < 0) {
+            return false;
+        }
+        buffer.end += receivedBytes;
+    }
+    return true;
+}
+
+
+ssize_t Socket::sendFile(const int fileFd, off_t offset, const size_t count) const {
+    size_t totalSent = 0;
+
+#ifdef __linux__
+    while (totalSent < count) {
+        const ssize_t sentBytes = sendfile(_socketFd, fileFd, &offset, count - totalSent);
+        if (sentBytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sentBytes <= 0) {
+            return -1; // send error or file shorter than announced
+        }
+        totalSent += sentBytes;
+    }
+#else
+    char buffer[STREAM_BUFFER_SIZE];
+    while (totalSent < count) {
+        const size_t chunkSize = std::min(count - totalSent, sizeof(buffer));
+        const ssize_t bytesRead = pread(fileFd, buffer, chunkSize, offset);
+        if (bytesRead <= 0) {
+            return -1;
+        }
+        if (send(_socketFd, buffer, bytesRead, 0) != bytesRead) {
+            return -1;
+        }
+        offset += bytesRead;
+        totalSent += bytesRead;
     }
+#endif
 
-    return recv(_socketFd, buffer, dataLen, MSG_WAITALL);
+    return static_cast<ssize_t>(totalSent);
+}
+
+
+// Sends count bytes without a length prefix, as sendFile() does; for data that is already in memory.
+ssize_t Socket::sendRaw(const char *data, const size_t count) const {
+    size_t totalSent = 0;
+    while (totalSent < count) {
+        const ssize_t sentBytes = send(_socketFd, data + totalSent, count - totalSent, SEND_FLAGS);
+        if (sentBytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sentBytes <= 0) {
+            return -1;
+        }
+        totalSent += sentBytes;
+    }
+    return static_cast<ssize_t>(totalSent);
+}
+
+
+ssize_t Socket::receiveFile(const int fileFd, const size_t count) const {
+    // bytes that arrived together with the last frame are already in user space
+    ReceiveBuffer &receiveBuffer = *_receiveBuffer;
+    size_t totalReceived = std::min(count, receiveBuffer.end - receiveBuffer.begin);
+    if (totalReceived > 0) {
+        if (write(fileFd, receiveBuffer.data.data() + receiveBuffer.begin, totalReceived) !=
+            static_cast<ssize_t>(totalReceived)) {
+            return -1;
+        }
+        receiveBuffer.begin += totalReceived;
+        if (receiveBuffer.begin == receiveBuffer.end) {
+            receiveBuffer.reset();
+        }
+    }
+
+#ifdef __linux__
+    int pipeFds[2];
+    if (pipe(pipeFds) == -1) {
+        return -1;
+    }
+
+    while (totalReceived < count) {
+        const ssize_t splicedIn = splice(_socketFd, nullptr, pipeFds[1], nullptr,
+                                         std::min(count - totalReceived, static_cast<size_t>(STREAM_BUFFER_SIZE)),
+                                         SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (splicedIn <= 0) {
+            break; // peer closed the connection or receive timed out
+        }
+
+        ssize_t pending = splicedIn;
+        while (pending > 0) {
+            const ssize_t splicedOut = splice(pipeFds[0], nullptr, fileFd, nullptr, pending, SPLICE_F_MOVE);
+            if (splicedOut <= 0) {
+                close(pipeFds[0]);
+                close(pipeFds[1]);
+                return -1;
+            }
+            pending -= splicedOut;
+        }
+        totalReceived += splicedIn;
+    }
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+#else
+    char buffer[STREAM_BUFFER_SIZE];
+    while (totalReceived < count) {
+        const ssize_t receivedBytes = recv(_socketFd, buffer, std::min(count - totalReceived, sizeof(buffer)), 0);
+        if (receivedBytes <= 0) {
+            break;
+        }
+        if (write(fileFd, buffer, receivedBytes) != receivedBytes) {
+            return -1;
+        }
+        totalReceived += receivedBytes;
+    }
+#endif
+
+    return static_cast<ssize_t>(totalReceived);
 }
 
 
@@ -153,6 +421,67 @@ bool Socket::setRecvTimeout() const {
 }
 
 
+bool Socket::setNonBlocking(const bool nonBlocking) const {
+    const int flags = fcntl(_socketFd, F_GETFL, 0);
+    if (flags == -1) {
+        perror("error reading socket flags");
+        return false;
+    }
+
+    const int newFlags = nonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    if (fcntl(_socketFd, F_SETFL, newFlags) == -1) {
+        perror("error setting socket flags");
+        return false;
+    }
+    return true;
+}
+
+
+bool Socket::setNoDelay(const bool enabled) const {
+    const int value = enabled ? 1 : 0;
+    if (setsockopt(_socketFd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) == -1) {
+        perror("error setting TCP_NODELAY");
+        return false;
+    }
+    return true;
+}
+
+
+bool Socket::setCork(const bool enabled) const {
+    const int value = enabled ? 1 : 0;
+#ifdef TCP_CORK
+    const int option = TCP_CORK;
+#else
+    const int option = TCP_NOPUSH;
+#endif
+    if (setsockopt(_socketFd, IPPROTO_TCP, option, &value, sizeof(value)) == -1) {
+        perror("error setting TCP_CORK");
+        return false;
+    }
+    return true;
+}
+
+
+bool Socket::setReuseAddress(const bool enabled) const {
+    const int value = enabled ? 1 : 0;
+    if (setsockopt(_socketFd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value)) == -1) {
+        perror("error setting SO_REUSEADDR");
+        return false;
+    }
+    return true;
+}
+
+
+bool Socket::setReusePort(const bool enabled) const {
+    const int value = enabled ? 1 : 0;
+    if (setsockopt(_socketFd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) == -1) {
+        perror("error setting SO_REUSEPORT");
+        return false;
+    }
+    return true;
+}
+
+
 int Socket::getS() const {
     return _socketFd;
 }
@@ -160,9 +489,11 @@ int Socket::getS() const {
 
 void Socket::setS(const int s) {
     _socketFd = s;
+    _receiveBuffer->reset();
 }
 
 
-void Socket::setTimeoutSeconds(const int timeoutSeconds) {
+bool Socket::setTimeoutSeconds(const int timeoutSeconds) {
     _timeoutSeconds = timeoutSeconds;
+    return setRecvTimeout();
 }
@@ -0,0 +1,81 @@
+#include "TransferOptions.h"
+#include "Socket.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+
+bool TransferOptions::empty() const {
+    return !streamGet && frameSize == 0 && !compress && !dedup && !delta && !checksum && inlineLimit == 0;
+}
+
+
+size_t TransferOptions::dataFrameSize() const {
+    return frameSize == 0 ? FILE_BUFFER_SIZE : frameSize;
+}
+
+
+std::string TransferOptions::toString() const {
+    std::vector<std::string> tokens;
+    if (streamGet) {
+        tokens.push_back("stream=1");
+    }
+    if (frameSize != 0) {
+        tokens.push_back("frame=" + std::to_string(frameSize));
+    }
+    if (compress) {
+        tokens.push_back("compress=zlib");
+    }
+    if (dedup) {
+        tokens.push_back("dedup=1");
+    }
+    if (delta) {
+        tokens.push_back("delta=1");
+    }
+    if (checksum) {
+        tokens.push_back("crc=1");
+    }
+    if (inlineLimit != 0) {
+        tokens.push_back("inline=" + std::to_string(inlineLimit));
+    }
+
+    std::ostringstream stream;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        stream << (i == 0 ? "" : " ") << tokens[i];
+    }
+    return stream.str();
+}
+
+
+TransferOptions TransferOptions::parse(const std::string &text) {
+    TransferOptions options;
+    std::istringstream stream(text);
+    std::string token;
+
+    while (stream >> token) {
+        const size_t separator = token.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+
+        const std::string key = token.substr(0, separator);
+        const std::string value = token.substr(separator + 1);
+        if (key == "stream") {
+            options.streamGet = value == "1";
+        } else if (key == "frame") {
+            options.frameSize = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (key == "compress") {
+            options.compress = value == "zlib";
+        } else if (key == "dedup") {
+            options.dedup = value == "1";
+        } else if (key == "delta") {
+            options.delta = value == "1";
+        } else if (key == "crc") {
+            options.checksum = value == "1";
+        } else if (key == "inline") {
+            options.inlineLimit = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+    }
+    return options;
+}